@@ -0,0 +1,317 @@
+#include "http_body.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+static const char *TAG = "http_body";
+
+static uint8_t s_arena[CONFIG_HTTP_BODY_ARENA_SIZE]
+    __attribute__((aligned(4)));
+static size_t s_used = 0;
+
+static size_t arena_free(void) { return sizeof(s_arena) - s_used; }
+
+void *http_body_alloc(size_t n) {
+  n = (n + 3) & ~(size_t)3;
+  if (n > arena_free()) {
+    return NULL;
+  }
+  void *p = s_arena + s_used;
+  s_used += n;
+  return p;
+}
+
+void http_body_reset(void) { s_used = 0; }
+
+// 413 right away, the body stays unread
+static esp_err_t too_large(httpd_req_t *req) {
+  ESP_LOGW(TAG, "%s: %u byte body refused", req->uri,
+           (unsigned)req->content_len);
+  httpd_resp_set_status(req, "413 Payload Too Large");
+  httpd_resp_sendstr(req, "Body too large\n");
+  return ESP_FAIL;
+}
+
+static int recv_some(httpd_req_t *req, char *buf, size_t len) {
+  int ret = httpd_req_recv(req, buf, len);
+  if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+    httpd_resp_send_408(req);
+  }
+  return ret;
+}
+
+esp_err_t http_body_read(httpd_req_t *req, size_t max_len, char **out,
+                         size_t *out_len) {
+  size_t len = req->content_len;
+  char *buf = len <= max_len ? http_body_alloc(len + 1) : NULL;
+  if (!buf) {
+    return too_large(req);
+  }
+  for (size_t got = 0; got < len;) {
+    int ret = recv_some(req, buf + got, len - got);
+    if (ret <= 0) {
+      return ESP_FAIL;
+    }
+    got += ret;
+  }
+  buf[len] = '\0';
+  *out = buf;
+  if (out_len) {
+    *out_len = len;
+  }
+  return ESP_OK;
+}
+
+esp_err_t http_body_stream(httpd_req_t *req, size_t max_len,
+                           http_body_chunk_fn fn, void *ctx) {
+  size_t left = req->content_len;
+  if (left > max_len) {
+    return too_large(req);
+  }
+  if (left == 0) {
+    return ESP_OK;
+  }
+
+  // whatever the arena has left, recv hands over what has arrived anyway
+  size_t chunk_len = left < arena_free() ? left : arena_free() & ~3;
+  char *chunk = chunk_len ? http_body_alloc(chunk_len) : NULL;
+  if (!chunk) {
+    ESP_LOGE(TAG, "%s: arena used up", req->uri);
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+
+  while (left > 0) {
+    int ret = recv_some(req, chunk, left < chunk_len ? left : chunk_len);
+    if (ret <= 0) {
+      return ESP_FAIL;
+    }
+    left -= ret;
+    esp_err_t err = fn(chunk, ret, ctx);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  return ESP_OK;
+}
+
+typedef struct {
+  char *line;
+  size_t len;
+  size_t max;
+  http_body_line_fn fn;
+  void *ctx;
+} line_splitter_t;
+
+static esp_err_t end_line(line_splitter_t *s) {
+  if (s->len > 0 && s->line[s->len - 1] == '\r') {
+    s->len--;
+  }
+  s->line[s->len] = '\0';
+  s->len = 0;
+  return s->fn(s->line, s->ctx);
+}
+
+static esp_err_t split_lines(const char *data, size_t len, void *ctx) {
+  line_splitter_t *s = ctx;
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == '\n') {
+      esp_err_t err = end_line(s);
+      if (err != ESP_OK) {
+        return err;
+      }
+    } else if (s->len < s->max - 1) {
+      s->line[s->len++] = data[i];
+    } else {
+      return ESP_ERR_INVALID_SIZE;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t http_body_lines(httpd_req_t *req, size_t max_len, size_t line_max,
+                          http_body_line_fn fn, void *ctx) {
+  line_splitter_t s = {.line = http_body_alloc(line_max),
+                       .max = line_max,
+                       .fn = fn,
+                       .ctx = ctx};
+  if (!s.line) {
+    ESP_LOGE(TAG, "%s: arena used up", req->uri);
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+  esp_err_t err = http_body_stream(req, max_len, split_lines, &s);
+  if (err == ESP_OK && s.len > 0) {
+    err = end_line(&s);
+  }
+  return err;
+}
+
+// --- fields ---
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  return (tolower((unsigned char)c) - 'a') + 10;
+}
+
+bool http_url_decode(char *dst, size_t len, const char *src) {
+  size_t n = 0;
+  while (*src) {
+    if (n + 1 >= len) {
+      dst[n] = '\0';
+      return false;
+    }
+    if (src[0] == '%' && isxdigit((unsigned char)src[1]) &&
+        isxdigit((unsigned char)src[2])) {
+      dst[n++] = hex_value(src[1]) * 16 + hex_value(src[2]);
+      src += 3;
+    } else if (*src == '+') {
+      dst[n++] = ' ';
+      src++;
+    } else {
+      dst[n++] = *src++;
+    }
+  }
+  dst[n] = '\0';
+  return true;
+}
+
+static esp_err_t form_field(const char *body, const char *key, char *val,
+                            size_t len) {
+  // encoded it can be three times as long, decoded in place if the arena
+  // has no room
+  size_t enc_len = len * 3;
+  char *enc = http_body_alloc(enc_len);
+  if (!enc) {
+    enc = val;
+    enc_len = len;
+  }
+  esp_err_t err = httpd_query_key_value(body, key, enc, enc_len);
+  if (err == ESP_ERR_NOT_FOUND) {
+    return err;
+  }
+  if (err != ESP_OK || !http_url_decode(val, len, enc)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  return ESP_OK;
+}
+
+static const char *skip_space(const char *s) {
+  while (isspace((unsigned char)*s)) {
+    s++;
+  }
+  return s;
+}
+
+// JSON string from just after the opening quote into out (NULL to skip
+// it). Returns what follows the closing quote, NULL if malformed.
+static const char *json_string(const char *s, char *out, size_t len,
+                               bool *fits) {
+  size_t n = 0;
+  *fits = true;
+  for (; *s && *s != '"'; s++) {
+    char c = *s;
+    if (c == '\\') {
+      static const char esc_in[] = "\"\\/bfnrt";
+      static const char esc_out[] = "\"\\/\b\f\n\r\t";
+      const char *e = *++s ? strchr(esc_in, *s) : NULL;
+      if (e) {
+        c = esc_out[e - esc_in];
+      } else if (*s == 'u' && isxdigit((unsigned char)s[1]) &&
+                 isxdigit((unsigned char)s[2]) &&
+                 isxdigit((unsigned char)s[3]) &&
+                 isxdigit((unsigned char)s[4])) {
+        int cp = hex_value(s[1]) << 12 | hex_value(s[2]) << 8 |
+                 hex_value(s[3]) << 4 | hex_value(s[4]);
+        c = cp < 0x80 ? cp : '?'; // no UTF-8 encoding, ASCII is enough here
+        s += 4;
+      } else {
+        return NULL;
+      }
+    }
+    if (out && n + 1 < len) {
+      out[n++] = c;
+    } else if (out) {
+      *fits = false;
+    }
+  }
+  if (*s != '"') {
+    return NULL;
+  }
+  if (out) {
+    out[n] = '\0';
+  }
+  return s + 1;
+}
+
+// Flat object only, nested objects and arrays are refused
+static esp_err_t json_field(const char *body, const char *key, char *val,
+                            size_t len) {
+  const char *s = skip_space(body) + 1; // past '{'
+  char name[32];
+  bool fits;
+  for (;;) {
+    s = skip_space(s);
+    if (*s == '}') {
+      return ESP_ERR_NOT_FOUND;
+    }
+    if (*s != '"' || !(s = json_string(s + 1, name, sizeof(name), &fits))) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    bool match = fits && strcmp(name, key) == 0;
+    s = skip_space(s);
+    if (*s++ != ':') {
+      return ESP_ERR_INVALID_ARG;
+    }
+    s = skip_space(s);
+
+    if (*s == '"') {
+      s = json_string(s + 1, match ? val : NULL, len, &fits);
+      if (!s) {
+        return ESP_ERR_INVALID_ARG;
+      }
+    } else if (*s == '{' || *s == '[') {
+      return ESP_ERR_INVALID_ARG;
+    } else {
+      // number, true, false or null as its text
+      size_t n = strcspn(s, ",} \t\r\n");
+      if (n == 0) {
+        return ESP_ERR_INVALID_ARG;
+      }
+      if (match) {
+        fits = n < len;
+        if (fits) {
+          memcpy(val, s, n);
+          val[n] = '\0';
+        }
+      }
+      s += n;
+    }
+    if (match) {
+      return fits ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+
+    s = skip_space(s);
+    if (*s == ',') {
+      s++;
+    } else if (*s != '}') {
+      return ESP_ERR_INVALID_ARG;
+    }
+  }
+}
+
+esp_err_t http_body_field(const char *body, const char *key, char *val,
+                          size_t len) {
+  if (len == 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (*skip_space(body) == '{') {
+    return json_field(body, key, val, len);
+  }
+  return form_field(body, key, val, len);
+}
@@ -0,0 +1,51 @@
+#ifndef HTTP_BODY_H
+#define HTTP_BODY_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Request bodies without malloc: everything comes from one static arena
+// of CONFIG_HTTP_BODY_ARENA_SIZE bytes that the server resets after each
+// request. Handlers run one at a time on the server task, so one arena is
+// enough.
+//
+// A body longer than max_len is answered with 413 before any of it is
+// read. The read functions return ESP_FAIL once they have answered
+// (413, 408) or the socket is gone; the handler then returns ESP_FAIL too,
+// which closes the connection instead of draining the rest. Errors from
+// callbacks are passed through unanswered and must not be ESP_FAIL.
+
+// Up to n bytes from the arena, NULL if it is used up
+void *http_body_alloc(size_t n);
+
+// Free the whole arena, done by the server after every handler
+void http_body_reset(void);
+
+// The whole body, NUL-terminated, in the arena
+esp_err_t http_body_read(httpd_req_t *req, size_t max_len, char **out,
+                         size_t *out_len);
+
+// The body in chunks as they arrive, for payloads bigger than the arena
+typedef esp_err_t (*http_body_chunk_fn)(const char *data, size_t len,
+                                        void *ctx);
+esp_err_t http_body_stream(httpd_req_t *req, size_t max_len,
+                           http_body_chunk_fn fn, void *ctx);
+
+// The body one line at a time ('\n' or "\r\n", the last line may lack
+// it). A line longer than line_max - 1 stops with ESP_ERR_INVALID_SIZE.
+typedef esp_err_t (*http_body_line_fn)(char *line, void *ctx);
+esp_err_t http_body_lines(httpd_req_t *req, size_t max_len, size_t line_max,
+                          http_body_line_fn fn, void *ctx);
+
+// %XX and + decoded into dst; false if it had to be cut to fit in len
+bool http_url_decode(char *dst, size_t len, const char *src);
+
+// Field of a body read with http_body_read, either a form
+// (a=1&b=x%20y, decoded) or a flat JSON object ({"a":1,"b":"x y"}).
+// ESP_ERR_NOT_FOUND if missing, ESP_ERR_INVALID_SIZE if it does not fit.
+esp_err_t http_body_field(const char *body, const char *key, char *val,
+                          size_t len);
+
+#endif
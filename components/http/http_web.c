@@ -1,11 +1,25 @@
 #include "http_web.h"
+#include "http_body.h"
 #include "esp_log.h"
 #include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "led_api.h"
+#include "led_bench.h"
 #include "led_effects.h"
+#include "led_layout.h"
+#include "led_output.h"
+#include "led_render.h"
+#include "led_shader.h"
+#include "led_timeline.h"
+#include "scene.h"
+#include "sync.h"
+#include "trace.h"
 #include "wifi_connect.h"
-#include <ctype.h>
+#include "wifi_scan.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "http";
 
@@ -109,11 +123,13 @@ static const char *SETUP_HTML = R"rawliteral(
     input { width: 100%; padding: 0.8rem; margin: 0.5rem 0; box-sizing: border-box; font-size: 1rem; }
     button { width: 100%; padding: 1rem; font-size: 1.2rem; background: #4CAF50; color: white; border: none; cursor: pointer; }
     button:hover { background: #45a049; }
+    button.net { font-size: 1rem; padding: 0.6rem; margin: 0.2rem 0; background: #eee; color: black; text-align: left; }
   </style>
 </head>
 <body>
   <h1>🛜 WiFi Setup</h1>
   <p>Wifi-SSID:</p>
+  <div id="nets"><p>Searching for networks...</p></div>
   
   <form action="/setup" method="POST">
     <input type="text" name="ssid" placeholder="WiFi SSID" required autocomplete="off">
@@ -125,7 +141,30 @@ static const char *SETUP_HTML = R"rawliteral(
     window.onload = function() {
       document.querySelector('input[name="ssid"]').value = '';
       document.querySelector('input[name="password"]').value = '';
+      loadNetworks();
     };
+
+    // list from the device's background scan, tap one to fill in the SSID
+    function loadNetworks() {
+      fetch('/scan.json').then(r => r.json()).then(data => {
+        const nets = document.getElementById('nets');
+        if (data.networks.length) {
+          nets.innerHTML = '';
+          data.networks.forEach(n => {
+            const b = document.createElement('button');
+            b.type = 'button';
+            b.className = 'net';
+            b.textContent = (n.secure ? '🔒 ' : '') + n.ssid + ' (' + n.rssi + ' dBm)';
+            b.onclick = () => {
+              document.querySelector('input[name="ssid"]').value = n.ssid;
+              document.querySelector('input[name="password"]').focus();
+            };
+            nets.appendChild(b);
+          });
+        }
+      }).catch(() => {}).finally(() => setTimeout(loadNetworks, 5000));
+    }
+  </script>
 </body>
 </html>
 )rawliteral";
@@ -137,8 +176,8 @@ static esp_err_t index_handler(httpd_req_t *req) {
 
   httpd_resp_set_type(req, "text/html");
 
-  if (mode == WIFI_MODE_AP) {
-    // AccesPoint-mode, show setup form
+  if (mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA) {
+    // AccesPoint-mode (or setup AP next to a failing STA), show setup form
     httpd_resp_sendstr(req, SETUP_HTML);
   } else {
     // STA-mode, normal control mode
@@ -169,8 +208,7 @@ static esp_err_t color_handler(httpd_req_t *req) {
     parse_rgb(query, &r, &g, &b);
   }
 
-  ws2812_set_all(r, g, b);
-  ws2812_show();
+  led_solid(r, g, b);
 
   httpd_resp_set_type(req, "text/plain");
   httpd_resp_sendstr(req, "OK\n");
@@ -271,73 +309,44 @@ static esp_err_t wipe_handler(httpd_req_t *req) {
 static esp_err_t off_handler(httpd_req_t *req) {
   builtin_led_blink(3, 100);
 
-  ws2812_clear();
+  led_solid(0, 0, 0);
 
   httpd_resp_set_type(req, "text/plain");
   httpd_resp_sendstr(req, "OK\n");
   return ESP_OK;
 }
 
-// decoder for wifi symbols
-static void url_decode(char *dst, const char *src) {
-  char a, b;
-  while (*src) {
-    if ((*src == '%') && ((a = src[1]) && (b = src[2])) &&
-        (isxdigit(a) && isxdigit(b))) {
-      if (a >= 'a')
-        a -= 'a' - 'A';
-      if (a >= 'A')
-        a -= ('A' - 10);
-      else
-        a -= '0';
-      if (b >= 'a')
-        b -= 'a' - 'A';
-      if (b >= 'A')
-        b -= ('A' - 10);
-      else
-        b -= '0';
-      *dst++ = 16 * a + b;
-      src += 3;
-    } else if (*src == '+') {
-      *dst++ = ' ';
-      src++;
-    } else {
-      *dst++ = *src++;
-    }
-  }
-  *dst = '\0';
-}
-// GET /setup?ssid=MyWiFi&password=MyPass
+// Both fields url-encoded at worst, plus the keys
+#define SETUP_BODY_MAX 512
+
+// POST /setup with ssid=MyWiFi&password=MyPass (the setup page's form) or
+// {"ssid":"MyWiFi","password":"MyPass"}
 static esp_err_t setup_handler(httpd_req_t *req) {
-  char content[256];
-  char ssid_encoded[32] = {0};
-  char password_encoded[64] = {0};
-  char ssid[32] = {0};
-  char password[64] = {0};
-
-  int ret = httpd_req_recv(req, content, sizeof(content));
-  if (ret <= 0) {
-    if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-      httpd_resp_send_408(req);
-    }
+  // longest SSID and WPA passphrase plus the terminator
+  char ssid[33] = {0};
+  char password[65] = {0};
+
+  char *body;
+  if (http_body_read(req, SETUP_BODY_MAX, &body, NULL) != ESP_OK) {
     return ESP_FAIL;
   }
-  content[ret] = '\0';
 
-  if (httpd_query_key_value(content, "ssid", ssid_encoded,
-                            sizeof(ssid_encoded)) != ESP_OK) {
+  esp_err_t err = http_body_field(body, "ssid", ssid, sizeof(ssid));
+  if (err == ESP_OK) {
+    err = http_body_field(body, "password", password, sizeof(password));
+    // no password is an open network
+    if (err == ESP_ERR_NOT_FOUND) {
+      err = ESP_OK;
+    }
+  }
+  if (err != ESP_OK || ssid[0] == '\0') {
     httpd_resp_set_status(req, "400 Bad Request");
-    httpd_resp_sendstr(req, "Missing SSID");
+    httpd_resp_sendstr(req, err == ESP_ERR_INVALID_SIZE
+                                ? "SSID or password too long"
+                                : "Missing SSID");
     return ESP_OK;
   }
 
-  httpd_query_key_value(content, "password", password_encoded,
-                        sizeof(password_encoded));
-
-  // URL-dekoda SSID och password
-  url_decode(ssid, ssid_encoded);
-  url_decode(password, password_encoded);
-
   ESP_LOGI(TAG, "Setup WiFi - SSID: '%s'", ssid); // Debug-logg
 
   // Spara och starta om
@@ -367,17 +376,904 @@ static esp_err_t reset_handler(httpd_req_t *req) {
   return ESP_OK;
 }
 
+// Append `src` to `dst` as a JSON string body (no quotes)
+static void json_escape(char *dst, size_t size, const char *src) {
+  size_t n = strlen(dst);
+  for (; *src && n + 7 < size; src++) {
+    unsigned char c = (unsigned char)*src;
+    if (c == '"' || c == '\\') {
+      dst[n++] = '\\';
+      dst[n++] = c;
+    } else if (c < 0x20) {
+      n += snprintf(dst + n, size - n, "\\u%04x", c);
+    } else {
+      dst[n++] = c;
+    }
+  }
+  dst[n] = '\0';
+}
+
+// GET /scan.json - networks from the background scan, never waits for a scan
+static esp_err_t scan_handler(httpd_req_t *req) {
+  static wifi_scan_entry_t nets[WIFI_SCAN_MAX_NETWORKS];
+  int count = wifi_scan_get_results(nets, WIFI_SCAN_MAX_NETWORKS);
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  char buf[256];
+  snprintf(buf, sizeof(buf), "{\"age_ms\":%ld,\"networks\":[",
+           (long)wifi_scan_age_ms());
+  httpd_resp_sendstr_chunk(req, buf);
+
+  for (int i = 0; i < count; i++) {
+    snprintf(buf, sizeof(buf), "%s{\"ssid\":\"", i ? "," : "");
+    json_escape(buf, sizeof(buf), nets[i].ssid);
+    size_t n = strlen(buf);
+    snprintf(buf + n, sizeof(buf) - n,
+             "\",\"rssi\":%d,\"channel\":%d,\"secure\":%s}", nets[i].rssi,
+             nets[i].channel, nets[i].secure ? "true" : "false");
+    httpd_resp_sendstr_chunk(req, buf);
+  }
+
+  httpd_resp_sendstr_chunk(req, "]}");
+  httpd_resp_sendstr_chunk(req, NULL);
+  return ESP_OK;
+}
+
+// GET /metrics - render pipeline stats as JSON
+static esp_err_t metrics_handler(httpd_req_t *req) {
+  led_render_stats_t st;
+  led_render_get_stats(&st);
+  led_output_stats_t out;
+  led_output_get_stats(&out);
+  led_power_t pw;
+  ws2812_get_power(&pw);
+
+  char json[576];
+  snprintf(json, sizeof(json),
+           "{\"frames\":%lu,\"fps\":%lu,\"render_us_avg\":%lu,"
+           "\"render_us_max\":%lu,\"show_us_avg\":%lu,\"split\":%s,"
+           "\"layers\":%d,\"output\":{\"name\":\"%s\",\"frames\":%lu,"
+           "\"errors\":%lu,\"bytes\":%lu,\"submit_us_avg\":%lu,"
+           "\"wait_us_avg\":%lu},\"power\":{\"ma_estimate\":%lu,"
+           "\"ma_out\":%lu,\"scale\":%u,\"limited_frames\":%lu}}\n",
+           (unsigned long)st.frames, (unsigned long)st.fps,
+           (unsigned long)st.render_us_avg, (unsigned long)st.render_us_max,
+           (unsigned long)st.show_us_avg, st.split ? "true" : "false",
+           st.layers, out.name ? out.name : "none", (unsigned long)out.frames,
+           (unsigned long)out.errors, (unsigned long)out.bytes,
+           (unsigned long)out.submit_us_avg, (unsigned long)out.wait_us_avg,
+           (unsigned long)pw.ma_estimate, (unsigned long)pw.ma_out, pw.scale,
+           (unsigned long)pw.limited_frames);
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, json);
+  return ESP_OK;
+}
+
+// GET /plasma?speed=3&duration=0
+static esp_err_t plasma_handler(httpd_req_t *req) {
+  uint8_t speed = 3;
+  uint32_t duration = 0;
+
+  char query[128];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "speed", v, sizeof(v)) == ESP_OK)
+      speed = (uint8_t)atoi(v);
+    if (httpd_query_key_value(query, "duration", v, sizeof(v)) == ESP_OK)
+      duration = (uint32_t)atoi(v);
+  }
+
+  led_plasma(speed, duration);
+
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_sendstr(req, "OK\n");
+  return ESP_OK;
+}
+
+// GET /fire?speed=5&duration=0
+static esp_err_t fire_handler(httpd_req_t *req) {
+  uint8_t speed = 5;
+  uint32_t duration = 0;
+
+  char query[128];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "speed", v, sizeof(v)) == ESP_OK)
+      speed = (uint8_t)atoi(v);
+    if (httpd_query_key_value(query, "duration", v, sizeof(v)) == ESP_OK)
+      duration = (uint32_t)atoi(v);
+  }
+
+  led_fire(speed, duration);
+
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_sendstr(req, "OK\n");
+  return ESP_OK;
+}
+
+// GET /noise?speed=3&duration=0
+static esp_err_t noise_handler(httpd_req_t *req) {
+  uint8_t speed = 3;
+  uint32_t duration = 0;
+
+  char query[128];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "speed", v, sizeof(v)) == ESP_OK)
+      speed = (uint8_t)atoi(v);
+    if (httpd_query_key_value(query, "duration", v, sizeof(v)) == ESP_OK)
+      duration = (uint32_t)atoi(v);
+  }
+
+  led_noise_field(speed, duration);
+
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_sendstr(req, "OK\n");
+  return ESP_OK;
+}
+
+#define BENCH_TASK_STACK 4096
+// below httpd, so the other endpoints still answer while a run is going
+#define BENCH_TASK_PRIORITY 2
+
+// /bench and /regress render into led_bench's scratch frame and take
+// seconds, so one run at a time goes to bench_task, which owns the request
+// until it is answered
+static portMUX_TYPE s_bench_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_bench_busy = false;
+static httpd_req_t *s_bench_req;
+static void (*s_bench_job)(httpd_req_t *req);
+
+// Arguments of the run, set by the handler that claimed it
+static int s_bench_frames;
+static struct {
+  const led_clock_t *clock;
+  int seconds;
+  uint32_t golden[LED_EFFECT_COUNT];
+  int n_golden;
+} s_regress;
+
+static void bench_send(httpd_req_t *req) {
+  int frames = s_bench_frames;
+  led_bench_result_t res[LED_EFFECT_COUNT];
+  if (led_bench_effects(frames, res) != ESP_OK) {
+    httpd_resp_send_500(req);
+    return;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  char buf[128];
+  snprintf(buf, sizeof(buf),
+           "{\"leds\":%d,\"frames\":%d,\"budget_us\":%d,\"effects\":[",
+           ws2812_get_num_leds(), frames, 1000000 / CONFIG_LED_FRAME_RATE);
+  httpd_resp_sendstr_chunk(req, buf);
+  for (int i = 0; i < LED_EFFECT_COUNT; i++) {
+    snprintf(buf, sizeof(buf),
+             "%s{\"name\":\"%s\",\"us_avg\":%lu,\"us_max\":%lu}",
+             i ? "," : "", res[i].name, (unsigned long)res[i].us_avg,
+             (unsigned long)res[i].us_max);
+    httpd_resp_sendstr_chunk(req, buf);
+  }
+  httpd_resp_sendstr_chunk(req, "]");
+
+  // the same formula on the shader VM and in C
+  led_shader_bench_t sh;
+  if (led_shader_bench(frames, &sh) == ESP_OK) {
+    snprintf(buf, sizeof(buf),
+             ",\"shader\":{\"insns\":%d,\"vm_px_s\":%lu,"
+             "\"native_px_s\":%lu}",
+             sh.insns, (unsigned long)sh.vm_px_per_s,
+             (unsigned long)sh.native_px_per_s);
+    httpd_resp_sendstr_chunk(req, buf);
+  }
+
+  // output stage for a 1000 LED frame: gamma, dithering, byte order
+  bool high_depth = false;
+#if CONFIG_LED_HIGH_DEPTH
+  high_depth = true;
+#endif
+  snprintf(buf, sizeof(buf),
+           ",\"pack\":{\"leds\":1000,\"high_depth\":%s,\"us_avg\":%lu}",
+           high_depth ? "true" : "false",
+           (unsigned long)ws2812_bench_pack(1000, frames));
+  httpd_resp_sendstr_chunk(req, buf);
+  httpd_resp_sendstr_chunk(req, "}\n");
+  httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static void regress_send(httpd_req_t *req) {
+  const led_clock_t *clock = s_regress.clock;
+  int seconds = s_regress.seconds;
+  int n_golden = s_regress.n_golden;
+  const uint32_t *table = s_regress.golden;
+  const char *source = n_golden ? "query" : "none";
+  if (!n_golden && (table = led_bench_golden(seconds, &n_golden))) {
+    source = "builtin";
+  }
+
+  led_regress_result_t res[LED_EFFECT_COUNT];
+  if (led_bench_regress(clock, seconds, table, n_golden, res) != ESP_OK) {
+    httpd_resp_send_500(req);
+    return;
+  }
+  bool pass = true;
+  for (int i = 0; i < LED_EFFECT_COUNT; i++) {
+    pass = pass && res[i].pass;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  char buf[192];
+  snprintf(buf, sizeof(buf),
+           "{\"pass\":%s,\"clock\":\"%s\",\"seconds\":%d,\"leds\":%d,"
+           "\"golden\":\"%s\",\"frame_budget_us\":%d,"
+           "\"jitter_budget_us\":%d,\"effects\":[",
+           pass ? "true" : "false", clock->name, seconds,
+           ws2812_get_num_leds(), source, CONFIG_LED_REGRESS_FRAME_US,
+           CONFIG_LED_REGRESS_JITTER_US);
+  httpd_resp_sendstr_chunk(req, buf);
+  for (int i = 0; i < LED_EFFECT_COUNT; i++) {
+    snprintf(buf, sizeof(buf),
+             "%s{\"name\":\"%s\",\"hash\":\"%08lx\",\"hash_ok\":%s,"
+             "\"us_max\":%lu,\"jitter_us_max\":%lu,\"pass\":%s}",
+             i ? "," : "", res[i].name, (unsigned long)res[i].hash,
+             res[i].hash_ok ? "true" : "false", (unsigned long)res[i].us_max,
+             (unsigned long)res[i].jitter_us_max,
+             res[i].pass ? "true" : "false");
+    httpd_resp_sendstr_chunk(req, buf);
+  }
+  httpd_resp_sendstr_chunk(req, "]}\n");
+  httpd_resp_sendstr_chunk(req, NULL);
+}
+
+// false (and the request answered) if a run is already going
+static bool bench_claim(httpd_req_t *req) {
+  portENTER_CRITICAL(&s_bench_lock);
+  bool busy = s_bench_busy;
+  s_bench_busy = true;
+  portEXIT_CRITICAL(&s_bench_lock);
+  if (busy) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_sendstr(req, "A bench or regression run is in progress\n");
+  }
+  return !busy;
+}
+
+static void bench_done(void) {
+  portENTER_CRITICAL(&s_bench_lock);
+  s_bench_busy = false;
+  portEXIT_CRITICAL(&s_bench_lock);
+}
+
+static void bench_task(void *arg) {
+  s_bench_job(s_bench_req);
+  httpd_req_async_handler_complete(s_bench_req);
+  bench_done();
+  vTaskDelete(NULL);
+}
+
+// Hand a claimed run over to bench_task, httpd is free right away
+static esp_err_t bench_start(httpd_req_t *req,
+                             void (*job)(httpd_req_t *req)) {
+  s_bench_job = job;
+  if (httpd_req_async_handler_begin(req, &s_bench_req) != ESP_OK) {
+    bench_done();
+    httpd_resp_send_500(req);
+    return ESP_OK;
+  }
+  // networking core, like httpd itself
+  if (xTaskCreatePinnedToCore(bench_task, "bench", BENCH_TASK_STACK, NULL,
+                              BENCH_TASK_PRIORITY, NULL, 0) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start bench task!");
+    httpd_resp_send_500(s_bench_req);
+    httpd_req_async_handler_complete(s_bench_req);
+    bench_done();
+  }
+  return ESP_OK;
+}
+
+// GET /bench?frames=100 - per-effect render cost for a full frame, the
+// shader VM and the output packer
+static esp_err_t bench_handler(httpd_req_t *req) {
+  int frames = 100;
+
+  char query[64];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "frames", v, sizeof(v)) == ESP_OK)
+      frames = atoi(v);
+  }
+  if (frames < 1 || frames > 1000) {
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_sendstr(req, "frames must be 1-1000\n");
+    return ESP_OK;
+  }
+
+  if (!bench_claim(req)) {
+    return ESP_OK;
+  }
+  s_bench_frames = frames;
+  return bench_start(req, bench_send);
+}
+
+// GET /regress?seconds=10&clock=virtual&golden=1a2b3c4d,... - run every
+// effect against golden frame hashes and the render/timing budgets.
+// Without golden= the table built into the firmware is used, when there
+// is one for this configuration (led_bench_golden).
+static esp_err_t regress_handler(httpd_req_t *req) {
+  int seconds = 10;
+  const led_clock_t *clock = &led_clock_virtual;
+  uint32_t golden[LED_EFFECT_COUNT];
+  int n_golden = 0;
+
+  char query[256];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "seconds", v, sizeof(v)) == ESP_OK)
+      seconds = atoi(v);
+    if (httpd_query_key_value(query, "clock", v, sizeof(v)) == ESP_OK &&
+        strcmp(v, "system") == 0)
+      clock = &led_clock_system;
+    char list[LED_EFFECT_COUNT * 9 + 1];
+    if (httpd_query_key_value(query, "golden", list, sizeof(list)) ==
+        ESP_OK) {
+      char *p = list;
+      while (*p && n_golden < LED_EFFECT_COUNT) {
+        golden[n_golden++] = strtoul(p, &p, 16);
+        if (*p == ',')
+          p++;
+        else
+          break;
+      }
+    }
+  }
+  // a real-time run takes seconds * effects
+  int max_seconds = clock == &led_clock_system ? 2 : 60;
+  if (seconds < 1 || seconds > max_seconds) {
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_sendstr(req, clock == &led_clock_system
+                                ? "seconds must be 1-2 on the system clock\n"
+                                : "seconds must be 1-60\n");
+    return ESP_OK;
+  }
+
+  if (!bench_claim(req)) {
+    return ESP_OK;
+  }
+  s_regress.clock = clock;
+  s_regress.seconds = seconds;
+  s_regress.n_golden = n_golden;
+  memcpy(s_regress.golden, golden, n_golden * sizeof(golden[0]));
+  return bench_start(req, regress_send);
+}
+
+// GET /text?msg=Hello&r=255&g=255&b=255&step=80
+static esp_err_t text_handler(httpd_req_t *req) {
+  uint8_t r = 255, g = 255, b = 255;
+  uint16_t step = 80;
+  char msg[LED_TEXT_MAX] = "Hello";
+
+  char query[192];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    parse_rgb(query, &r, &g, &b);
+    char v[16];
+    if (httpd_query_key_value(query, "step", v, sizeof(v)) == ESP_OK)
+      step = (uint16_t)atoi(v);
+    // encoded text can be up to three times longer
+    char encoded[3 * LED_TEXT_MAX];
+    if (httpd_query_key_value(query, "msg", encoded, sizeof(encoded)) ==
+        ESP_OK) {
+      // longer text is cut
+      http_url_decode(msg, sizeof(msg), encoded);
+    }
+  }
+
+  led_scroll_text(msg, r, g, b, step);
+
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_sendstr(req, "OK\n");
+  return ESP_OK;
+}
+
+// GET /layout?w=16&h=8&serp=1&rot=0&tx=1&ty=1 - set the matrix layout,
+// without a query just report the current one
+static esp_err_t layout_handler(httpd_req_t *req) {
+  char query[128];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    led_matrix_t m = {.height = 1, .tiles_x = 1, .tiles_y = 1};
+    char v[16];
+    if (httpd_query_key_value(query, "w", v, sizeof(v)) == ESP_OK)
+      m.width = (uint16_t)atoi(v);
+    if (httpd_query_key_value(query, "h", v, sizeof(v)) == ESP_OK)
+      m.height = (uint16_t)atoi(v);
+    if (httpd_query_key_value(query, "serp", v, sizeof(v)) == ESP_OK)
+      m.serpentine = atoi(v) != 0;
+    if (httpd_query_key_value(query, "rot", v, sizeof(v)) == ESP_OK)
+      m.rotation = (uint8_t)atoi(v);
+    if (httpd_query_key_value(query, "tx", v, sizeof(v)) == ESP_OK)
+      m.tiles_x = (uint8_t)atoi(v);
+    if (httpd_query_key_value(query, "ty", v, sizeof(v)) == ESP_OK)
+      m.tiles_y = (uint8_t)atoi(v);
+
+    esp_err_t err = led_layout_set_matrix(&m);
+    if (err == ESP_ERR_TIMEOUT) {
+      httpd_resp_set_status(req, "503 Service Unavailable");
+      httpd_resp_sendstr(req, "Previous layout still in use\n");
+      return ESP_OK;
+    }
+    if (err != ESP_OK) {
+      httpd_resp_set_status(req, "400 Bad Request");
+      httpd_resp_sendstr(req, "Invalid layout\n");
+      return ESP_OK;
+    }
+  }
+
+  const led_layout_t *l = led_layout_get();
+  char buf[64];
+  snprintf(buf, sizeof(buf), "{\"width\":%u,\"height\":%u}\n", l->width,
+           l->height);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, buf);
+  return ESP_OK;
+}
+
+// GET /flash?r=255&g=0&b=0&period=250&duration=2000 - notification over
+// whatever is playing
+static esp_err_t flash_handler(httpd_req_t *req) {
+  uint8_t r = 255, g = 255, b = 255;
+  uint16_t period = 250;
+  uint32_t duration = 2000;
+
+  char query[128];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    parse_rgb(query, &r, &g, &b);
+    char v[16];
+    if (httpd_query_key_value(query, "period", v, sizeof(v)) == ESP_OK)
+      period = (uint16_t)atoi(v);
+    if (httpd_query_key_value(query, "duration", v, sizeof(v)) == ESP_OK)
+      duration = (uint32_t)atoi(v);
+  }
+
+  led_flash(r, g, b, period, duration);
+
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_sendstr(req, "OK\n");
+  return ESP_OK;
+}
+
+// GET /layer?n=1&fx=rainbow_cycle&speed=3&r=..&duration=0&opacity=128&mode=add
+// or /layer?n=1&off=1. Without fx only opacity/mode are changed.
+static esp_err_t layer_handler(httpd_req_t *req) {
+  char query[192];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_sendstr(req, "n is required\n");
+    return ESP_OK;
+  }
+
+  char v[24];
+  int n = -1;
+  if (httpd_query_key_value(query, "n", v, sizeof(v)) == ESP_OK)
+    n = atoi(v);
+  if (n <= LED_LAYER_BASE || n >= CONFIG_LED_LAYERS) {
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_sendstr(req, "n must be an overlay layer\n");
+    return ESP_OK;
+  }
+
+  uint8_t opacity;
+  led_blend_mode_t mode;
+  led_render_layer_get(n, &opacity, &mode);
+  if (httpd_query_key_value(query, "opacity", v, sizeof(v)) == ESP_OK)
+    opacity = (uint8_t)atoi(v);
+  if (httpd_query_key_value(query, "mode", v, sizeof(v)) == ESP_OK) {
+    int m = led_blend_from_name(v);
+    if (m < 0) {
+      httpd_resp_set_status(req, "400 Bad Request");
+      httpd_resp_sendstr(req, "mode must be normal, add, multiply or max\n");
+      return ESP_OK;
+    }
+    mode = (led_blend_mode_t)m;
+  }
+  led_render_layer_set(n, opacity, mode);
+
+  if (httpd_query_key_value(query, "off", v, sizeof(v)) == ESP_OK &&
+      atoi(v)) {
+    led_render_layer_clear(n);
+  } else if (httpd_query_key_value(query, "fx", v, sizeof(v)) == ESP_OK) {
+    int id = led_effect_from_name(v);
+    if (id < 0) {
+      httpd_resp_set_status(req, "400 Bad Request");
+      httpd_resp_sendstr(req, "Unknown effect\n");
+      return ESP_OK;
+    }
+
+    led_effect_params_t p = {.speed = 3, .delay_ms = 50};
+    uint32_t duration = 0;
+    parse_rgb(query, &p.r, &p.g, &p.b);
+    if (httpd_query_key_value(query, "speed", v, sizeof(v)) == ESP_OK)
+      p.speed = (uint8_t)atoi(v);
+    if (httpd_query_key_value(query, "delay", v, sizeof(v)) == ESP_OK)
+      p.delay_ms = (uint16_t)atoi(v);
+    if (httpd_query_key_value(query, "duration", v, sizeof(v)) == ESP_OK)
+      duration = (uint32_t)atoi(v);
+    led_render_layer_play(n, (led_effect_id_t)id, &p, duration);
+  }
+
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_sendstr(req, "OK\n");
+  return ESP_OK;
+}
+
+// GET /transition?type=ease&ms=400, or ?cancel=1 to skip a running one
+static esp_err_t transition_handler(httpd_req_t *req) {
+  led_transition_type_t type;
+  uint16_t ms;
+  led_render_get_transition(&type, &ms);
+
+  char query[128];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "cancel", v, sizeof(v)) == ESP_OK &&
+        atoi(v)) {
+      led_render_cancel_transition();
+    }
+    if (httpd_query_key_value(query, "type", v, sizeof(v)) == ESP_OK) {
+      int t = led_transition_from_name(v);
+      if (t < 0) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "type must be none, linear, ease or wipe\n");
+        return ESP_OK;
+      }
+      type = (led_transition_type_t)t;
+    }
+    if (httpd_query_key_value(query, "ms", v, sizeof(v)) == ESP_OK) {
+      int n = atoi(v);
+      ms = n < 0 ? 0 : n > 10000 ? 10000 : n;
+    }
+    led_render_set_transition(type, ms);
+  }
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), "{\"type\":\"%s\",\"ms\":%u}\n",
+           led_transition_name(type), ms);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, buf);
+  return ESP_OK;
+}
+
+// GET /brightness?level=0-255
+static esp_err_t brightness_handler(httpd_req_t *req) {
+  char query[64];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "level", v, sizeof(v)) == ESP_OK) {
+      int level = atoi(v);
+      led_render_set_brightness(level < 0 ? 0 : level > 255 ? 255 : level);
+    }
+  }
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "{\"level\":%u}\n",
+           led_render_get_brightness());
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, buf);
+  return ESP_OK;
+}
+
+static void send_scene_json(httpd_req_t *req, const char *prefix,
+                            const scene_t *sc) {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "%s\"effect\":\"%s\",\"brightness\":%u,\"r\":%u,\"g\":%u,"
+           "\"b\":%u,\"speed\":%u,\"delay\":%u,\"text\":\"",
+           prefix, led_effect_get(sc->effect)->name, sc->brightness,
+           sc->params.r, sc->params.g, sc->params.b, sc->params.speed,
+           sc->params.delay_ms);
+  json_escape(buf, sizeof(buf), sc->params.text);
+  size_t n = strlen(buf);
+  snprintf(buf + n, sizeof(buf) - n, "\"}");
+  httpd_resp_sendstr_chunk(req, buf);
+}
+
+// GET /scene?id=3 recalls a scene, &save=1 stores what is playing now in
+// it, &delete=1 clears it. Without id all scenes are listed.
+static esp_err_t scene_handler(httpd_req_t *req) {
+  char query[64];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "id", v, sizeof(v)) == ESP_OK) {
+      int id = atoi(v);
+      esp_err_t err;
+      if (httpd_query_key_value(query, "save", v, sizeof(v)) == ESP_OK &&
+          atoi(v)) {
+        err = scene_save_current(id);
+      } else if (httpd_query_key_value(query, "delete", v, sizeof(v)) ==
+                     ESP_OK &&
+                 atoi(v)) {
+        err = scene_delete(id);
+      } else {
+        err = scene_apply(id);
+      }
+
+      if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_sendstr(req, "No such scene\n");
+      } else if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Invalid scene id\n");
+      } else if (err != ESP_OK) {
+        httpd_resp_send_500(req);
+      } else {
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_sendstr(req, "OK\n");
+      }
+      return ESP_OK;
+    }
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  scene_t sc;
+  scene_get_current(&sc);
+  send_scene_json(req, "{\"current\":{", &sc);
+  httpd_resp_sendstr_chunk(req, ",\"scenes\":[");
+  bool first = true;
+  for (int i = 0; i < CONFIG_SCENE_MAX; i++) {
+    if (!scene_get(i, &sc)) {
+      continue;
+    }
+    char prefix[24];
+    snprintf(prefix, sizeof(prefix), "%s{\"id\":%d,", first ? "" : ",", i);
+    send_scene_json(req, prefix, &sc);
+    first = false;
+  }
+  httpd_resp_sendstr_chunk(req, "]}\n");
+  httpd_resp_sendstr_chunk(req, NULL);
+  return ESP_OK;
+}
+
+// Longest timeline line; the text= of a keyframe is capped anyway
+#define TIMELINE_LINE_MAX 160
+// every keyframe on a full line, plus room for comments
+#define TIMELINE_BODY_MAX                                                      \
+  ((CONFIG_LED_TIMELINE_MAX_KEYS + 32) * TIMELINE_LINE_MAX)
+
+static esp_err_t timeline_line(char *line, void *ctx) {
+  esp_err_t err = led_timeline_add_line(line);
+  if (err == ESP_OK) {
+    (*(int *)ctx)++;
+  }
+  return err;
+}
+
+// POST /timeline - upload a timeline, one keyframe per line (format in
+// led_timeline.h). The body is split into lines as it arrives.
+static esp_err_t timeline_upload_handler(httpd_req_t *req) {
+  int line_no = 1;
+
+  if (led_timeline_begin() != ESP_OK) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_sendstr(req, "Previous timeline still in use\n");
+    return ESP_OK;
+  }
+  esp_err_t err = http_body_lines(req, TIMELINE_BODY_MAX, TIMELINE_LINE_MAX,
+                                  timeline_line, &line_no);
+  if (err == ESP_FAIL) {
+    return ESP_FAIL;
+  }
+  if (err == ESP_OK) {
+    err = led_timeline_commit();
+  }
+
+  char msg[64];
+  if (err != ESP_OK) {
+    snprintf(msg, sizeof(msg), "Timeline error on line %d\n", line_no);
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_sendstr(req, err == ESP_ERR_INVALID_STATE
+                                ? "Timeline has no keyframes\n"
+                                : msg);
+    return ESP_OK;
+  }
+  led_timeline_status_t st;
+  led_timeline_get_status(&st);
+  snprintf(msg, sizeof(msg), "{\"keys\":%d,\"length_ms\":%lu}\n", st.keys,
+           (unsigned long)st.length_ms);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, msg);
+  return ESP_OK;
+}
+
+// Bytecode of the longest program, expressions are about as long
+#define SHADER_BODY_MAX 1280
+
+// POST /shader?duration=0 - load a shader program and play it. The body is
+// either bytecode (starting with "LSV1") or an expression, see led_shader.h.
+static esp_err_t shader_handler(httpd_req_t *req) {
+  uint32_t duration = 0;
+
+  char query[32];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[16];
+    if (httpd_query_key_value(query, "duration", v, sizeof(v)) == ESP_OK)
+      duration = strtoul(v, NULL, 10);
+  }
+  char *body;
+  size_t len;
+  if (http_body_read(req, SHADER_BODY_MAX, &body, &len) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  if (len == 0) {
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_sendstr(req, "Empty program\n");
+    return ESP_OK;
+  }
+
+  // the loaders only write the message on failure
+  char msg[80] = "";
+  esp_err_t err;
+  if (len >= 4 && memcmp(body, "LSV1", 4) == 0) {
+    err = led_shader_load_bytecode((const uint8_t *)body, len);
+    snprintf(msg, sizeof(msg), "Bad bytecode: %s\n", esp_err_to_name(err));
+  } else {
+    err = led_shader_load_expr(body, msg, sizeof(msg) - 1);
+    if (err != ESP_OK) {
+      strcat(msg, "\n");
+    }
+  }
+  if (err != ESP_OK) {
+    httpd_resp_set_status(req, err == ESP_ERR_TIMEOUT
+                                   ? "503 Service Unavailable"
+                                   : "400 Bad Request");
+    httpd_resp_sendstr(req, msg);
+    return ESP_OK;
+  }
+  led_shader(duration);
+
+  int insns, consts;
+  led_shader_get_info(&insns, &consts);
+  snprintf(msg, sizeof(msg), "{\"insns\":%d,\"consts\":%d}\n", insns,
+           consts);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, msg);
+  return ESP_OK;
+}
+
+// GET /timeline?play=1&loop=1 starts the uploaded timeline, ?stop=1 stops
+// it; always answers with the playback state
+static esp_err_t timeline_handler(httpd_req_t *req) {
+  char query[64];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[8];
+    if (httpd_query_key_value(query, "stop", v, sizeof(v)) == ESP_OK &&
+        atoi(v)) {
+      led_timeline_stop();
+    } else if (httpd_query_key_value(query, "play", v, sizeof(v)) ==
+                   ESP_OK &&
+               atoi(v)) {
+      bool loop = httpd_query_key_value(query, "loop", v, sizeof(v)) ==
+                      ESP_OK &&
+                  atoi(v);
+      if (led_timeline_play(loop) != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "No timeline uploaded\n");
+        return ESP_OK;
+      }
+    }
+  }
+
+  led_timeline_status_t st;
+  led_timeline_get_status(&st);
+  char json[160];
+  snprintf(json, sizeof(json),
+           "{\"playing\":%s,\"loop\":%s,\"keys\":%d,\"segments\":%d,"
+           "\"length_ms\":%lu,\"position_ms\":%lu}\n",
+           st.playing ? "true" : "false", st.loop ? "true" : "false", st.keys,
+           st.segments, (unsigned long)st.length_ms,
+           (unsigned long)st.position_ms);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, json);
+  return ESP_OK;
+}
+
+// GET /sync - clock sync state, on the master also per-hub skew
+static esp_err_t sync_handler(httpd_req_t *req) {
+  sync_stats_t st;
+  sync_get_stats(&st);
+
+  httpd_resp_set_type(req, "application/json");
+
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"master\":%s,\"locked\":%s,\"network_time_us\":%lld,"
+           "\"offset_us\":%lld,\"drift_ppb\":%ld,\"residual_us\":%ld,"
+           "\"beacons\":%lu,\"beacon_age_ms\":%lu,\"max_skew_us\":%ld,"
+           "\"nodes\":[",
+           st.master ? "true" : "false", st.locked ? "true" : "false",
+           (long long)sync_now_us(), (long long)st.offset_us,
+           (long)st.drift_ppb, (long)st.residual_us, (unsigned long)st.beacons,
+           (unsigned long)st.beacon_age_ms, (long)st.max_skew_us);
+  httpd_resp_sendstr_chunk(req, buf);
+
+  for (int i = 0; i < st.node_count; i++) {
+    snprintf(buf, sizeof(buf),
+             "%s{\"id\":\"%08lx\",\"skew_us\":%ld,\"rtt_us\":%lu,"
+             "\"age_ms\":%lu}",
+             i ? "," : "", (unsigned long)st.nodes[i].id,
+             (long)st.nodes[i].skew_us, (unsigned long)st.nodes[i].rtt_us,
+             (unsigned long)st.nodes[i].age_ms);
+    httpd_resp_sendstr_chunk(req, buf);
+  }
+
+  httpd_resp_sendstr_chunk(req, "]}\n");
+  httpd_resp_sendstr_chunk(req, NULL);
+  return ESP_OK;
+}
+
+// trace_dump_json sink, one HTTP chunk per piece
+static esp_err_t trace_write_chunk(void *ctx, const char *data, size_t len) {
+  return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+// GET /trace?clear=1 - timeline as Chrome Trace Event JSON (open in Perfetto)
+static esp_err_t trace_handler(httpd_req_t *req) {
+  bool clear = false;
+
+  char query[32];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char v[4];
+    if (httpd_query_key_value(query, "clear", v, sizeof(v)) == ESP_OK)
+      clear = atoi(v) != 0;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"trace.json\"");
+  esp_err_t err = trace_dump_json(trace_write_chunk, req);
+  if (err == ESP_ERR_INVALID_STATE) {
+    // nothing sent yet, another request is dumping
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_sendstr(req, "Trace dump already running\n");
+    return ESP_OK;
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Trace dump failed: %s", esp_err_to_name(err));
+    return err;
+  }
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  if (clear) {
+    trace_clear();
+  }
+  return ESP_OK;
+}
+
+// Runs the real handler (user_ctx) inside a trace span named after its URI
+static esp_err_t traced_handler(httpd_req_t *req) {
+  const httpd_uri_t *uri = req->user_ctx;
+  trace_span_t span = trace_begin(uri->uri);
+  esp_err_t ret = uri->handler(req);
+  http_body_reset();
+  trace_end(&span);
+  return ret;
+}
+
 // Register endpoints
 httpd_handle_t http_api_start(void) {
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.lru_purge_enable = true;
   // increase handlers from default (8)
-  config.max_uri_handlers = 12;
+  config.max_uri_handlers = 32;
+  // networking lives on core 0, core 1 is left to the LED pipeline
+  config.core_id = 0;
   httpd_handle_t server = NULL;
 
   ESP_ERROR_CHECK(httpd_start(&server, &config));
 
-  httpd_uri_t uris[] = {
+  // static, traced_handler keeps pointers into it
+  static const httpd_uri_t uris[] = {
       {.uri = "/", .method = HTTP_GET, .handler = index_handler},
       {.uri = "/color", .method = HTTP_GET, .handler = color_handler},
       {.uri = "/rainbow", .method = HTTP_GET, .handler = rainbow_handler},
@@ -387,10 +1283,35 @@ httpd_handle_t http_api_start(void) {
       {.uri = "/off", .method = HTTP_GET, .handler = off_handler},
       {.uri = "/setup", .method = HTTP_POST, .handler = setup_handler},
       {.uri = "/reset", .method = HTTP_GET, .handler = reset_handler},
+      {.uri = "/trace", .method = HTTP_GET, .handler = trace_handler},
+      {.uri = "/metrics", .method = HTTP_GET, .handler = metrics_handler},
+      {.uri = "/scan.json", .method = HTTP_GET, .handler = scan_handler},
+      {.uri = "/sync", .method = HTTP_GET, .handler = sync_handler},
+      {.uri = "/transition", .method = HTTP_GET,
+       .handler = transition_handler},
+      {.uri = "/flash", .method = HTTP_GET, .handler = flash_handler},
+      {.uri = "/plasma", .method = HTTP_GET, .handler = plasma_handler},
+      {.uri = "/text", .method = HTTP_GET, .handler = text_handler},
+      {.uri = "/fire", .method = HTTP_GET, .handler = fire_handler},
+      {.uri = "/noise", .method = HTTP_GET, .handler = noise_handler},
+      {.uri = "/bench", .method = HTTP_GET, .handler = bench_handler},
+      {.uri = "/regress", .method = HTTP_GET, .handler = regress_handler},
+      {.uri = "/brightness", .method = HTTP_GET,
+       .handler = brightness_handler},
+      {.uri = "/scene", .method = HTTP_GET, .handler = scene_handler},
+      {.uri = "/layout", .method = HTTP_GET, .handler = layout_handler},
+      {.uri = "/layer", .method = HTTP_GET, .handler = layer_handler},
+      {.uri = "/timeline", .method = HTTP_GET, .handler = timeline_handler},
+      {.uri = "/timeline", .method = HTTP_POST,
+       .handler = timeline_upload_handler},
+      {.uri = "/shader", .method = HTTP_POST, .handler = shader_handler},
   };
 
   for (int i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &uris[i]));
+    httpd_uri_t traced = uris[i];
+    traced.handler = traced_handler;
+    traced.user_ctx = (void *)&uris[i];
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &traced));
   }
 
   ESP_LOGI(TAG, "HTTP API started with %d endpoints",
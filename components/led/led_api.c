@@ -1,200 +1,158 @@
 #include "led_api.h"
-#include "driver/gpio.h"
-#include "driver/rmt_tx.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include <stddef.h>
-#include <stdlib.h>
+#include "led_chip.h"
+#include "led_output.h"
+#include "sdkconfig.h"
+#include "trace.h"
+#include <math.h>
 #include <string.h>
 
-// WS2812 led constants
-// High for 0-signal
-#define WS2812_T0H_NS 300
-// low for 0-signal
-#define WS2812_T0L_NS 875
-// high for 1-signal
-#define WS2812_T1H_NS 875
-// low for 1-signal
-#define WS2812_T1L_NS 300
-// rest in microseconds
-#define WS2812_RESET_US 280
+#if !CONFIG_IDF_TARGET_LINUX
+#include "driver/gpio.h"
+#endif
+
+#define NUM_LEDS CONFIG_LED_STRIP_COUNT
 
 // built in led (pin 2)
 #define BUILTIN_LED_GPIO 2
 
-// containerof error fix
-#ifndef __containerof
-#define __containerof(ptr, type, member)                                       \
-  ((type *)((char *)(ptr) - offsetof(type, member)))
+#if CONFIG_LED_OUTPUT_SPI
+#define LED_OUTPUT led_output_spi
+#elif CONFIG_LED_OUTPUT_FILE
+#define LED_OUTPUT led_output_file
+#else
+#define LED_OUTPUT led_output_rmt
 #endif
+
 static const char *TAG = "ws2812";
-static rmt_channel_handle_t s_channel = NULL;
-static rmt_encoder_handle_t s_encoder = NULL;
-static rgb_t *s_pixels = NULL;
-static int s_num_leds = 0;
-
-// Bytes encoder callback
-static size_t ws2812_encode(rmt_encoder_t *encoder,
-                            rmt_channel_handle_t channel, const void *data,
-                            size_t size, rmt_encode_state_t *state);
-
-typedef struct {
-  rmt_encoder_t base;
-  rmt_encoder_t *bytes_encoder;
-  rmt_encoder_t *copy_encoder;
-  rmt_symbol_word_t reset_code;
-  int state;
-} ws2812_encoder_t;
-
-static size_t ws2812_encode(rmt_encoder_t *encoder,
-                            rmt_channel_handle_t channel, const void *data,
-                            size_t size, rmt_encode_state_t *state) {
-  ws2812_encoder_t *ws_enc = __containerof(encoder, ws2812_encoder_t, base);
-  rmt_encode_state_t session_state = RMT_ENCODING_RESET;
-  size_t encoded_symbols = 0;
-
-  switch (ws_enc->state) {
-  case 0: // send RGB data
-    encoded_symbols += ws_enc->bytes_encoder->encode(
-        ws_enc->bytes_encoder, channel, data, size, &session_state);
-    if (session_state & RMT_ENCODING_COMPLETE) {
-      ws_enc->state = 1;
-    }
-    if (session_state & RMT_ENCODING_MEM_FULL) {
-      *state |= RMT_ENCODING_MEM_FULL;
-      return encoded_symbols;
-    }
-    // fall through
-  case 1: // send reset code
-    encoded_symbols += ws_enc->copy_encoder->encode(
-        ws_enc->copy_encoder, channel, &ws_enc->reset_code,
-        sizeof(ws_enc->reset_code), &session_state);
-    if (session_state & RMT_ENCODING_COMPLETE) {
-      ws_enc->state = 0;
-      *state |= RMT_ENCODING_COMPLETE;
-    }
-    if (session_state & RMT_ENCODING_MEM_FULL) {
-      *state |= RMT_ENCODING_MEM_FULL;
-    }
-    break;
-  }
-  return encoded_symbols;
-}
+static const led_output_t *const s_output = &LED_OUTPUT;
+static bool s_ready = false;
+static led_output_stats_t s_stats;
+
+#if CONFIG_LED_HIGH_DEPTH
+typedef rgb16_t pixel_t;
+#define PX_FROM8(v) ((v) * 257)
+#define PX_TO8(v) ((v) >> 8)
+#else
+typedef rgb_t pixel_t;
+#define PX_FROM8(v) (v)
+#define PX_TO8(v) (v)
+#endif
 
-static esp_err_t ws2812_encoder_reset(rmt_encoder_t *encoder) {
-  ws2812_encoder_t *ws_enc = __containerof(encoder, ws2812_encoder_t, base);
-  rmt_encoder_reset(ws_enc->bytes_encoder);
-  rmt_encoder_reset(ws_enc->copy_encoder);
-  ws_enc->state = 0;
-  return ESP_OK;
-}
+// All buffers are sized at compile time
+static pixel_t s_pixels[NUM_LEDS];
+static uint8_t s_wire[NUM_LEDS * LED_CHIP_BYTES];
+
+#if CONFIG_LED_HIGH_DEPTH
+// Gamma curve at 257 points over 0..0x10000, built by ws2812_init
+static uint16_t s_gamma[257];
+// What each wire byte rounded away last frame, in 1/256 steps
+static uint8_t s_dither[NUM_LEDS * LED_CHIP_BYTES];
+// Some byte of the last frame is between two levels
+static bool s_dithering = false;
+#endif
 
-static esp_err_t ws2812_encoder_del(rmt_encoder_t *encoder) {
-  ws2812_encoder_t *ws_enc = __containerof(encoder, ws2812_encoder_t, base);
-  rmt_del_encoder(ws_enc->bytes_encoder);
-  rmt_del_encoder(ws_enc->copy_encoder);
-  free(ws_enc);
-  return ESP_OK;
-}
+// Sum of each channel over s_pixels, kept up to date by the setters so the
+// current estimate never has to rescan the frame
+static uint32_t s_sum_r, s_sum_g, s_sum_b;
+// Output scale from the power limiter, LED_POWER_FULL = unlimited
+#define LED_POWER_FULL 256
+static uint16_t s_power_scale = LED_POWER_FULL;
+static uint16_t s_power_target = LED_POWER_FULL;
+static led_power_t s_power;
 
-void ws2812_init(int gpio, int num_leds) {
+esp_err_t ws2812_init(void) {
   ESP_LOGI(TAG, "=== WS2812 INIT START ===");
-  ESP_LOGI(TAG, "GPIO: %d, LEDs: %d", gpio, num_leds);
-
-  s_num_leds = num_leds;
-  s_pixels = calloc(num_leds, sizeof(rgb_t));
-
-  if (!s_pixels) {
-    ESP_LOGE(TAG, "Failed to allocate pixel memory!");
-    return;
+  ESP_LOGI(TAG, "GPIO: %d, LEDs: %d, chip: %s, output: %s, buffers: %d bytes",
+           CONFIG_LED_STRIP_GPIO, NUM_LEDS, LED_CHIP_NAME, s_output->name,
+           sizeof(s_pixels) + sizeof(s_wire));
+
+#if CONFIG_LED_HIGH_DEPTH
+  // once at boot, the frames only interpolate in the table
+  for (int i = 0; i < 257; i++) {
+    s_gamma[i] = 65535.0 * pow(i / 256.0, CONFIG_LED_GAMMA_X10 / 10.0) + 0.5;
   }
-  ESP_LOGI(TAG, "Pixel buffer allocated: %d bytes", num_leds * sizeof(rgb_t));
-
-  // RMT TX channel config
-  rmt_tx_channel_config_t tx_cfg = {
-      .gpio_num = gpio,
-      .clk_src = RMT_CLK_SRC_DEFAULT,
-      .resolution_hz = 10000000, // 10MHz = 100ns per tick
-      .mem_block_symbols = 64,
-      .trans_queue_depth = 4,
-  };
-
-  ESP_LOGI(TAG, "Creating RMT TX channel...");
-  esp_err_t err = rmt_new_tx_channel(&tx_cfg, &s_channel);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "❌ RMT channel creation FAILED: %s (0x%x)",
-             esp_err_to_name(err), err);
-    return;
+  // start the remainders spread out, so LEDs on the same level do not all
+  // step up in the same frame
+  for (int i = 0; i < sizeof(s_dither); i++) {
+    s_dither[i] = i * 97;
   }
-  ESP_LOGI(TAG, "✅ RMT TX channel created");
-
-  // Create encoder
-  ws2812_encoder_t *ws_enc = calloc(1, sizeof(ws2812_encoder_t));
-  if (!ws_enc) {
-    ESP_LOGE(TAG, "Failed to allocate encoder!");
-    return;
-  }
-
-  ws_enc->base.encode = ws2812_encode;
-  ws_enc->base.reset = ws2812_encoder_reset;
-  ws_enc->base.del = ws2812_encoder_del;
-
-  // Bytes encoder for RGB data
-  rmt_bytes_encoder_config_t bytes_cfg = {
-      .bit0 = {.duration0 = 3,
-               .level0 = 1,
-               .duration1 = 9,
-               .level1 = 0}, // T0H=300ns, T0L=900ns
-      .bit1 = {.duration0 = 9,
-               .level0 = 1,
-               .duration1 = 3,
-               .level1 = 0}, // T1H=900ns, T1L=300ns
-      .flags.msb_first = 1,
-  };
-
-  ESP_LOGI(TAG, "Creating bytes encoder...");
-  err = rmt_new_bytes_encoder(&bytes_cfg, &ws_enc->bytes_encoder);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "❌ Bytes encoder creation FAILED: %s", esp_err_to_name(err));
-    return;
-  }
-  ESP_LOGI(TAG, "✅ Bytes encoder created");
+#endif
 
-  // Copy encoder for reset code
-  rmt_copy_encoder_config_t copy_cfg = {};
-  err = rmt_new_copy_encoder(&copy_cfg, &ws_enc->copy_encoder);
+  esp_err_t err = s_output->init();
   if (err != ESP_OK) {
-    ESP_LOGE(TAG, "❌ Copy encoder creation FAILED: %s", esp_err_to_name(err));
-    return;
+    ESP_LOGE(TAG, "❌ %s output init FAILED: %s", s_output->name,
+             esp_err_to_name(err));
+    return err;
   }
-  ESP_LOGI(TAG, "✅ Copy encoder created");
 
-  // Reset code: low for 280us
-  ws_enc->reset_code = (rmt_symbol_word_t){
-      .duration0 = 2800, .level0 = 0, .duration1 = 0, .level1 = 0};
+#if CONFIG_LED_STRIP_STRONG_DRIVE && !CONFIG_IDF_TARGET_LINUX
+  gpio_set_drive_capability(CONFIG_LED_STRIP_GPIO, GPIO_DRIVE_CAP_3);
+#endif
 
-  s_encoder = &ws_enc->base;
+  s_stats.name = s_output->name;
+  s_stats.bytes = sizeof(s_wire);
+  s_ready = true;
+  ESP_LOGI(TAG, "✅✅✅ %s init SUCCESS on GPIO %d ✅✅✅", LED_CHIP_NAME,
+           CONFIG_LED_STRIP_GPIO);
+  return ESP_OK;
+}
 
-  err = rmt_enable(s_channel);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "❌ RMT enable FAILED: %s", esp_err_to_name(err));
-    return;
+void ws2812_set_pixel(int index, uint8_t r, uint8_t g, uint8_t b) {
+  if (index >= 0 && index < NUM_LEDS) {
+    pixel_t old = s_pixels[index];
+    s_sum_r += r - PX_TO8(old.r);
+    s_sum_g += g - PX_TO8(old.g);
+    s_sum_b += b - PX_TO8(old.b);
+    s_pixels[index] = (pixel_t){PX_FROM8(r), PX_FROM8(g), PX_FROM8(b)};
   }
+}
 
-  ESP_LOGI(TAG, "✅✅✅ WS2812D init SUCCESS on GPIO %d ✅✅✅", gpio);
+void ws2812_set_all(uint8_t r, uint8_t g, uint8_t b) {
+  for (int i = 0; i < NUM_LEDS; i++) {
+    s_pixels[i] = (pixel_t){PX_FROM8(r), PX_FROM8(g), PX_FROM8(b)};
+  }
+  s_sum_r = (uint32_t)r * NUM_LEDS;
+  s_sum_g = (uint32_t)g * NUM_LEDS;
+  s_sum_b = (uint32_t)b * NUM_LEDS;
 }
 
-void ws2812_set_pixel(int index, uint8_t r, uint8_t g, uint8_t b) {
-  if (index >= 0 && index < s_num_leds) {
-    s_pixels[index] = (rgb_t){r, g, b};
+// A whole new frame, the sums are taken in the same pass as the copy
+void ws2812_set_frame(const rgb_t *pixels) {
+  uint32_t r = 0, g = 0, b = 0;
+  for (int i = 0; i < NUM_LEDS; i++) {
+    rgb_t p = pixels[i];
+    r += p.r;
+    g += p.g;
+    b += p.b;
+    s_pixels[i] = (pixel_t){PX_FROM8(p.r), PX_FROM8(p.g), PX_FROM8(p.b)};
   }
+  s_sum_r = r;
+  s_sum_g = g;
+  s_sum_b = b;
 }
 
-void ws2812_set_all(uint8_t r, uint8_t g, uint8_t b) {
-  for (int i = 0; i < s_num_leds; i++) {
-    s_pixels[i] = (rgb_t){r, g, b};
+// The current estimate goes by the top 8 bits before gamma, which is on
+// the safe side
+void ws2812_set_frame16(const rgb16_t *pixels) {
+  uint32_t r = 0, g = 0, b = 0;
+  for (int i = 0; i < NUM_LEDS; i++) {
+    rgb16_t p = pixels[i];
+    r += p.r >> 8;
+    g += p.g >> 8;
+    b += p.b >> 8;
+#if CONFIG_LED_HIGH_DEPTH
+    s_pixels[i] = p;
+#else
+    s_pixels[i] = (rgb_t){p.r >> 8, p.g >> 8, p.b >> 8};
+#endif
   }
+  s_sum_r = r;
+  s_sum_g = g;
+  s_sum_b = b;
 }
 
 void ws2812_clear(void) {
@@ -202,61 +160,198 @@ void ws2812_clear(void) {
   ws2812_show();
 }
 
-void ws2812_show(void) {
-  ESP_LOGI(TAG, "=== ws2812_show() called ===");
+// Estimated strip current in mA for the current pixel sums. On RGBW chips
+// the shared part goes to one white LED instead of three, so this is an
+// upper bound there.
+static uint32_t power_estimate_ma(void) {
+  return (s_sum_r * CONFIG_LED_POWER_MA_RED +
+          s_sum_g * CONFIG_LED_POWER_MA_GREEN +
+          s_sum_b * CONFIG_LED_POWER_MA_BLUE) /
+             255 +
+         NUM_LEDS * CONFIG_LED_POWER_MA_IDLE / 1000;
+}
 
-  if (!s_channel) {
-    ESP_LOGE(TAG, "❌ RMT channel is NULL!");
-    return;
+// Scale for the next frame. Over budget it drops right away, below it
+// creeps back up over a few frames so a flickering load does not pump.
+static void power_update(void) {
+  uint32_t ma = power_estimate_ma();
+  uint32_t target = LED_POWER_FULL;
+#if CONFIG_LED_POWER_LIMIT
+  uint32_t idle = NUM_LEDS * CONFIG_LED_POWER_MA_IDLE / 1000;
+  if (ma > CONFIG_LED_POWER_BUDGET_MA) {
+    // the idle draw of the chips cannot be scaled away
+    target = CONFIG_LED_POWER_BUDGET_MA > idle
+                 ? (uint32_t)(CONFIG_LED_POWER_BUDGET_MA - idle) *
+                       LED_POWER_FULL / (ma - idle)
+                 : 0;
   }
-
-  if (!s_encoder) {
-    ESP_LOGE(TAG, "❌ Encoder is NULL!");
-    return;
+#endif
+  s_power_target = target;
+  uint32_t scale = s_power_scale;
+  if (target < scale) {
+    scale = target;
+  } else if (target > scale) {
+    scale += (target - scale + 7) / 8;
+  }
+  s_power_scale = scale;
+
+  s_power.ma_estimate = ma;
+  s_power.ma_out = scale == LED_POWER_FULL
+                       ? ma
+                       : (uint32_t)((uint64_t)ma * scale / LED_POWER_FULL);
+  s_power.scale = scale;
+  if (scale < LED_POWER_FULL) {
+    s_power.limited_frames++;
   }
+}
 
-  // WS2812 expects GRB order
-  uint8_t *grb_data = malloc(s_num_leds * 3);
-  if (!grb_data) {
-    ESP_LOGE(TAG, "❌ Failed to allocate GRB buffer!");
-    return;
+#if CONFIG_LED_HIGH_DEPTH
+static inline uint32_t gamma16(uint32_t v) {
+  uint32_t i = v >> 8, f = v & 0xff; // table step and 1/256 within it
+  return s_gamma[i] + (((int32_t)(s_gamma[i + 1] - s_gamma[i]) * f) >> 8);
+}
+
+// Gamma and limiter scale in 16 bits, then the top byte goes out and the
+// low byte is carried to the same wire byte of the next frame, so over a
+// few frames the LED averages the full level. A level that is exactly on
+// a step (or above the top one) goes out as it is and carries nothing, so
+// a still frame of such levels settles. *frac collects the low bits of the
+// levels that do get dithered. Integers only.
+static inline uint8_t dither(uint32_t v, uint16_t scale, uint8_t *err,
+                             uint8_t *frac) {
+  v = gamma16(v) * scale >> 8;
+  if (v >= 0xff00) {
+    return 0xff;
+  }
+  if ((v & 0xff) == 0) {
+    return v >> 8;
   }
+  *frac |= v;
+  v += *err; // stays below 0xffff
+  *err = v & 0xff;
+  return v >> 8;
+}
 
-  for (int i = 0; i < s_num_leds; i++) {
-    grb_data[i * 3 + 0] = s_pixels[i].g;
-    grb_data[i * 3 + 1] = s_pixels[i].r;
-    grb_data[i * 3 + 2] = s_pixels[i].b;
+#if LED_CHIP_WHITE
+// RGBW: white takes the shared part, then as below
+static bool pack_wire(uint8_t *wire, const rgb16_t *px, uint8_t *err, int n,
+                      uint16_t scale) {
+  uint8_t frac = 0;
+  for (int i = 0; i < n; i++) {
+    rgb16_t p = px[i];
+    uint16_t w = p.r < p.g ? p.r : p.g;
+    w = p.b < w ? p.b : w;
+    p.r -= w;
+    p.g -= w;
+    p.b -= w;
+    *wire++ = dither(p.LED_WIRE_C0, scale, err++, &frac);
+    *wire++ = dither(p.LED_WIRE_C1, scale, err++, &frac);
+    *wire++ = dither(p.LED_WIRE_C2, scale, err++, &frac);
+    *wire++ = dither(w, scale, err++, &frac);
+  }
+  return frac != 0;
+}
+#else
+// Gamma, dithering and byte order in one pass. Returns whether any byte
+// is between two levels, i.e. the frame has to be sent again to average
+// out.
+static bool pack_wire(uint8_t *wire, const rgb16_t *px, uint8_t *err, int n,
+                      uint16_t scale) {
+  uint8_t frac = 0;
+  for (int i = 0; i < n; i++) {
+    *wire++ = dither(px[i].LED_WIRE_C0, scale, err++, &frac);
+    *wire++ = dither(px[i].LED_WIRE_C1, scale, err++, &frac);
+    *wire++ = dither(px[i].LED_WIRE_C2, scale, err++, &frac);
+  }
+  return frac != 0;
+}
+#endif
 
-    ESP_LOGI(TAG, "LED %d: R=%d G=%d B=%d -> GRB: %02x %02x %02x", i,
-             s_pixels[i].r, s_pixels[i].g, s_pixels[i].b, grb_data[i * 3 + 0],
-             grb_data[i * 3 + 1], grb_data[i * 3 + 2]);
+#elif LED_CHIP_WHITE
+// RGBW: the part all three channels share goes to the white LED
+static void pack_wire(uint8_t *wire, const rgb_t *px, int n, uint16_t scale) {
+  for (int i = 0; i < n; i++) {
+    rgb_t p = px[i];
+    uint8_t w = p.r < p.g ? p.r : p.g;
+    w = p.b < w ? p.b : w;
+    p.r -= w;
+    p.g -= w;
+    p.b -= w;
+    *wire++ = p.LED_WIRE_C0 * scale >> 8;
+    *wire++ = p.LED_WIRE_C1 * scale >> 8;
+    *wire++ = p.LED_WIRE_C2 * scale >> 8;
+    *wire++ = w * scale >> 8;
+  }
+}
+#else
+// reorder into the chip's byte order
+static void pack_wire(uint8_t *wire, const rgb_t *px, int n, uint16_t scale) {
+  for (int i = 0; i < n; i++) {
+    *wire++ = px[i].LED_WIRE_C0 * scale >> 8;
+    *wire++ = px[i].LED_WIRE_C1 * scale >> 8;
+    *wire++ = px[i].LED_WIRE_C2 * scale >> 8;
   }
+}
+#endif
 
-  rmt_transmit_config_t tx_config = {.loop_count = 0};
+// moving average over roughly the last 16 frames
+static uint32_t avg16(uint32_t avg, uint32_t sample) {
+  return (avg * 15 + sample) / 16;
+}
 
-  ESP_LOGI(TAG, "Transmitting %d bytes...", s_num_leds * 3);
-  esp_err_t err =
-      rmt_transmit(s_channel, s_encoder, grb_data, s_num_leds * 3, &tx_config);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "❌ rmt_transmit FAILED: %s", esp_err_to_name(err));
-    free(grb_data);
+// The previous frame may still be going out; wait for it, then pack and
+// hand over the new one without waiting, so it is sent while the next
+// frame renders.
+static void ws2812_transmit(void) {
+  if (!s_ready) {
+    ESP_LOGE(TAG, "❌ Output not initialized!");
     return;
   }
-  ESP_LOGI(TAG, "Waiting for transmission...");
 
-  err = rmt_tx_wait_all_done(s_channel, portMAX_DELAY);
+  int64_t t0 = esp_timer_get_time();
+  esp_err_t err = s_output->wait();
+  int64_t t1 = esp_timer_get_time();
   if (err != ESP_OK) {
-    ESP_LOGE(TAG, "❌ rmt_tx_wait_all_done FAILED: %s", esp_err_to_name(err));
-  } else {
-    ESP_LOGI(TAG, "✅ Transmission complete!");
+    ESP_LOGE(TAG, "❌ %s wait FAILED: %s", s_output->name,
+             esp_err_to_name(err));
+    s_stats.errors++;
   }
 
-  free(grb_data);
-  ESP_LOGI(TAG, "=== ws2812_show() done ===");
+  power_update();
+#if CONFIG_LED_HIGH_DEPTH
+  s_dithering =
+      pack_wire(s_wire, s_pixels, s_dither, NUM_LEDS, s_power_scale);
+#else
+  pack_wire(s_wire, s_pixels, NUM_LEDS, s_power_scale);
+#endif
+  err = s_output->submit(s_wire, sizeof(s_wire));
+  int64_t t2 = esp_timer_get_time();
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "❌ %s submit FAILED: %s", s_output->name,
+             esp_err_to_name(err));
+    s_stats.errors++;
+    return;
+  }
+
+  s_stats.frames++;
+  s_stats.wait_us_avg = avg16(s_stats.wait_us_avg, t1 - t0);
+  s_stats.submit_us_avg = avg16(s_stats.submit_us_avg, t2 - t1);
+}
+
+void ws2812_show(void) {
+  trace_span_t span = trace_begin("ws2812_show");
+  ws2812_transmit();
+  trace_end(&span);
 }
 
 // builtin led blink
 void builtin_led_blink(int count, int delay_ms) {
+#if CONFIG_IDF_TARGET_LINUX
+  // no pin to blink, only the time it takes
+  if (count > 0) {
+    vTaskDelay(pdMS_TO_TICKS(delay_ms * (2 * count - 1)));
+  }
+#else
   // configure if not done
   static bool gpio_initialized = false;
   if (!gpio_initialized) {
@@ -272,13 +367,64 @@ void builtin_led_blink(int count, int delay_ms) {
       vTaskDelay(pdMS_TO_TICKS(delay_ms));
     }
   }
+#endif
 }
 
-int ws2812_get_num_leds(void) { return s_num_leds; }
+int ws2812_get_num_leds(void) { return NUM_LEDS; }
 
 rgb_t ws2812_get_pixel(int index) {
-  if (index >= 0 && index < s_num_leds) {
-    return s_pixels[index];
+  if (index >= 0 && index < NUM_LEDS) {
+    pixel_t p = s_pixels[index];
+    return (rgb_t){PX_TO8(p.r), PX_TO8(p.g), PX_TO8(p.b)};
   }
   return (rgb_t){0, 0, 0};
 }
+
+void led_output_get_stats(led_output_stats_t *out) { *out = s_stats; }
+
+void ws2812_get_power(led_power_t *out) { *out = s_power; }
+
+bool ws2812_power_settling(void) { return s_power_scale < s_power_target; }
+
+bool ws2812_needs_refresh(void) {
+#if CONFIG_LED_HIGH_DEPTH
+  if (s_dithering) {
+    return true;
+  }
+#endif
+  return ws2812_power_settling();
+}
+
+// Packed in chunks from a small scratch frame, so any strip length can be
+// timed without buffers of that size
+#define BENCH_CHUNK 50
+
+uint32_t ws2812_bench_pack(int n, int frames) {
+  static pixel_t px[BENCH_CHUNK];
+  static uint8_t wire[BENCH_CHUNK * LED_CHIP_BYTES];
+#if CONFIG_LED_HIGH_DEPTH
+  static uint8_t err[BENCH_CHUNK * LED_CHIP_BYTES];
+#endif
+  if (n <= 0 || frames <= 0) {
+    return 0;
+  }
+  // a dim ramp, what dithering is for
+  for (int i = 0; i < BENCH_CHUNK; i++) {
+    px[i] = (pixel_t){PX_FROM8(i * 5), PX_FROM8(i * 3), PX_FROM8(i)};
+  }
+
+  volatile uint8_t sink = 0;
+  int64_t t0 = esp_timer_get_time();
+  for (int f = 0; f < frames; f++) {
+    for (int done = 0; done < n; done += BENCH_CHUNK) {
+      int k = n - done < BENCH_CHUNK ? n - done : BENCH_CHUNK;
+#if CONFIG_LED_HIGH_DEPTH
+      pack_wire(wire, px, err, k, LED_POWER_FULL);
+#else
+      pack_wire(wire, px, k, LED_POWER_FULL);
+#endif
+      sink ^= wire[0];
+    }
+  }
+  return (esp_timer_get_time() - t0) / frames;
+}
@@ -1,3 +1,7 @@
+#ifndef LED_API_H
+#define LED_API_H
+
+#include "esp_err.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -7,14 +11,52 @@ typedef struct {
   uint8_t b;
 } rgb_t;
 
-void ws2812_init(int gpio, int num_leds);
+// 16 bits per channel, 0xffff = full
+typedef struct {
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
+} rgb16_t;
+
+// Set up the output backend for the strip configured in Kconfig
+// (CONFIG_LED_STRIP_GPIO, CONFIG_LED_STRIP_COUNT, chip, color order, output)
+esp_err_t ws2812_init(void);
 void ws2812_set_pixel(int index, uint8_t r, uint8_t g, uint8_t b);
 void ws2812_set_all(uint8_t r, uint8_t g, uint8_t b);
+// Copy a whole frame (ws2812_get_num_leds() pixels) into the pixel buffer
+void ws2812_set_frame(const rgb_t *pixels);
+// Same for a 16-bit frame. With CONFIG_LED_HIGH_DEPTH the low bits reach
+// the strip through gamma and temporal dithering, otherwise they are cut.
+void ws2812_set_frame16(const rgb16_t *pixels);
+// Send the pixel buffer. Returns once the frame is handed to the output,
+// which sends it while the caller goes on with the next one.
 void ws2812_show(void);
 void ws2812_clear(void);
 
+// Power estimate of the last frame sent, see Kconfig "LED power limit"
+typedef struct {
+  uint32_t ma_estimate;    // what the frame would draw unlimited
+  uint32_t ma_out;         // after the limiter
+  uint16_t scale;          // 256 = not limited
+  uint32_t limited_frames; // frames sent with scale < 256
+} led_power_t;
+
+void ws2812_get_power(led_power_t *out);
+// True while the limiter is still fading back up after a bright frame; the
+// same frame has to be sent again until it is done
+bool ws2812_power_settling(void);
+// True while the last frame has to be sent again: the limiter is settling
+// or dithering is still spreading a level between two steps over frames
+bool ws2812_needs_refresh(void);
+
+// Average time in us to pack n pixels (gamma, dithering, byte order) into
+// a scratch buffer, over `frames` runs; the strip is not touched
+uint32_t ws2812_bench_pack(int n, int frames);
+
 int ws2812_get_num_leds(void);
 rgb_t ws2812_get_pixel(int index);
 
 // builtin led for troubleshooting
 void builtin_led_blink(int count, int delay_ms);
+
+#endif
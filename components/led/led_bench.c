@@ -0,0 +1,150 @@
+#include "led_bench.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "led_api.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#define BENCH_FRAME_MS 16
+
+static const char *TAG = "led_bench";
+
+// scratch frame, the effects never see the strip
+static rgb_t s_px[CONFIG_LED_STRIP_COUNT];
+
+esp_err_t led_bench_effects(int frames, led_bench_result_t *out) {
+  if (frames <= 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  int n = CONFIG_LED_STRIP_COUNT;
+
+  led_effect_params_t params = {
+      .r = 255, .g = 128, .b = 0, .speed = 5, .delay_ms = 50,
+      .text = "Benchmark"};
+  led_frame_t frame = {.px = s_px, .start = 0, .end = n, .num_leds = n};
+
+  for (int id = 0; id < LED_EFFECT_COUNT; id++) {
+    const led_effect_t *fx = led_effect_get(id);
+    uint64_t total = 0;
+    uint32_t max = 0;
+    for (int i = 0; i < frames; i++) {
+      int64_t t0 = esp_timer_get_time();
+      fx->render(&params, i * BENCH_FRAME_MS, &frame);
+      uint32_t us = esp_timer_get_time() - t0;
+      total += us;
+      if (us > max) {
+        max = us;
+      }
+    }
+    out[id] = (led_bench_result_t){
+        .name = fx->name, .us_avg = total / frames, .us_max = max};
+    ESP_LOGI(TAG, "%-14s %5lu us avg, %5lu us max (%d LEDs)", fx->name,
+             (unsigned long)out[id].us_avg, (unsigned long)max, n);
+  }
+
+  return ESP_OK;
+}
+
+// FNV-1a over the frame bytes
+static uint32_t hash_frame(uint32_t h, const rgb_t *px, int n) {
+  const uint8_t *p = (const uint8_t *)px;
+  for (int i = 0; i < n * (int)sizeof(rgb_t); i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+esp_err_t led_bench_regress(const led_clock_t *clock, int seconds,
+                            const uint32_t *golden, int n_golden,
+                            led_regress_result_t *out) {
+  if (seconds <= 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const int n = CONFIG_LED_STRIP_COUNT;
+  const int64_t period = 1000000 / CONFIG_LED_FRAME_RATE;
+  const int frames = seconds * CONFIG_LED_FRAME_RATE;
+
+  // same parameters as the benchmark, the hashes depend on them
+  led_effect_params_t params = {
+      .r = 255, .g = 128, .b = 0, .speed = 5, .delay_ms = 50,
+      .text = "Benchmark"};
+  led_frame_t frame = {.px = s_px, .start = 0, .end = n, .num_leds = n};
+
+  for (int id = 0; id < LED_EFFECT_COUNT; id++) {
+    const led_effect_t *fx = led_effect_get(id);
+    uint32_t hash = 2166136261u;
+    uint32_t cost_max = 0, jitter_max = 0;
+    memset(s_px, 0, sizeof(s_px));
+
+    if (clock == &led_clock_virtual) {
+      led_clock_virtual_reset(0);
+    }
+    int64_t start = clock->now_us();
+    for (int i = 0; i < frames; i++) {
+      // effect time comes from the schedule, not from when we woke up,
+      // so the frames are the same on every clock
+      int64_t due = start + i * period;
+      clock->sleep_until_us(due);
+      uint32_t late = clock->now_us() - due;
+      if (late > jitter_max) {
+        jitter_max = late;
+      }
+
+      int64_t t0 = esp_timer_get_time();
+      fx->render(&params, (uint32_t)(i * period / 1000), &frame);
+      uint32_t us = esp_timer_get_time() - t0;
+      if (us > cost_max) {
+        cost_max = us;
+      }
+      hash = hash_frame(hash, s_px, n);
+    }
+
+    led_regress_result_t *r = &out[id];
+    *r = (led_regress_result_t){.name = fx->name,
+                                .hash = hash,
+                                .golden = id < n_golden ? golden[id] : 0,
+                                .us_max = cost_max,
+                                .jitter_us_max = jitter_max};
+    r->hash_ok = !r->golden || r->golden == hash;
+    r->pass = r->hash_ok && cost_max <= CONFIG_LED_REGRESS_FRAME_US &&
+              jitter_max <= CONFIG_LED_REGRESS_JITTER_US;
+    if (!r->pass) {
+      ESP_LOGW(TAG, "%-14s FAIL: hash %08lx%s, %lu us max, %lu us late",
+               fx->name, (unsigned long)hash, r->hash_ok ? "" : " (changed)",
+               (unsigned long)cost_max, (unsigned long)jitter_max);
+    }
+  }
+  return ESP_OK;
+}
+
+// Recorded with host_test/test_regress --print; an effect whose output
+// changes on purpose gets its new hash here. The shader's frames depend on
+// the program loaded, it is not checked.
+#if CONFIG_LED_STRIP_COUNT == 12 && CONFIG_LED_MATRIX_WIDTH == 0 &&         \
+    CONFIG_LED_FRAME_RATE == 60
+#define GOLDEN_SECONDS 10
+static const uint32_t s_golden[LED_EFFECT_COUNT] = {
+    [LED_EFFECT_SOLID] = 0x8040d5a5,
+    [LED_EFFECT_RAINBOW_CHASE] = 0xdf8ce38e,
+    [LED_EFFECT_RAINBOW_CYCLE] = 0x033bcbf5,
+    [LED_EFFECT_BOUNCING_BALL] = 0x849262dc,
+    [LED_EFFECT_COLOR_WIPE] = 0x4952c892,
+    [LED_EFFECT_SELF_TEST] = 0xfab827c5,
+    [LED_EFFECT_FLASH] = 0x57d8cfa9,
+    [LED_EFFECT_PLASMA] = 0x1898068a,
+    [LED_EFFECT_SCROLL_TEXT] = 0x087cf591,
+    [LED_EFFECT_FIRE] = 0x1512a137,
+    [LED_EFFECT_NOISE] = 0x09b9b7ba,
+};
+#endif
+
+const uint32_t *led_bench_golden(int seconds, int *n) {
+#ifdef GOLDEN_SECONDS
+  if (seconds == GOLDEN_SECONDS) {
+    *n = LED_EFFECT_COUNT;
+    return s_golden;
+  }
+#endif
+  *n = 0;
+  return NULL;
+}
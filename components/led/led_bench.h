@@ -0,0 +1,50 @@
+#ifndef LED_BENCH_H
+#define LED_BENCH_H
+
+#include "esp_err.h"
+#include "led_clock.h"
+#include "led_effects.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  const char *name;
+  uint32_t us_avg; // one full frame, all LEDs, on one core
+  uint32_t us_max;
+} led_bench_result_t;
+
+// Render every effect `frames` times into a scratch frame on the calling
+// task's core, 16 ms of effect time apart. The live pipeline keeps
+// running, so the numbers include whatever else that core is doing (WiFi
+// on core 0). out gets LED_EFFECT_COUNT results. This and
+// led_bench_regress() share one scratch frame, run one at a time.
+esp_err_t led_bench_effects(int frames, led_bench_result_t *out);
+
+typedef struct {
+  const char *name;
+  uint32_t hash;          // FNV-1a over every frame of the run
+  uint32_t golden;        // expected hash, 0 = not checked
+  uint32_t us_max;        // worst frame render cost
+  uint32_t jitter_us_max; // worst lateness of a frame against its slot
+  bool hash_ok;
+  bool pass; // hash matches, cost and jitter within the Kconfig budgets
+} led_regress_result_t;
+
+// Run every effect for `seconds` of clock time at CONFIG_LED_FRAME_RATE and
+// check it. The effect time of frame i is i frame periods whatever the
+// clock, so the hashes only change when an effect's output changes (or
+// the LED count or matrix layout). On led_clock_virtual the run takes only
+// the render time and jitter is 0; on led_clock_system it paces in real
+// time and measures how late each frame slot is hit. golden holds up to
+// n_golden expected hashes in effect order; out gets LED_EFFECT_COUNT
+// results.
+esp_err_t led_bench_regress(const led_clock_t *clock, int seconds,
+                            const uint32_t *golden, int n_golden,
+                            led_regress_result_t *out);
+
+// Hashes of a 10 s run at the Kconfig defaults (12 LEDs as a plain strip,
+// 60 FPS), the same on the host and the device. NULL if this build or run
+// differs from that, e.g. another LED count. n gets the table length.
+const uint32_t *led_bench_golden(int seconds, int *n);
+
+#endif
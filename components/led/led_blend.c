@@ -0,0 +1,108 @@
+#include "led_blend.h"
+#include <string.h>
+
+static const char *const s_names[LED_BLEND_COUNT] = {
+    [LED_BLEND_NORMAL] = "normal",
+    [LED_BLEND_ADD] = "add",
+    [LED_BLEND_MULTIPLY] = "multiply",
+    [LED_BLEND_MAX] = "max",
+};
+
+// Saturating per-channel add. Lanes are spread out so a carry lands in the
+// gap above each lane, from where it is turned into an 0xFF mask.
+static inline uint32_t add_px(uint32_t a, uint32_t b) {
+  uint32_t rb = (a & 0xFF00FF) + (b & 0xFF00FF);
+  uint32_t g = (a & 0x00FF00) + (b & 0x00FF00);
+  uint32_t rb_of = rb & 0x1000100;
+  uint32_t g_of = g & 0x10000;
+  rb |= rb_of - (rb_of >> 8);
+  g |= g_of - (g_of >> 8);
+  return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+// Per-channel max. Setting the gap bit above each lane of a before the
+// subtraction leaves it set exactly where a >= b.
+static inline uint32_t max_px(uint32_t a, uint32_t b) {
+  uint32_t a_rb = a & 0xFF00FF, b_rb = b & 0xFF00FF;
+  uint32_t a_g = a & 0x00FF00, b_g = b & 0x00FF00;
+  uint32_t rb_ge = ((a_rb | 0x1000100) - b_rb) & 0x1000100;
+  uint32_t g_ge = ((a_g | 0x10000) - b_g) & 0x10000;
+  uint32_t rb_m = rb_ge - (rb_ge >> 8);
+  uint32_t g_m = g_ge - (g_ge >> 8);
+  return (a_rb & rb_m) | (b_rb & ~rb_m & 0xFF00FF) | (a_g & g_m) |
+         (b_g & ~g_m & 0x00FF00);
+}
+
+// Per-channel a * b / 255 (rounded), lanes can't share a multiply here
+static inline uint32_t mul_px(uint32_t a, uint32_t b) {
+  uint32_t out = 0;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint32_t x = ((a >> shift) & 0xFF) * ((b >> shift) & 0xFF) + 128;
+    out |= ((x + (x >> 8)) >> 8) << shift;
+  }
+  return out;
+}
+
+void led_pack_frame(const rgb_t *px, uint32_t *out, int n) {
+  for (int i = 0; i < n; i++) {
+    out[i] = led_pack_rgb(px[i]);
+  }
+}
+
+void led_scale_frame(rgb_t *dst, const rgb_t *src, int n, uint8_t level) {
+  uint32_t w = led_opacity_weight(level);
+  for (int i = 0; i < n; i++) {
+    led_store_rgb(&dst[i], led_lerp_px(0, led_pack_rgb(src[i]), w));
+  }
+}
+
+// One loop per mode so the per-pixel work has no branches
+#define BLEND_LOOP(expr)                                                       \
+  for (int i = 0; i < n; i++) {                                                \
+    uint32_t a = led_pack_rgb(dst[i]);                                         \
+    uint32_t b = led_pack_rgb(src[i]);                                         \
+    uint32_t c = (expr);                                                       \
+    led_store_rgb(&dst[i], w == LED_WEIGHT_FULL ? c : led_lerp_px(a, c, w));   \
+  }
+
+void led_blend_layer(led_blend_mode_t mode, rgb_t *dst, const rgb_t *src,
+                     int n, uint8_t opacity) {
+  uint32_t w = led_opacity_weight(opacity);
+  if (w == 0) {
+    return;
+  }
+
+  switch (mode) {
+  case LED_BLEND_NORMAL:
+    if (w == LED_WEIGHT_FULL) {
+      memcpy(dst, src, n * sizeof(rgb_t));
+      return;
+    }
+    BLEND_LOOP(b);
+    break;
+  case LED_BLEND_ADD:
+    BLEND_LOOP(add_px(a, b));
+    break;
+  case LED_BLEND_MULTIPLY:
+    BLEND_LOOP(mul_px(a, b));
+    break;
+  case LED_BLEND_MAX:
+    BLEND_LOOP(max_px(a, b));
+    break;
+  default:
+    break;
+  }
+}
+
+const char *led_blend_name(led_blend_mode_t mode) {
+  return mode < LED_BLEND_COUNT ? s_names[mode] : "?";
+}
+
+int led_blend_from_name(const char *name) {
+  for (int i = 0; i < LED_BLEND_COUNT; i++) {
+    if (strcmp(name, s_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,58 @@
+#ifndef LED_BLEND_H
+#define LED_BLEND_H
+
+#include "led_api.h"
+#include <stdint.h>
+
+// Packed-pixel helpers shared by transitions and the layer compositor.
+// Pixels are packed as 0x00RRGGBB; weights are 0..256 (256 = all of b).
+
+typedef enum {
+  LED_BLEND_NORMAL,   // layer covers what is below
+  LED_BLEND_ADD,      // saturating add, good for light overlays
+  LED_BLEND_MULTIPLY, // darken/tint what is below
+  LED_BLEND_MAX,      // brightest channel wins
+  LED_BLEND_COUNT,
+} led_blend_mode_t;
+
+#define LED_WEIGHT_FULL 256
+
+static inline uint32_t led_pack_rgb(rgb_t c) {
+  return ((uint32_t)c.r << 16) | ((uint32_t)c.g << 8) | c.b;
+}
+
+static inline void led_store_rgb(rgb_t *px, uint32_t c) {
+  px->r = c >> 16;
+  px->g = c >> 8;
+  px->b = c;
+}
+
+// a + (b - a) * w. Red and blue share one multiply (0x00RR00BB), green gets
+// the other; each lane has 8 bits of headroom so a*(256-w) + b*w never
+// carries into the next lane.
+static inline uint32_t led_lerp_px(uint32_t a, uint32_t b, uint32_t w) {
+  uint32_t iw = LED_WEIGHT_FULL - w;
+  uint32_t rb = ((a & 0xFF00FF) * iw + (b & 0xFF00FF) * w) >> 8;
+  uint32_t g = ((a & 0x00FF00) * iw + (b & 0x00FF00) * w) >> 8;
+  return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+// 0..255 opacity to a 0..256 weight
+static inline uint32_t led_opacity_weight(uint8_t opacity) {
+  return opacity + (opacity >> 7);
+}
+
+void led_pack_frame(const rgb_t *px, uint32_t *out, int n);
+
+// dst = src * level / 255 (dst may be src)
+void led_scale_frame(rgb_t *dst, const rgb_t *src, int n, uint8_t level);
+
+// Composite src over dst in place
+void led_blend_layer(led_blend_mode_t mode, rgb_t *dst, const rgb_t *src,
+                     int n, uint8_t opacity);
+
+// "normal", "add", ... and back, -1 for unknown names
+const char *led_blend_name(led_blend_mode_t mode);
+int led_blend_from_name(const char *name);
+
+#endif
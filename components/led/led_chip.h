@@ -0,0 +1,110 @@
+#ifndef LED_CHIP_H
+#define LED_CHIP_H
+
+#include "sdkconfig.h"
+
+// Wire description of the chip picked in menuconfig (LED strip -> LED chip).
+// Everything here is a compile-time constant: the RMT bit symbols, reset
+// length and byte order are fixed when the firmware is built, so the
+// encoder and the packing loop never branch on the chip per byte.
+//
+//                  T0H   T0L   T1H   T1L  reset  white
+//  WS2812B         300   875   875   300  280us  -
+//  WS2811          250  1000   600   650  280us  -
+//  WS2815          300  1090  1090   320  280us  -
+//  SK6812          300   900   600   600   80us  -
+//  SK6812 RGBW     300   900   600   600   80us  yes
+#if CONFIG_LED_CHIP_WS2811
+#define LED_CHIP_NAME "WS2811"
+#define LED_CHIP_T0H_NS 250
+#define LED_CHIP_T0L_NS 1000
+#define LED_CHIP_T1H_NS 600
+#define LED_CHIP_T1L_NS 650
+#define LED_CHIP_RESET_US 280
+#define LED_CHIP_WHITE 0
+#elif CONFIG_LED_CHIP_WS2815
+#define LED_CHIP_NAME "WS2815"
+#define LED_CHIP_T0H_NS 300
+#define LED_CHIP_T0L_NS 1090
+#define LED_CHIP_T1H_NS 1090
+#define LED_CHIP_T1L_NS 320
+#define LED_CHIP_RESET_US 280
+#define LED_CHIP_WHITE 0
+#elif CONFIG_LED_CHIP_SK6812
+#define LED_CHIP_NAME "SK6812"
+#define LED_CHIP_T0H_NS 300
+#define LED_CHIP_T0L_NS 900
+#define LED_CHIP_T1H_NS 600
+#define LED_CHIP_T1L_NS 600
+#define LED_CHIP_RESET_US 80
+#define LED_CHIP_WHITE 0
+#elif CONFIG_LED_CHIP_SK6812_RGBW
+#define LED_CHIP_NAME "SK6812 RGBW"
+#define LED_CHIP_T0H_NS 300
+#define LED_CHIP_T0L_NS 900
+#define LED_CHIP_T1H_NS 600
+#define LED_CHIP_T1L_NS 600
+#define LED_CHIP_RESET_US 80
+#define LED_CHIP_WHITE 1
+#else // WS2812B
+#define LED_CHIP_NAME "WS2812B"
+#define LED_CHIP_T0H_NS 300
+#define LED_CHIP_T0L_NS 875
+#define LED_CHIP_T1H_NS 875
+#define LED_CHIP_T1L_NS 300
+#define LED_CHIP_RESET_US 280
+#define LED_CHIP_WHITE 0
+#endif
+
+// Bytes per LED on the wire, the white channel goes last
+#define LED_CHIP_BYTES (LED_CHIP_WHITE ? 4 : 3)
+
+// Which rgb_t member goes out first, second and third
+#if CONFIG_LED_COLOR_ORDER_RGB
+#define LED_WIRE_C0 r
+#define LED_WIRE_C1 g
+#define LED_WIRE_C2 b
+#elif CONFIG_LED_COLOR_ORDER_BRG
+#define LED_WIRE_C0 b
+#define LED_WIRE_C1 r
+#define LED_WIRE_C2 g
+#elif CONFIG_LED_COLOR_ORDER_RBG
+#define LED_WIRE_C0 r
+#define LED_WIRE_C1 b
+#define LED_WIRE_C2 g
+#elif CONFIG_LED_COLOR_ORDER_GBR
+#define LED_WIRE_C0 g
+#define LED_WIRE_C1 b
+#define LED_WIRE_C2 r
+#elif CONFIG_LED_COLOR_ORDER_BGR
+#define LED_WIRE_C0 b
+#define LED_WIRE_C1 g
+#define LED_WIRE_C2 r
+#else // GRB
+#define LED_WIRE_C0 g
+#define LED_WIRE_C1 r
+#define LED_WIRE_C2 b
+#endif
+
+// RMT runs at 10MHz, 100ns per tick
+#define LED_RMT_RESOLUTION_HZ 10000000
+#define LED_NS_TO_TICKS(ns) (((ns) + 50) / 100)
+
+// One RMT symbol per bit: high for T*H, then low for T*L
+#define LED_CHIP_SYMBOL(th, tl)                                                \
+  {.duration0 = LED_NS_TO_TICKS(th),                                           \
+   .level0 = 1,                                                                \
+   .duration1 = LED_NS_TO_TICKS(tl),                                           \
+   .level1 = 0}
+#define LED_CHIP_BIT0 LED_CHIP_SYMBOL(LED_CHIP_T0H_NS, LED_CHIP_T0L_NS)
+#define LED_CHIP_BIT1 LED_CHIP_SYMBOL(LED_CHIP_T1H_NS, LED_CHIP_T1L_NS)
+#define LED_CHIP_RESET_TICKS LED_NS_TO_TICKS(LED_CHIP_RESET_US * 1000)
+
+// RMT durations are 15 bits
+_Static_assert(LED_CHIP_RESET_TICKS < 32768, "LED reset too long for RMT");
+_Static_assert(LED_NS_TO_TICKS(LED_CHIP_T0H_NS) > 0 &&
+                   LED_NS_TO_TICKS(LED_CHIP_T1H_NS) >
+                       LED_NS_TO_TICKS(LED_CHIP_T0H_NS),
+               "LED bit timing does not fit the RMT resolution");
+
+#endif
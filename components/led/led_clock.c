@@ -0,0 +1,41 @@
+#include "led_clock.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static int64_t system_now_us(void) { return esp_timer_get_time(); }
+
+static void system_sleep_until_us(int64_t t_us) {
+  const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+  int64_t left = t_us - esp_timer_get_time();
+  // tick sleeps can overshoot by up to a tick, keep the rest for spinning
+  if (left > 2 * tick_us) {
+    vTaskDelay(left / tick_us - 1);
+  }
+  while (esp_timer_get_time() < t_us) {
+  }
+}
+
+const led_clock_t led_clock_system = {
+    .name = "system",
+    .now_us = system_now_us,
+    .sleep_until_us = system_sleep_until_us,
+};
+
+static int64_t s_virtual_us = 0;
+
+static int64_t virtual_now_us(void) { return s_virtual_us; }
+
+static void virtual_sleep_until_us(int64_t t_us) {
+  if (t_us > s_virtual_us) {
+    s_virtual_us = t_us;
+  }
+}
+
+void led_clock_virtual_reset(int64_t t_us) { s_virtual_us = t_us; }
+
+const led_clock_t led_clock_virtual = {
+    .name = "virtual",
+    .now_us = virtual_now_us,
+    .sleep_until_us = virtual_sleep_until_us,
+};
@@ -0,0 +1,27 @@
+#ifndef LED_CLOCK_H
+#define LED_CLOCK_H
+
+#include <stdint.h>
+
+// Time source for code that paces frames. Effects never read a clock
+// themselves, they get the effect time from whoever drives them; this is
+// what the driver sleeps and measures on.
+typedef struct {
+  const char *name;
+  int64_t (*now_us)(void);
+  // Return at t_us or as soon after as possible
+  void (*sleep_until_us)(int64_t t_us);
+  // Optional, for clocks that can jump (a network clock locking on):
+  // number of jumps so far and their sum in us
+  uint32_t (*steps)(int64_t *total_us);
+} led_clock_t;
+
+// esp_timer, sleeps on the scheduler and spins the last millisecond
+extern const led_clock_t led_clock_system;
+
+// Simulated time: only moves when slept on, so a run on it gives the same
+// frames every time and takes no longer than the rendering itself
+extern const led_clock_t led_clock_virtual;
+void led_clock_virtual_reset(int64_t t_us);
+
+#endif
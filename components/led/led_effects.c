@@ -1,8 +1,13 @@
 #include "led_effects.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 #include "led_api.h"
-#include <math.h>
+#include "led_font.h"
+#include "led_layout.h"
+#include "led_math.h"
+#include "led_noise.h"
+#include "led_render.h"
+#include "led_shader.h"
+#include <stddef.h>
+#include <string.h>
 
 // Konvertera HSV (Hue, Saturation, Value) till RGB
 void hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g,
@@ -49,86 +54,317 @@ void hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g,
   }
 }
 
+// Hur många steg av `speed` grader regnbågen har hunnit rotera (ett steg per
+// 20 ms, samma takt som de gamla blockerande looparna)
+static uint16_t hue_at(uint8_t speed, uint32_t t_ms) {
+  return (uint16_t)(((uint64_t)t_ms / 20 * speed) % 360);
+}
+
+// Millisekunder per steg för studsande bollen
+static uint32_t bounce_step_ms(uint8_t speed) {
+  uint32_t step = 50 / (speed ? speed : 1);
+  return step ? step : 1;
+}
+
+// Enfärgad stripe
+static void render_solid(const led_effect_params_t *p, uint32_t t_ms,
+                         led_frame_t *f) {
+  rgb_t c = {p->r, p->g, p->b};
+  for (int i = f->start; i < f->end; i++) {
+    f->px[i] = c;
+  }
+}
+
 // Rainbow chase - färgregnbåge som rör sig längs stripen
-void led_rainbow_chase(uint8_t speed, uint32_t duration_ms) {
-  int num_leds = ws2812_get_num_leds();
-  uint32_t start_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-  uint16_t hue_offset = 0;
-
-  while ((xTaskGetTickCount() * portTICK_PERIOD_MS - start_time) <
-         duration_ms) {
-    for (int i = 0; i < num_leds; i++) {
-      // Varje LED får en färg baserat på position + offset
-      uint16_t hue = ((i * 360 / num_leds) + hue_offset) % 360;
-      uint8_t r, g, b;
-      hsv_to_rgb(hue, 255, 255, &r, &g, &b);
-      ws2812_set_pixel(i, r, g, b);
+static void render_rainbow_chase(const led_effect_params_t *p, uint32_t t_ms,
+                                 led_frame_t *f) {
+  uint16_t hue_offset = hue_at(p->speed, t_ms);
+  for (int i = f->start; i < f->end; i++) {
+    // Varje LED får en färg baserat på position + offset
+    uint16_t hue = ((i * 360 / f->num_leds) + hue_offset) % 360;
+    rgb_t *px = &f->px[i];
+    hsv_to_rgb(hue, 255, 255, &px->r, &px->g, &px->b);
+  }
+}
+
+// Rainbow cycle - alla LEDs ändrar färg synkront
+static void render_rainbow_cycle(const led_effect_params_t *p, uint32_t t_ms,
+                                 led_frame_t *f) {
+  rgb_t c;
+  hsv_to_rgb(hue_at(p->speed, t_ms), 255, 255, &c.r, &c.g, &c.b);
+  for (int i = f->start; i < f->end; i++) {
+    f->px[i] = c;
+  }
+}
+
+// Studsande boll-effekt
+static void render_bouncing_ball(const led_effect_params_t *p, uint32_t t_ms,
+                                 led_frame_t *f) {
+  int num_leds = f->num_leds;
+  // Bollen går fram och tillbaka, en period är 2 * (num_leds - 1) steg
+  int period = num_leds > 1 ? 2 * (num_leds - 1) : 1;
+  int step = (t_ms / bounce_step_ms(p->speed)) % period;
+  int position = step < num_leds ? step : period - step;
+
+  rgb_t ball = {p->r, p->g, p->b};
+  rgb_t trail = {p->r / 4, p->g / 4, p->b / 4};
+  for (int i = f->start; i < f->end; i++) {
+    // Rita "bollen" med trailing effect
+    if (i == position) {
+      f->px[i] = ball;
+    } else if (i == position - 1 || i == position + 1) {
+      f->px[i] = trail;
+    } else {
+      f->px[i] = (rgb_t){0, 0, 0};
     }
-    ws2812_show();
+  }
+}
 
-    hue_offset += speed;
-    if (hue_offset >= 360)
-      hue_offset = 0;
+// Color wipe - fyller stripen från början till slut, LEDs som vågen inte
+// nått än behåller sin gamla färg
+static void render_color_wipe(const led_effect_params_t *p, uint32_t t_ms,
+                              led_frame_t *f) {
+  uint32_t lit = t_ms / (p->delay_ms ? p->delay_ms : 1) + 1;
+  int end = lit < (uint32_t)f->end ? (int)lit : f->end;
+  rgb_t c = {p->r, p->g, p->b};
+  for (int i = f->start; i < end; i++) {
+    f->px[i] = c;
+  }
+}
 
-    vTaskDelay(pdMS_TO_TICKS(20)); // ~50 FPS
+// Självtest - röd, grön, blå och av, delay_ms per färg
+static void render_self_test(const led_effect_params_t *p, uint32_t t_ms,
+                             led_frame_t *f) {
+  static const rgb_t steps[] = {{200, 0, 0}, {0, 200, 0}, {0, 0, 200}, {0}};
+  uint32_t step = t_ms / (p->delay_ms ? p->delay_ms : 1);
+  rgb_t c = steps[step < 3 ? step : 3];
+  for (int i = f->start; i < f->end; i++) {
+    f->px[i] = c;
   }
 }
 
-// Rainbow cycle - alla LEDs ändrar färg synkront
-void led_rainbow_cycle(uint8_t speed, uint32_t duration_ms) {
-  uint32_t start_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-  uint16_t hue = 0;
+// Notis - hela stripen blinkar, tänd första halvan av varje period
+static void render_flash(const led_effect_params_t *p, uint32_t t_ms,
+                         led_frame_t *f) {
+  uint32_t period = p->delay_ms ? p->delay_ms : 1;
+  bool on = t_ms % period < period / 2;
+  rgb_t c = on ? (rgb_t){p->r, p->g, p->b} : (rgb_t){0, 0, 0};
+  for (int i = f->start; i < f->end; i++) {
+    f->px[i] = c;
+  }
+}
 
-  while ((xTaskGetTickCount() * portTICK_PERIOD_MS - start_time) <
-         duration_ms) {
-    uint8_t r, g, b;
-    hsv_to_rgb(hue, 255, 255, &r, &g, &b);
-    ws2812_set_all(r, g, b);
-    ws2812_show();
+// Plasma - summa av sinusvågor över x, y och diagonalen, färgen tas från
+// summan. Allt i heltal via sinustabellen.
+static void render_plasma(const led_effect_params_t *p, uint32_t t_ms,
+                          led_frame_t *f) {
+  const led_layout_t *l = led_layout_get();
+  uint32_t t = t_ms * (p->speed ? p->speed : 1) / 16;
+  uint8_t t1 = t, t2 = t * 3 / 4, t3 = t / 2;
+  uint16_t hue_shift = t / 8;
 
-    hue = (hue + speed) % 360;
-    vTaskDelay(pdMS_TO_TICKS(20));
+  // bara vår del av bilden, den andra kärnan kan ta resten
+  for (int i = f->start; i < f->end; i++) {
+    int x, y;
+    if (!led_layout_pos(l, i, &x, &y)) {
+      continue;
+    }
+    uint16_t v = led_sin8(x * 16 + t1) + led_sin8(y * 16 + t2) +
+                 led_sin8((x + y) * 8 + t3) +
+                 led_sin8(led_sin8(x * 8 + t3) / 2 + y * 12);
+    hsv_to_rgb((v * 360 / 1024 + hue_shift) % 360, 255, 255, &f->px[i].r,
+               &f->px[i].g, &f->px[i].b);
   }
 }
 
-// Studsande boll-effekt
-void led_bouncing_ball(uint8_t r, uint8_t g, uint8_t b, uint8_t speed) {
-  int num_leds = ws2812_get_num_leds();
-  int position = 0;
-  int direction = 1; // 1 = framåt, -1 = bakåt
+// Rullande text - 5x7-typsnitt, en tom kolumn mellan tecknen
+static void render_scroll_text(const led_effect_params_t *p, uint32_t t_ms,
+                               led_frame_t *f) {
+  const led_layout_t *l = led_layout_get();
+  for (int i = f->start; i < f->end; i++) {
+    f->px[i] = (rgb_t){0, 0, 0};
+  }
 
-  for (int i = 0; i < 100; i++) { // 100 studsar
-    ws2812_clear();
+  int len = strnlen(p->text, LED_TEXT_MAX);
+  int text_w = len * (LED_FONT_WIDTH + 1);
+  int step = t_ms / (p->delay_ms ? p->delay_ms : 1);
+  // texten börjar precis utanför högerkanten
+  int x0 = l->width - step % (l->width + text_w);
+  int y0 = (l->height - LED_FONT_HEIGHT) / 2;
+  rgb_t c = {p->r, p->g, p->b};
 
-    // Rita "bollen" med trailing effect
-    ws2812_set_pixel(position, r, g, b);
-    if (position > 0) {
-      ws2812_set_pixel(position - 1, r / 4, g / 4, b / 4);
+  int x_end = x0 + text_w < l->width ? x0 + text_w : l->width;
+  for (int x = x0 > 0 ? x0 : 0; x < x_end; x++) {
+    int col = x - x0;
+    int cx = col % (LED_FONT_WIDTH + 1);
+    if (cx == LED_FONT_WIDTH) {
+      continue; // mellanrum
     }
-    if (position < num_leds - 1) {
-      ws2812_set_pixel(position + 1, r / 4, g / 4, b / 4);
+    uint8_t bits = led_font_glyph(p->text[col / (LED_FONT_WIDTH + 1)])[cx];
+    for (int row = 0; row < LED_FONT_HEIGHT; row++) {
+      if (bits & (1 << row)) {
+        led_draw2d(l, f, x, y0 + row, c);
+      }
     }
+  }
+}
 
-    ws2812_show();
+// Värme 0-255 till färg: svart -> röd -> gul -> vit
+static rgb_t heat_color(uint8_t heat) {
+  uint8_t t = (heat * 191) >> 8;
+  uint8_t ramp = (t & 0x3F) << 2;
+  if (t & 0x80) {
+    return (rgb_t){255, 255, ramp};
+  }
+  if (t & 0x40) {
+    return (rgb_t){255, ramp, 0};
+  }
+  return (rgb_t){ramp, 0, 0};
+}
 
-    position += direction;
+// Eld - brus som stiger uppåt och svalnar med höjden. På en vanlig strip
+// (en rad) brinner den från index 0 och utåt. Värmen räknas fram ur bruset
+// för varje pixel och tid, inget sparas mellan bilderna, så bilden kan
+// delas mellan kärnorna.
+static void render_fire(const led_effect_params_t *p, uint32_t t_ms,
+                        led_frame_t *f) {
+  const led_layout_t *l = led_layout_get();
+  bool strip = l->height == 1;
+  int rows = strip ? l->width : l->height;
+  uint32_t speed = p->speed ? p->speed : 1;
+  // 16.16-koordinater, ungefär 2 rader per sekund och speed-steg
+  uint32_t rise = t_ms * speed * 24;
+  uint32_t flicker = t_ms * speed * 8;
 
-    // Studsa vid ändarna
-    if (position >= num_leds - 1 || position <= 0) {
-      direction *= -1;
+  for (int i = f->start; i < f->end; i++) {
+    int x, y;
+    if (!led_layout_pos(l, i, &x, &y)) {
+      continue;
     }
+    int r = strip ? x : l->height - 1 - y;
+    int c = strip ? 0 : x;
+    int heat = led_fbm3(c * 0x4000, r * 0x3000 - rise, flicker, 2) + 48 -
+               r * 300 / rows;
+    heat = heat < 0 ? 0 : heat > 255 ? 255 : heat;
+    f->px[i] = heat_color(heat);
+  }
+}
+
+// Brusfält - färgen följer ett långsamt flytande brus
+static void render_noise(const led_effect_params_t *p, uint32_t t_ms,
+                         led_frame_t *f) {
+  const led_layout_t *l = led_layout_get();
+  uint32_t z = t_ms * (p->speed ? p->speed : 1) * 16;
+  uint16_t hue_shift = t_ms / 100;
 
-    vTaskDelay(pdMS_TO_TICKS(50 / speed));
+  for (int i = f->start; i < f->end; i++) {
+    int x, y;
+    if (!led_layout_pos(l, i, &x, &y)) {
+      continue;
+    }
+    uint8_t n = led_fbm3(x * 0x2000, y * 0x2000, z, 2);
+    hsv_to_rgb((n * 360 / 256 + hue_shift) % 360, 255, 255, &f->px[i].r,
+               &f->px[i].g, &f->px[i].b);
   }
 }
 
-// Color wipe - fyller stripen från början till slut
-void led_color_wipe(uint8_t r, uint8_t g, uint8_t b, uint16_t delay_ms) {
-  int num_leds = ws2812_get_num_leds();
+static const led_effect_t s_effects[LED_EFFECT_COUNT] = {
+    [LED_EFFECT_SOLID] = {"solid", render_solid, true, true},
+    [LED_EFFECT_RAINBOW_CHASE] = {"rainbow_chase", render_rainbow_chase, true,
+                                  false},
+    [LED_EFFECT_RAINBOW_CYCLE] = {"rainbow_cycle", render_rainbow_cycle, true,
+                                  false},
+    [LED_EFFECT_BOUNCING_BALL] = {"bouncing_ball", render_bouncing_ball,
+                                  false, false},
+    [LED_EFFECT_COLOR_WIPE] = {"color_wipe", render_color_wipe, false, false},
+    [LED_EFFECT_SELF_TEST] = {"self_test", render_self_test, true, false},
+    [LED_EFFECT_FLASH] = {"flash", render_flash, true, false},
+    [LED_EFFECT_PLASMA] = {"plasma", render_plasma, true, false},
+    [LED_EFFECT_SCROLL_TEXT] = {"scroll_text", render_scroll_text, false,
+                                false},
+    [LED_EFFECT_FIRE] = {"fire", render_fire, true, false},
+    [LED_EFFECT_NOISE] = {"noise", render_noise, true, false},
+    [LED_EFFECT_SHADER] = {"shader", led_shader_render, true, false,
+                           led_shader_render16},
+};
 
-  for (int i = 0; i < num_leds; i++) {
-    ws2812_set_pixel(i, r, g, b);
-    ws2812_show();
-    vTaskDelay(pdMS_TO_TICKS(delay_ms));
+const led_effect_t *led_effect_get(led_effect_id_t id) {
+  if (id < 0 || id >= LED_EFFECT_COUNT) {
+    return NULL;
   }
+  return &s_effects[id];
+}
+
+int led_effect_from_name(const char *name) {
+  for (int i = 0; i < LED_EFFECT_COUNT; i++) {
+    if (strcmp(name, s_effects[i].name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void led_rainbow_chase(uint8_t speed, uint32_t duration_ms) {
+  led_effect_params_t p = {.speed = speed};
+  led_render_play(LED_EFFECT_RAINBOW_CHASE, &p, duration_ms);
+}
+
+void led_rainbow_cycle(uint8_t speed, uint32_t duration_ms) {
+  led_effect_params_t p = {.speed = speed};
+  led_render_play(LED_EFFECT_RAINBOW_CYCLE, &p, duration_ms);
+}
+
+void led_bouncing_ball(uint8_t r, uint8_t g, uint8_t b, uint8_t speed) {
+  led_effect_params_t p = {.r = r, .g = g, .b = b, .speed = speed};
+  // 100 studsar
+  led_render_play(LED_EFFECT_BOUNCING_BALL, &p, 100 * bounce_step_ms(speed));
+}
+
+void led_color_wipe(uint8_t r, uint8_t g, uint8_t b, uint16_t delay_ms) {
+  led_effect_params_t p = {.r = r, .g = g, .b = b, .delay_ms = delay_ms};
+  led_render_play(LED_EFFECT_COLOR_WIPE, &p,
+                  ws2812_get_num_leds() * (delay_ms ? delay_ms : 1));
+}
+
+void led_solid(uint8_t r, uint8_t g, uint8_t b) {
+  led_effect_params_t p = {.r = r, .g = g, .b = b};
+  led_render_play(LED_EFFECT_SOLID, &p, 0);
+}
+
+void led_flash(uint8_t r, uint8_t g, uint8_t b, uint16_t period_ms,
+               uint32_t duration_ms) {
+  led_effect_params_t p = {.r = r, .g = g, .b = b, .delay_ms = period_ms};
+  led_render_layer_play(LED_LAYER_NOTIFY, LED_EFFECT_FLASH, &p, duration_ms);
+}
+
+void led_plasma(uint8_t speed, uint32_t duration_ms) {
+  led_effect_params_t p = {.speed = speed};
+  led_render_play(LED_EFFECT_PLASMA, &p, duration_ms);
+}
+
+void led_fire(uint8_t speed, uint32_t duration_ms) {
+  led_effect_params_t p = {.speed = speed};
+  led_render_play(LED_EFFECT_FIRE, &p, duration_ms);
+}
+
+void led_noise_field(uint8_t speed, uint32_t duration_ms) {
+  led_effect_params_t p = {.speed = speed};
+  led_render_play(LED_EFFECT_NOISE, &p, duration_ms);
+}
+
+void led_shader(uint32_t duration_ms) {
+  led_effect_params_t p = {0};
+  led_render_play(LED_EFFECT_SHADER, &p, duration_ms);
+}
+
+void led_scroll_text(const char *text, uint8_t r, uint8_t g, uint8_t b,
+                     uint16_t step_ms) {
+  led_effect_params_t p = {.r = r, .g = g, .b = b, .delay_ms = step_ms};
+  strncpy(p.text, text, sizeof(p.text) - 1);
+  led_render_play(LED_EFFECT_SCROLL_TEXT, &p, 0);
+}
+
+void led_self_test(uint16_t step_ms) {
+  led_effect_params_t p = {.delay_ms = step_ms};
+  led_render_play(LED_EFFECT_SELF_TEST, &p, 4 * step_ms);
 }
@@ -1,8 +1,81 @@
 #ifndef LED_EFFECTS_H
 #define LED_EFFECTS_H
 
+#include "led_api.h"
+#include <stdbool.h>
 #include <stdint.h>
 
+typedef enum {
+  LED_EFFECT_SOLID,
+  LED_EFFECT_RAINBOW_CHASE,
+  LED_EFFECT_RAINBOW_CYCLE,
+  LED_EFFECT_BOUNCING_BALL,
+  LED_EFFECT_COLOR_WIPE,
+  LED_EFFECT_SELF_TEST,
+  LED_EFFECT_FLASH,
+  LED_EFFECT_PLASMA,
+  LED_EFFECT_SCROLL_TEXT,
+  LED_EFFECT_FIRE,
+  LED_EFFECT_NOISE,
+  LED_EFFECT_SHADER,
+  LED_EFFECT_COUNT,
+} led_effect_id_t;
+
+#define LED_TEXT_MAX 32
+
+// Parametrar för en effekt (vilka som används beror på effekten)
+typedef struct {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t speed;
+  uint16_t delay_ms;
+  char text[LED_TEXT_MAX]; // rullande text
+} led_effect_params_t;
+
+// Den del av bilden en effekt ska rita. Effekten får bara skriva
+// px[start..end), så att två kärnor kan dela på samma bild.
+typedef struct {
+  rgb_t *px;
+  int start;
+  int end;
+  int num_leds;
+} led_frame_t;
+
+// Samma sak med 16 bitar per kanal
+typedef struct {
+  rgb16_t *px;
+  int start;
+  int end;
+  int num_leds;
+} led_frame16_t;
+
+// Rita bilden för tiden t_ms sedan effekten startade
+typedef void (*led_effect_render_fn)(const led_effect_params_t *p,
+                                     uint32_t t_ms, led_frame_t *f);
+typedef void (*led_effect_render16_fn)(const led_effect_params_t *p,
+                                       uint32_t t_ms, led_frame16_t *f);
+
+typedef struct {
+  const char *name;
+  led_effect_render_fn render;
+  // pixlarna beror inte på varandra, bilden kan delas mellan kärnorna
+  bool parallel;
+  // bilden beror bara på parametrarna, inte på tiden (behöver bara
+  // ritas en gång)
+  bool still;
+  // valfri: ritar med mer än 8 bitar, används för baslagret med
+  // CONFIG_LED_HIGH_DEPTH
+  led_effect_render16_fn render16;
+} led_effect_t;
+
+const led_effect_t *led_effect_get(led_effect_id_t id);
+
+// Slå upp en effekt på namn ("solid", "rainbow_chase", ...), -1 om okänd
+int led_effect_from_name(const char *name);
+
+// Effekterna nedan startas i render-tasken och returnerar direkt
+
 // Rainbow som rör sig längs stripen
 void led_rainbow_chase(uint8_t speed, uint32_t duration_ms);
 
@@ -15,6 +88,35 @@ void led_bouncing_ball(uint8_t r, uint8_t g, uint8_t b, uint8_t speed);
 // Färgvåg som färdas längs stripen
 void led_color_wipe(uint8_t r, uint8_t g, uint8_t b, uint16_t delay_ms);
 
+// En färg på hela stripen tills något annat startas
+void led_solid(uint8_t r, uint8_t g, uint8_t b);
+
+// Blinkande notis ovanpå det som spelas (översta lagret), period_ms per
+// blink, försvinner efter duration_ms
+void led_flash(uint8_t r, uint8_t g, uint8_t b, uint16_t period_ms,
+               uint32_t duration_ms);
+
+// 2D-effekter, ritas genom layouten (led_layout.h)
+
+// Plasma över hela matrisen
+void led_plasma(uint8_t speed, uint32_t duration_ms);
+
+// Eld som stiger från nederkanten (index 0 på en vanlig strip)
+void led_fire(uint8_t speed, uint32_t duration_ms);
+
+// Flytande färgfält av brus
+void led_noise_field(uint8_t speed, uint32_t duration_ms);
+
+// Programmet som laddats med led_shader_load_* (led_shader.h)
+void led_shader(uint32_t duration_ms);
+
+// Text som rullar från höger till vänster, step_ms per kolumn
+void led_scroll_text(const char *text, uint8_t r, uint8_t g, uint8_t b,
+                     uint16_t step_ms);
+
+// Kort självtest vid boot: röd, grön, blå, av, step_ms per färg
+void led_self_test(uint16_t step_ms);
+
 // Hjälpfunktion: konvertera HSV till RGB
 void hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g,
                 uint8_t *b);
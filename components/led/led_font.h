@@ -0,0 +1,13 @@
+#ifndef LED_FONT_H
+#define LED_FONT_H
+
+#include <stdint.h>
+
+#define LED_FONT_WIDTH 5
+#define LED_FONT_HEIGHT 7
+
+// Columns of a printable ASCII character, bit 0 is the top row. Characters
+// outside ' '..'~' come out as '?'.
+const uint8_t *led_font_glyph(char c);
+
+#endif
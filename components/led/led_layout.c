@@ -0,0 +1,189 @@
+#include "led_layout.h"
+#include "esp_log.h"
+#include "led_swap.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "led_layout";
+
+#if CONFIG_LED_MATRIX_SERPENTINE
+#define MATRIX_SERPENTINE true
+#else
+#define MATRIX_SERPENTINE false
+#endif
+
+// Two tables: a new layout is built in the spare one, then swapped in
+static int16_t s_lut[2][CONFIG_LED_LAYOUT_MAX_CELLS];
+static int16_t s_pos[2][CONFIG_LED_STRIP_COUNT];
+static led_layout_t s_layouts[2];
+static led_swap_t s_swap = LED_SWAP_INIT(&s_layouts[0], &s_layouts[1]);
+static int s_num_leds = 0;
+
+static led_layout_t *spare_layout(int16_t **lut) {
+  led_layout_t *l = led_swap_begin(&s_swap);
+  if (!l) {
+    ESP_LOGW(TAG, "Previous layout still in use");
+    return NULL;
+  }
+  *lut = s_lut[l - s_layouts];
+  return l;
+}
+
+static esp_err_t check_size(int width, int height) {
+  if (width <= 0 || height <= 0 ||
+      width * height > CONFIG_LED_LAYOUT_MAX_CELLS) {
+    ESP_LOGE(TAG, "Layout %dx%d does not fit (max %d cells)", width, height,
+             CONFIG_LED_LAYOUT_MAX_CELLS);
+    return ESP_ERR_INVALID_SIZE;
+  }
+  return ESP_OK;
+}
+
+static void publish(led_layout_t *l, int16_t *lut, int width, int height) {
+  // inverse of the finished table, so both agree on LEDs placed twice
+  int16_t *pos = s_pos[l - s_layouts];
+  memset(pos, 0xFF, sizeof(s_pos[0]));
+  for (int cell = 0; cell < width * height; cell++) {
+    if (lut[cell] >= 0 && lut[cell] < CONFIG_LED_STRIP_COUNT) {
+      pos[lut[cell]] = cell;
+    }
+  }
+
+  l->width = width;
+  l->height = height;
+  l->lut = lut;
+  l->pos = pos;
+  l->num_leds = s_num_leds < CONFIG_LED_STRIP_COUNT ? s_num_leds
+                                                    : CONFIG_LED_STRIP_COUNT;
+  led_swap_publish(&s_swap, l);
+  ESP_LOGI(TAG, "Layout %dx%d for %d LEDs", width, height, s_num_leds);
+}
+
+esp_err_t led_layout_set_matrix(const led_matrix_t *m) {
+  if (m->rotation > 3) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  int tx = m->tiles_x ? m->tiles_x : 1;
+  int ty = m->tiles_y ? m->tiles_y : 1;
+  int pw = tx * m->width; // physical size before rotation
+  int ph = ty * m->height;
+  bool swap = m->rotation & 1;
+  int width = swap ? ph : pw;
+  int height = swap ? pw : ph;
+  esp_err_t err = check_size(width, height);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  int16_t *lut;
+  led_layout_t *l = spare_layout(&lut);
+  if (!l) {
+    return ESP_ERR_TIMEOUT;
+  }
+  memset(lut, 0xFF, width * height * sizeof(int16_t));
+
+  // walk the LEDs in wiring order and note where each one ends up
+  int index = 0;
+  for (int tile = 0; tile < tx * ty; tile++) {
+    int ox = (tile % tx) * m->width;
+    int oy = (tile / tx) * m->height;
+    for (int py = 0; py < m->height; py++) {
+      for (int px = 0; px < m->width; px++, index++) {
+        if (index >= s_num_leds) {
+          continue;
+        }
+        int col = m->serpentine && (py & 1) ? m->width - 1 - px : px;
+        int X = ox + col;
+        int Y = oy + py;
+        int x, y;
+        switch (m->rotation) {
+        case 1:
+          x = ph - 1 - Y;
+          y = X;
+          break;
+        case 2:
+          x = pw - 1 - X;
+          y = ph - 1 - Y;
+          break;
+        case 3:
+          x = Y;
+          y = pw - 1 - X;
+          break;
+        default:
+          x = X;
+          y = Y;
+          break;
+        }
+        lut[y * width + x] = index;
+      }
+    }
+  }
+
+  publish(l, lut, width, height);
+  return ESP_OK;
+}
+
+esp_err_t led_layout_set_coords(const led_point_t *pts, int n) {
+  int width = 0, height = 0;
+  for (int i = 0; i < n; i++) {
+    if (pts[i].x >= width) {
+      width = pts[i].x + 1;
+    }
+    if (pts[i].y >= height) {
+      height = pts[i].y + 1;
+    }
+  }
+  esp_err_t err = check_size(width, height);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  int16_t *lut;
+  led_layout_t *l = spare_layout(&lut);
+  if (!l) {
+    return ESP_ERR_TIMEOUT;
+  }
+  memset(lut, 0xFF, width * height * sizeof(int16_t));
+  for (int i = 0; i < n && i < s_num_leds; i++) {
+    lut[pts[i].y * width + pts[i].x] = i;
+  }
+
+  publish(l, lut, width, height);
+  return ESP_OK;
+}
+
+void led_layout_init(int num_leds) {
+  s_num_leds = num_leds;
+
+#if CONFIG_LED_MATRIX_WIDTH > 0
+  led_matrix_t m = {
+      .width = CONFIG_LED_MATRIX_WIDTH,
+      .height = CONFIG_LED_MATRIX_HEIGHT,
+      .serpentine = MATRIX_SERPENTINE,
+      .rotation = CONFIG_LED_MATRIX_ROTATION,
+      .tiles_x = CONFIG_LED_MATRIX_TILES_X,
+      .tiles_y = CONFIG_LED_MATRIX_TILES_Y,
+  };
+  if (led_layout_set_matrix(&m) == ESP_OK) {
+    return;
+  }
+#endif
+
+  // plain strip, one row
+  int width = num_leds < CONFIG_LED_LAYOUT_MAX_CELLS
+                  ? num_leds
+                  : CONFIG_LED_LAYOUT_MAX_CELLS;
+  int16_t *lut;
+  led_layout_t *l = spare_layout(&lut);
+  if (!l) {
+    return;
+  }
+  for (int i = 0; i < width; i++) {
+    lut[i] = i;
+  }
+  publish(l, lut, width, 1);
+}
+
+const led_layout_t *led_layout_get(void) {
+  return led_swap_current(&s_swap);
+}
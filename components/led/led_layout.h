@@ -0,0 +1,78 @@
+#ifndef LED_LAYOUT_H
+#define LED_LAYOUT_H
+
+#include "esp_err.h"
+#include "led_api.h"
+#include "led_effects.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Matrix built from one or more identical panels
+typedef struct {
+  uint16_t width; // one panel
+  uint16_t height;
+  bool serpentine; // every other row runs backwards
+  uint8_t rotation; // quarter turns clockwise, 0-3
+  uint8_t tiles_x;  // panels side by side, wired row by row
+  uint8_t tiles_y;
+} led_matrix_t;
+
+// Position of one LED for free-form layouts
+typedef struct {
+  uint16_t x;
+  uint16_t y;
+} led_point_t;
+
+// x/y -> LED index table, -1 where there is no LED, and the other way
+// round for effects that draw only their part of the frame
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  const int16_t *lut;
+  const int16_t *pos; // LED index -> y * width + x, -1 if not placed
+  int num_leds;       // length of pos
+} led_layout_t;
+
+// Default layout from Kconfig (a plain strip if no matrix is configured)
+void led_layout_init(int num_leds);
+
+esp_err_t led_layout_set_matrix(const led_matrix_t *m);
+
+// pts[i] is where LED i sits
+esp_err_t led_layout_set_coords(const led_point_t *pts, int n);
+
+// Current layout. Effects fetch it once per frame; a new layout takes
+// effect from the next frame. Setting one right after another waits for
+// the render task to finish the frame that used the older one
+// (ESP_ERR_TIMEOUT if it does not).
+const led_layout_t *led_layout_get(void);
+
+static inline int led_layout_index(const led_layout_t *l, int x, int y) {
+  if ((unsigned)x >= l->width || (unsigned)y >= l->height) {
+    return -1;
+  }
+  return l->lut[y * l->width + x];
+}
+
+// Where LED i sits, false if it has no place in the layout
+static inline bool led_layout_pos(const led_layout_t *l, int i, int *x,
+                                  int *y) {
+  int cell = i < l->num_leds ? l->pos[i] : -1;
+  if (cell < 0) {
+    return false;
+  }
+  *x = cell % l->width;
+  *y = cell / l->width;
+  return true;
+}
+
+// Set the pixel at x/y if it has an LED in the part of the frame being drawn
+static inline void led_draw2d(const led_layout_t *l, led_frame_t *f, int x,
+                              int y, rgb_t c) {
+  int i = led_layout_index(l, x, y);
+  if (i >= f->start && i < f->end) {
+    f->px[i] = c;
+  }
+}
+
+#endif
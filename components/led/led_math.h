@@ -0,0 +1,21 @@
+#ifndef LED_MATH_H
+#define LED_MATH_H
+
+#include <stdint.h>
+
+// Integer helpers for effects, no floats in the render path
+
+// Quarter sine wave, 127 * sin(i * pi / 128) for i = 0..64
+extern const uint8_t led_sin_quarter[65];
+
+// Sine over a 256-step circle, 128 + 127 * sin(theta * 2pi / 256)
+static inline uint8_t led_sin8(uint8_t theta) {
+  uint8_t i = theta & 0x3F;
+  uint8_t q = theta >> 6;
+  uint8_t s = led_sin_quarter[(q & 1) ? 64 - i : i];
+  return (q & 2) ? 128 - s : 128 + s;
+}
+
+static inline uint8_t led_cos8(uint8_t theta) { return led_sin8(theta + 64); }
+
+#endif
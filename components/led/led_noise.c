@@ -0,0 +1,109 @@
+#include "led_noise.h"
+
+// Ken Perlin's permutation, indexed with uint8_t so it wraps by itself
+static const uint8_t s_perm[256] = {
+    151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140,
+    36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120,
+    234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33,
+    88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71,
+    134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133,
+    230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161,
+    1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130,
+    116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64, 52, 217, 226, 250,
+    124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207, 206, 59, 227,
+    47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44,
+    154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98,
+    108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251, 34,
+    242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14,
+    239, 107, 49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121,
+    50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243,
+    141, 128, 195, 78, 66, 215, 61, 156, 180,
+};
+
+// Gradients along the 12 cube edges, padded to 16 so hash & 15 picks one
+static const int8_t s_grad3[16][3] = {
+    {1, 1, 0},  {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0}, {1, 0, 1},  {-1, 0, 1},
+    {1, 0, -1}, {-1, 0, -1}, {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1},
+    {1, 1, 0},  {0, -1, 1}, {-1, 1, 0}, {0, -1, -1},
+};
+
+// 8 directions for 2D
+static const int8_t s_grad2[8][2] = {
+    {1, 1}, {-1, 1}, {1, -1}, {-1, -1}, {1, 0}, {-1, 0}, {0, 1}, {0, -1},
+};
+
+#define P(x) s_perm[(uint8_t)(x)]
+
+// Smoothstep fade 3t^2 - 2t^3 on 0..255
+static inline int32_t fade(int32_t t) {
+  return (t * t * (3 * 256 - 2 * t)) >> 16;
+}
+
+static inline int32_t lerp(int32_t a, int32_t b, int32_t t) {
+  return a + (((b - a) * t) >> 8);
+}
+
+static inline int32_t grad2(uint8_t hash, int32_t dx, int32_t dy) {
+  const int8_t *g = s_grad2[hash & 7];
+  return g[0] * dx + g[1] * dy;
+}
+
+static inline int32_t grad3(uint8_t hash, int32_t dx, int32_t dy,
+                            int32_t dz) {
+  const int8_t *g = s_grad3[hash & 15];
+  return g[0] * dx + g[1] * dy + g[2] * dz;
+}
+
+// Raw results are about +-256; scaled so common values fill -128..127
+#define NOISE_GAIN 3
+#define NOISE_SHIFT 2
+
+static inline int8_t to_s8(int32_t n) {
+  n = (n * NOISE_GAIN) >> NOISE_SHIFT;
+  return n < -128 ? -128 : n > 127 ? 127 : n;
+}
+
+int8_t led_noise2(uint32_t x, uint32_t y) {
+  uint8_t X = x >> 16, Y = y >> 16;
+  // fraction as 8 bits, corner offsets as -256..255
+  int32_t fx = (x >> 8) & 0xFF, fy = (y >> 8) & 0xFF;
+  int32_t u = fade(fx), v = fade(fy);
+
+  uint8_t a = P(X) + Y, b = P(X + 1) + Y;
+  int32_t n00 = grad2(P(a), fx, fy);
+  int32_t n10 = grad2(P(b), fx - 256, fy);
+  int32_t n01 = grad2(P(a + 1), fx, fy - 256);
+  int32_t n11 = grad2(P(b + 1), fx - 256, fy - 256);
+
+  return to_s8(lerp(lerp(n00, n10, u), lerp(n01, n11, u), v));
+}
+
+int8_t led_noise3(uint32_t x, uint32_t y, uint32_t z) {
+  uint8_t X = x >> 16, Y = y >> 16, Z = z >> 16;
+  int32_t fx = (x >> 8) & 0xFF, fy = (y >> 8) & 0xFF, fz = (z >> 8) & 0xFF;
+  int32_t u = fade(fx), v = fade(fy), w = fade(fz);
+
+  uint8_t a = P(X) + Y, aa = P(a) + Z, ab = P(a + 1) + Z;
+  uint8_t b = P(X + 1) + Y, ba = P(b) + Z, bb = P(b + 1) + Z;
+
+  int32_t x0 = lerp(grad3(P(aa), fx, fy, fz), grad3(P(ba), fx - 256, fy, fz),
+                    u);
+  int32_t x1 = lerp(grad3(P(ab), fx, fy - 256, fz),
+                    grad3(P(bb), fx - 256, fy - 256, fz), u);
+  int32_t x2 = lerp(grad3(P(aa + 1), fx, fy, fz - 256),
+                    grad3(P(ba + 1), fx - 256, fy, fz - 256), u);
+  int32_t x3 = lerp(grad3(P(ab + 1), fx, fy - 256, fz - 256),
+                    grad3(P(bb + 1), fx - 256, fy - 256, fz - 256), u);
+
+  return to_s8(lerp(lerp(x0, x1, v), lerp(x2, x3, v), w));
+}
+
+uint8_t led_fbm3(uint32_t x, uint32_t y, uint32_t z, int octaves) {
+  int32_t sum = 0;
+  int shift = 0;
+  for (int i = 0; i < octaves; i++, shift++) {
+    sum += led_noise3(x << i, y << i, z + (i << 20)) >> shift;
+  }
+  sum += 128;
+  return sum < 0 ? 0 : sum > 255 ? 255 : sum;
+}
@@ -0,0 +1,19 @@
+#ifndef LED_NOISE_H
+#define LED_NOISE_H
+
+#include <stdint.h>
+
+// Integer gradient (Perlin) noise. Coordinates are 16.16 fixed point: the
+// high 16 bits pick the lattice cell, the low 16 the position inside it,
+// so one unit of 0x10000 is one noise feature. Results are signed,
+// roughly -128..127, and smooth between neighbouring coordinates.
+// Only table lookups, shifts and integer multiplies, no floats.
+
+int8_t led_noise2(uint32_t x, uint32_t y);
+int8_t led_noise3(uint32_t x, uint32_t y, uint32_t z);
+
+// Sum of octaves of led_noise3, each at double frequency and half
+// amplitude, shifted to 0..255
+uint8_t led_fbm3(uint32_t x, uint32_t y, uint32_t z, int octaves);
+
+#endif
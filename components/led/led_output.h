@@ -0,0 +1,38 @@
+#ifndef LED_OUTPUT_H
+#define LED_OUTPUT_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Where the packed wire bytes of a frame go. One backend is compiled in,
+// picked in menuconfig (LED strip -> Output backend). ws2812_show() packs
+// the pixels and hands them over; the frame goes out while the next one
+// renders, wait() is called before the wire buffer is touched again.
+typedef struct {
+  const char *name;
+  // Set up the hardware (pin, chip timing and length come from Kconfig)
+  esp_err_t (*init)(void);
+  // Start sending len bytes. wire stays untouched until wait() returns.
+  esp_err_t (*submit)(const uint8_t *wire, size_t len);
+  // Block until the last submitted frame is out, latch included
+  esp_err_t (*wait)(void);
+} led_output_t;
+
+typedef struct {
+  const char *name;
+  uint32_t frames;
+  uint32_t errors;
+  uint32_t bytes;         // wire bytes per frame
+  uint32_t submit_us_avg; // handing a frame over, encoding included
+  uint32_t wait_us_avg;   // blocked on the previous frame
+} led_output_stats_t;
+
+extern const led_output_t led_output_rmt;
+extern const led_output_t led_output_spi;
+extern const led_output_t led_output_file;
+
+// Stats of the compiled-in backend, kept by ws2812_show()
+void led_output_get_stats(led_output_stats_t *out);
+
+#endif
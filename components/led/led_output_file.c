@@ -0,0 +1,66 @@
+#include "led_output.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LED_OUTPUT_FILE
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+
+// Writes every frame as a record to a file or named pipe instead of a pin,
+// so the render pipeline can run without a strip and the frames can be
+// checked or timed afterwards. On the chip the path has to be on a mounted
+// VFS filesystem.
+//
+// Record: "LEDF", uint32 length, int64 timestamp in us, then the wire bytes
+// exactly as the strip would get them. All fields little endian.
+#define FILE_MAGIC 0x4644454cu // "LEDF"
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t len;
+  int64_t t_us;
+} frame_header_t;
+
+static const char *TAG = "led_file";
+static FILE *s_file = NULL;
+
+static esp_err_t file_out_init(void) {
+  if (!CONFIG_LED_OUTPUT_FILE_PATH[0]) {
+    ESP_LOGE(TAG, "No frame file set (CONFIG_LED_OUTPUT_FILE_PATH)");
+    return ESP_ERR_INVALID_STATE;
+  }
+  s_file = fopen(CONFIG_LED_OUTPUT_FILE_PATH, "wb");
+  if (!s_file) {
+    ESP_LOGE(TAG, "Cannot open %s", CONFIG_LED_OUTPUT_FILE_PATH);
+    return ESP_FAIL;
+  }
+  ESP_LOGI(TAG, "Writing frames to %s", CONFIG_LED_OUTPUT_FILE_PATH);
+  return ESP_OK;
+}
+
+static esp_err_t file_out_submit(const uint8_t *wire, size_t len) {
+  if (!s_file) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  frame_header_t hdr = {
+      .magic = FILE_MAGIC, .len = len, .t_us = esp_timer_get_time()};
+  if (fwrite(&hdr, sizeof(hdr), 1, s_file) != 1 ||
+      fwrite(wire, 1, len, s_file) != len) {
+    return ESP_FAIL;
+  }
+  // a reader on the other end of a pipe sees whole frames
+  return fflush(s_file) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+// written synchronously in submit
+static esp_err_t file_out_wait(void) { return ESP_OK; }
+
+const led_output_t led_output_file = {
+    .name = "file",
+    .init = file_out_init,
+    .submit = file_out_submit,
+    .wait = file_out_wait,
+};
+
+#endif // CONFIG_LED_OUTPUT_FILE
@@ -0,0 +1,173 @@
+#include "led_output.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LED_OUTPUT_RMT
+
+#include "driver/rmt_tx.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "led_chip.h"
+#include "trace.h"
+
+// containerof error fix
+#ifndef __containerof
+#define __containerof(ptr, type, member)                                       \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
+static const char *TAG = "led_rmt";
+static rmt_channel_handle_t s_channel = NULL;
+static rmt_encoder_handle_t s_encoder = NULL;
+
+typedef struct {
+  rmt_encoder_t base;
+  rmt_encoder_t *bytes_encoder;
+  rmt_encoder_t *copy_encoder;
+  rmt_symbol_word_t reset_code;
+  int state;
+} ws2812_encoder_t;
+
+static ws2812_encoder_t s_ws_enc;
+
+static size_t ws2812_encode(rmt_encoder_t *encoder,
+                            rmt_channel_handle_t channel, const void *data,
+                            size_t size, rmt_encode_state_t *state) {
+  ws2812_encoder_t *ws_enc = __containerof(encoder, ws2812_encoder_t, base);
+  rmt_encode_state_t session_state = RMT_ENCODING_RESET;
+  size_t encoded_symbols = 0;
+#if CONFIG_TRACE_RMT_ENCODER
+  trace_span_t span = trace_begin("rmt_encode");
+#endif
+
+  switch (ws_enc->state) {
+  case 0: // send RGB data
+    encoded_symbols += ws_enc->bytes_encoder->encode(
+        ws_enc->bytes_encoder, channel, data, size, &session_state);
+    if (session_state & RMT_ENCODING_COMPLETE) {
+      ws_enc->state = 1;
+    }
+    if (session_state & RMT_ENCODING_MEM_FULL) {
+      *state |= RMT_ENCODING_MEM_FULL;
+      break;
+    }
+    // fall through
+  case 1: // send reset code
+    encoded_symbols += ws_enc->copy_encoder->encode(
+        ws_enc->copy_encoder, channel, &ws_enc->reset_code,
+        sizeof(ws_enc->reset_code), &session_state);
+    if (session_state & RMT_ENCODING_COMPLETE) {
+      ws_enc->state = 0;
+      *state |= RMT_ENCODING_COMPLETE;
+    }
+    if (session_state & RMT_ENCODING_MEM_FULL) {
+      *state |= RMT_ENCODING_MEM_FULL;
+    }
+    break;
+  }
+#if CONFIG_TRACE_RMT_ENCODER
+  trace_end(&span);
+#endif
+  return encoded_symbols;
+}
+
+static esp_err_t ws2812_encoder_reset(rmt_encoder_t *encoder) {
+  ws2812_encoder_t *ws_enc = __containerof(encoder, ws2812_encoder_t, base);
+  rmt_encoder_reset(ws_enc->bytes_encoder);
+  rmt_encoder_reset(ws_enc->copy_encoder);
+  ws_enc->state = 0;
+  return ESP_OK;
+}
+
+static esp_err_t ws2812_encoder_del(rmt_encoder_t *encoder) {
+  ws2812_encoder_t *ws_enc = __containerof(encoder, ws2812_encoder_t, base);
+  rmt_del_encoder(ws_enc->bytes_encoder);
+  rmt_del_encoder(ws_enc->copy_encoder);
+  return ESP_OK;
+}
+
+static esp_err_t rmt_out_init(void) {
+  // RMT TX channel config
+  rmt_tx_channel_config_t tx_cfg = {
+      .gpio_num = CONFIG_LED_STRIP_GPIO,
+      .clk_src = RMT_CLK_SRC_DEFAULT,
+      .resolution_hz = LED_RMT_RESOLUTION_HZ,
+      .mem_block_symbols = 64,
+      .trans_queue_depth = 4,
+  };
+
+  ESP_LOGI(TAG, "Creating RMT TX channel...");
+  esp_err_t err = rmt_new_tx_channel(&tx_cfg, &s_channel);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "❌ RMT channel creation FAILED: %s (0x%x)",
+             esp_err_to_name(err), err);
+    return err;
+  }
+  ESP_LOGI(TAG, "✅ RMT TX channel created");
+
+  ws2812_encoder_t *ws_enc = &s_ws_enc;
+  ws_enc->base.encode = ws2812_encode;
+  ws_enc->base.reset = ws2812_encoder_reset;
+  ws_enc->base.del = ws2812_encoder_del;
+
+  // Bytes encoder for the pixel data, symbols fixed by the chip
+  rmt_bytes_encoder_config_t bytes_cfg = {
+      .bit0 = LED_CHIP_BIT0,
+      .bit1 = LED_CHIP_BIT1,
+      .flags.msb_first = 1,
+  };
+
+  ESP_LOGI(TAG, "Creating bytes encoder...");
+  err = rmt_new_bytes_encoder(&bytes_cfg, &ws_enc->bytes_encoder);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "❌ Bytes encoder creation FAILED: %s", esp_err_to_name(err));
+    return err;
+  }
+  ESP_LOGI(TAG, "✅ Bytes encoder created");
+
+  // Copy encoder for reset code
+  rmt_copy_encoder_config_t copy_cfg = {};
+  err = rmt_new_copy_encoder(&copy_cfg, &ws_enc->copy_encoder);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "❌ Copy encoder creation FAILED: %s", esp_err_to_name(err));
+    return err;
+  }
+  ESP_LOGI(TAG, "✅ Copy encoder created");
+
+  // Reset code: low for LED_CHIP_RESET_US
+  ws_enc->reset_code = (rmt_symbol_word_t){
+      .duration0 = LED_CHIP_RESET_TICKS,
+      .level0 = 0,
+      .duration1 = 0,
+      .level1 = 0};
+
+  s_encoder = &ws_enc->base;
+
+  err = rmt_enable(s_channel);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "❌ RMT enable FAILED: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+static esp_err_t rmt_out_submit(const uint8_t *wire, size_t len) {
+  if (!s_channel || !s_encoder) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  rmt_transmit_config_t tx_config = {.loop_count = 0};
+  return rmt_transmit(s_channel, s_encoder, wire, len, &tx_config);
+}
+
+static esp_err_t rmt_out_wait(void) {
+  if (!s_channel) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return rmt_tx_wait_all_done(s_channel, portMAX_DELAY);
+}
+
+const led_output_t led_output_rmt = {
+    .name = "rmt",
+    .init = rmt_out_init,
+    .submit = rmt_out_submit,
+    .wait = rmt_out_wait,
+};
+
+#endif // CONFIG_LED_OUTPUT_RMT
@@ -0,0 +1,118 @@
+#include "led_output.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LED_OUTPUT_SPI
+
+#include "driver/spi_master.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "led_chip.h"
+#include <stdbool.h>
+#include <string.h>
+
+// Every wire bit becomes three SPI bits: 0 -> 100, 1 -> 110. The SPI clock
+// is three times the chip's bit rate, so T0H is a third and T1H two thirds
+// of a bit. The whole frame goes out in one DMA transaction, the CPU only
+// expands the bytes.
+#define SPI_HOST_ID SPI2_HOST
+#define SPI_CLOCK_HZ                                                           \
+  ((int)(3000000000ULL / (LED_CHIP_T0H_NS + LED_CHIP_T0L_NS)))
+// low time after the data latches the frame, rounded up to whole bytes
+#define SPI_RESET_BYTES                                                        \
+  ((int)((uint64_t)LED_CHIP_RESET_US * SPI_CLOCK_HZ / 8000000) + 1)
+#define SPI_DATA_BYTES (CONFIG_LED_STRIP_COUNT * LED_CHIP_BYTES * 3)
+// one leading zero byte so the line starts low
+#define SPI_BUF_BYTES (1 + SPI_DATA_BYTES + SPI_RESET_BYTES)
+
+static const char *TAG = "led_spi";
+
+static spi_device_handle_t s_dev = NULL;
+static spi_transaction_t s_trans;
+static bool s_busy = false;
+// wire byte -> 24 SPI bits
+static uint32_t s_expand[256];
+DMA_ATTR static uint8_t s_buf[SPI_BUF_BYTES];
+
+static esp_err_t spi_out_init(void) {
+  for (int b = 0; b < 256; b++) {
+    uint32_t code = 0;
+    for (int i = 7; i >= 0; i--) {
+      code = code << 3 | ((b >> i) & 1 ? 0x6 : 0x4);
+    }
+    s_expand[b] = code;
+  }
+
+  spi_bus_config_t bus_cfg = {
+      .mosi_io_num = CONFIG_LED_STRIP_GPIO,
+      .miso_io_num = -1,
+      .sclk_io_num = -1,
+      .quadwp_io_num = -1,
+      .quadhd_io_num = -1,
+      .max_transfer_sz = SPI_BUF_BYTES,
+  };
+  esp_err_t err = spi_bus_initialize(SPI_HOST_ID, &bus_cfg, SPI_DMA_CH_AUTO);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "SPI bus init failed: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  spi_device_interface_config_t dev_cfg = {
+      .clock_speed_hz = SPI_CLOCK_HZ,
+      .mode = 0,
+      .spics_io_num = -1,
+      .queue_size = 1,
+  };
+  err = spi_bus_add_device(SPI_HOST_ID, &dev_cfg, &s_dev);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "SPI device add failed: %s", esp_err_to_name(err));
+    spi_bus_free(SPI_HOST_ID);
+    return err;
+  }
+
+  ESP_LOGI(TAG, "SPI output on GPIO %d, %d Hz, %d byte DMA frame",
+           CONFIG_LED_STRIP_GPIO, SPI_CLOCK_HZ, SPI_BUF_BYTES);
+  return ESP_OK;
+}
+
+static esp_err_t spi_out_submit(const uint8_t *wire, size_t len) {
+  if (!s_dev || len > SPI_DATA_BYTES / 3) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // s_buf[0] stays zero
+  uint8_t *out = s_buf + 1;
+  for (size_t i = 0; i < len; i++) {
+    uint32_t code = s_expand[wire[i]];
+    *out++ = code >> 16;
+    *out++ = code >> 8;
+    *out++ = code;
+  }
+  memset(out, 0, SPI_RESET_BYTES);
+
+  s_trans = (spi_transaction_t){
+      .length = (1 + len * 3 + SPI_RESET_BYTES) * 8,
+      .tx_buffer = s_buf,
+  };
+  esp_err_t err = spi_device_queue_trans(s_dev, &s_trans, portMAX_DELAY);
+  s_busy = err == ESP_OK;
+  return err;
+}
+
+static esp_err_t spi_out_wait(void) {
+  if (!s_busy) {
+    return ESP_OK;
+  }
+  spi_transaction_t *done;
+  s_busy = false;
+  return spi_device_get_trans_result(s_dev, &done, portMAX_DELAY);
+}
+
+const led_output_t led_output_spi = {
+    .name = "spi",
+    .init = spi_out_init,
+    .submit = spi_out_submit,
+    .wait = spi_out_wait,
+};
+
+#endif // CONFIG_LED_OUTPUT_SPI
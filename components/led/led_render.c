@@ -0,0 +1,877 @@
+#include "led_render.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "led_api.h"
+#include "led_clock.h"
+#include "led_layout.h"
+#include "led_transition.h"
+#include "trace.h"
+#include <string.h>
+
+#define RENDER_STACK_SIZE 4096
+// above httpd (5), below the WiFi/lwIP tasks on core 0
+#define RENDER_PRIORITY 10
+#define FRAME_PERIOD_US (1000000 / CONFIG_LED_FRAME_RATE)
+
+static const char *TAG = "led_render";
+
+// What a layer is playing
+typedef struct {
+  const led_effect_t *effect; // NULL = stopped
+  led_effect_params_t params;
+  uint32_t duration_ms;
+  int64_t start_us;
+  // transition from what is on the strip when the job starts (base layer)
+  led_transition_type_t transition;
+  uint16_t transition_ms;
+  bool blank; // no effect: black instead of holding the last frame
+} render_job_t;
+
+// One compositor layer, owned by the render task. Layer 0 is the base,
+// the others are drawn over it in order.
+typedef struct {
+  render_job_t job;
+  rgb_t *px;
+  uint8_t opacity;
+  led_blend_mode_t mode;
+  bool dirty; // new job, has to be rendered at least once
+  bool held;  // duration reached, the last frame stays
+} layer_t;
+
+static TaskHandle_t s_task = NULL;
+static const int s_num_leds = CONFIG_LED_STRIP_COUNT;
+static layer_t s_layers[CONFIG_LED_LAYERS];
+static rgb_t s_layer_px[CONFIG_LED_LAYERS][CONFIG_LED_STRIP_COUNT];
+// base layer frame, the transition runs on it
+static rgb_t *s_frame = s_layer_px[LED_LAYER_BASE];
+// composited output when more than the base layer is showing
+static rgb_t s_out[CONFIG_LED_STRIP_COUNT];
+#if CONFIG_LED_HIGH_DEPTH
+// Base layer at 16 bits, the transition and the brightness work on it.
+// Effects without render16 draw into s_frame and are widened into it.
+static rgb16_t s_frame16[CONFIG_LED_STRIP_COUNT];
+// composited output widened to 16 bits with the brightness applied
+static rgb16_t s_out16[CONFIG_LED_STRIP_COUNT];
+#endif
+
+// Commands from other tasks, picked up at the start of each frame
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static render_job_t s_pending[CONFIG_LED_LAYERS];
+static uint32_t s_pending_mask = 0;
+static uint8_t s_opacity[CONFIG_LED_LAYERS];
+static led_blend_mode_t s_mode[CONFIG_LED_LAYERS];
+static bool s_settings_changed = false;
+static uint8_t s_brightness = 255;
+// Last base-layer command, reported to the change hook
+static led_effect_id_t s_base_id = LED_EFFECT_SOLID;
+static led_effect_params_t s_base_params;
+static uint32_t s_base_duration_ms = 0;
+static led_render_change_fn s_change_hook = NULL;
+static led_transition_type_t s_transition = LED_TRANSITION_EASE;
+static uint16_t s_transition_ms = CONFIG_LED_TRANSITION_MS;
+static volatile bool s_cancel_transition = false;
+
+// Called at the start of every frame while set, see led_render_frame_set()
+static volatile led_render_frame_fn s_frame_hook = NULL;
+
+// Owned by the render task
+// Frame boundaries passed, bumped between frames (see led_swap.h)
+static volatile uint32_t s_gen = 0;
+static volatile bool s_active = false;
+static int64_t s_frame_us = 0; // time of the frame being rendered
+static bool s_recompose = false;
+static uint8_t s_level = 255; // brightness in use
+
+// Outgoing frame of a running transition, packed 0x00RRGGBB in 8 bits
+#if CONFIG_LED_HIGH_DEPTH
+static rgb16_t s_from[CONFIG_LED_STRIP_COUNT];
+#else
+static uint32_t s_from[CONFIG_LED_STRIP_COUNT];
+#endif
+static bool s_in_transition = false;
+
+// Stats for the current one-second window, published into s_stats
+typedef struct {
+  int64_t start_us;
+  uint32_t frames;
+  uint64_t render_us;
+  uint64_t show_us;
+  uint32_t render_us_max;
+} render_window_t;
+static render_window_t s_window;
+static led_render_stats_t s_stats;
+
+// External (network) clock, NULL = free-running on esp_timer. Set from
+// other tasks, the render task switches to it between frames.
+static const led_clock_t *volatile s_next_clock = NULL;
+static const led_clock_t *s_clock = NULL;
+static uint32_t s_start_quantum_ms = 0;
+// Free-running: when the last frame was due on led_clock_system, 0 after
+// idling
+static int64_t s_local_due_us = 0;
+// Clock jumps followed so far (led_render_clock_shift)
+static uint32_t s_steps_seen = 0;
+static int64_t s_steps_total = 0;
+static int64_t s_shift_us = 0;
+
+#if CONFIG_LED_SPLIT_FRAME
+// Helper on the other core rendering the first half of split frames
+static TaskHandle_t s_worker = NULL;
+static SemaphoreHandle_t s_worker_go = NULL;
+static SemaphoreHandle_t s_worker_done = NULL;
+static const render_job_t *s_worker_job;
+static led_frame_t s_worker_frame;
+static rgb16_t *s_worker_px16;
+static uint32_t s_worker_t_ms;
+#endif
+
+// Draw the part f of a frame, into px16 with the effect's 16-bit renderer
+// if that is given
+static void draw(const render_job_t *job, uint32_t t_ms, led_frame_t *f,
+                 rgb16_t *px16) {
+  if (px16) {
+    led_frame16_t f16 = {
+        .px = px16, .start = f->start, .end = f->end, .num_leds = f->num_leds};
+    job->effect->render16(&job->params, t_ms, &f16);
+  } else {
+    job->effect->render(&job->params, t_ms, f);
+  }
+}
+
+#if CONFIG_LED_SPLIT_FRAME
+static void worker_task(void *arg) {
+  for (;;) {
+    xSemaphoreTake(s_worker_go, portMAX_DELAY);
+    trace_span_t span = trace_begin("render_split");
+    draw(s_worker_job, s_worker_t_ms, &s_worker_frame, s_worker_px16);
+    trace_end(&span);
+    xSemaphoreGive(s_worker_done);
+  }
+}
+#endif
+
+static bool should_split(const led_effect_t *fx) {
+#if CONFIG_LED_SPLIT_FRAME
+  return s_worker && fx->parallel && s_num_leds >= CONFIG_LED_SPLIT_MIN_LEDS;
+#else
+  return false;
+#endif
+}
+
+static void render_frame(const render_job_t *job, rgb_t *px, rgb16_t *px16,
+                         uint32_t t_ms) {
+  const led_effect_t *fx = job->effect;
+  led_frame_t frame = {
+      .px = px, .start = 0, .end = s_num_leds, .num_leds = s_num_leds};
+
+  trace_span_t span = trace_begin(fx->name);
+#if CONFIG_LED_SPLIT_FRAME
+  if (should_split(fx)) {
+    int half = s_num_leds / 2;
+    s_worker_job = job;
+    s_worker_frame = frame;
+    s_worker_frame.end = half;
+    s_worker_px16 = px16;
+    s_worker_t_ms = t_ms;
+    xSemaphoreGive(s_worker_go);
+
+    frame.start = half;
+    draw(job, t_ms, &frame, px16);
+
+    // barrier: both halves must be done before the frame is transmitted
+    xSemaphoreTake(s_worker_done, portMAX_DELAY);
+    trace_end(&span);
+    return;
+  }
+#endif
+  draw(job, t_ms, &frame, px16);
+  trace_end(&span);
+}
+
+#if CONFIG_LED_HIGH_DEPTH
+// Base layer into s_frame16, at 16 bits if the effect can
+static void render_base16(const render_job_t *job, uint32_t t_ms) {
+  if (job->effect->render16) {
+    render_frame(job, NULL, s_frame16, t_ms);
+    return;
+  }
+  render_frame(job, s_frame, NULL, t_ms);
+  for (int i = 0; i < s_num_leds; i++) {
+    rgb_t p = s_frame[i];
+    s_frame16[i] = (rgb16_t){p.r * 257, p.g * 257, p.b * 257};
+  }
+}
+#endif
+
+static int64_t clock_now(void) {
+  return (s_clock ? s_clock : &led_clock_system)->now_us();
+}
+
+// Effect start time on the pipeline clock. With an external clock effects
+// start on the next quantum boundary, so hubs that get the same command
+// within one quantum start in lockstep.
+static int64_t job_start_time(void) {
+  int64_t now = clock_now();
+  if (s_clock && s_start_quantum_ms) {
+    int64_t q = (int64_t)s_start_quantum_ms * 1000;
+    return (now / q + 1) * q;
+  }
+  return now;
+}
+
+// Sleep until CONFIG_LED_FRAME_LEAD_US before the next frame boundary on the
+// external clock and return that boundary
+static int64_t wait_frame_slot(void) {
+  const int64_t period = FRAME_PERIOD_US;
+  int64_t now = s_clock->now_us();
+  int64_t frame = (now / period + 1) * period;
+  if (frame - now < CONFIG_LED_FRAME_LEAD_US / 2) {
+    // too late to render this one in time
+    frame += period;
+  }
+  if (frame - CONFIG_LED_FRAME_LEAD_US > now) {
+    s_clock->sleep_until_us(frame - CONFIG_LED_FRAME_LEAD_US);
+  }
+  return frame;
+}
+
+// Free-running: after the frame that started at frame_us, sleep until the
+// next one is due on the local clock. Frames stay on a grid one period
+// apart; after idling, or a frame that ran a whole period over, the grid
+// starts again from this frame instead of catching up in a burst.
+static void pace_local(int64_t frame_us) {
+  int64_t due = s_local_due_us + FRAME_PERIOD_US;
+  if (due <= frame_us - FRAME_PERIOD_US) {
+    due = frame_us + FRAME_PERIOD_US;
+  }
+  s_local_due_us = due;
+  led_clock_system.sleep_until_us(due);
+}
+
+// Move every running job by a jump of the pipeline clock, so effects,
+// transitions and durations carry on where they were instead of freezing
+// (clock went back) or skipping ahead
+static void shift_jobs(int64_t delta_us) {
+  if (delta_us == 0) {
+    return;
+  }
+  for (int i = 0; i < CONFIG_LED_LAYERS; i++) {
+    s_layers[i].job.start_us += delta_us;
+  }
+  s_shift_us += delta_us;
+}
+
+// Switch to a newly set clock and follow jumps of the current one
+static void follow_clock(void) {
+  const led_clock_t *next = s_next_clock;
+  if (next != s_clock) {
+    // job times were taken on the old clock
+    int64_t delta = (next ? next : &led_clock_system)->now_us() - clock_now();
+    s_clock = next;
+    s_steps_seen = next && next->steps ? next->steps(&s_steps_total) : 0;
+    shift_jobs(delta);
+    return;
+  }
+  if (!s_clock || !s_clock->steps) {
+    return;
+  }
+  int64_t total;
+  uint32_t steps = s_clock->steps(&total);
+  if (steps != s_steps_seen) {
+    s_steps_seen = steps;
+    shift_jobs(total - s_steps_total);
+    s_steps_total = total;
+  }
+}
+
+// Snapshot what is on the strip as the outgoing frame of a transition. A
+// transition that is still running is cut off where it is: s_frame holds
+// its blended output, so the new one continues from there.
+static void start_transition(const render_job_t *job) {
+  s_in_transition = false;
+  if (job->transition == LED_TRANSITION_NONE || job->transition_ms == 0 ||
+      s_stats.frames == 0) {
+    return;
+  }
+#if CONFIG_LED_HIGH_DEPTH
+  memcpy(s_from, s_frame16, sizeof(s_from));
+#else
+  led_pack_frame(s_frame, s_from, s_num_leds);
+#endif
+  s_in_transition = true;
+}
+
+// A cleared base layer would otherwise keep its last frame under the
+// overlays; overlays are simply left out of the composite
+static void blank_layer(int i) {
+  if (i == LED_LAYER_BASE) {
+    memset(s_frame, 0, s_num_leds * sizeof(rgb_t));
+#if CONFIG_LED_HIGH_DEPTH
+    memset(s_frame16, 0, sizeof(s_frame16));
+#endif
+    s_in_transition = false;
+  }
+}
+
+static void take_pending(void) {
+  int64_t start_us = job_start_time();
+  portENTER_CRITICAL(&s_lock);
+  uint32_t mask = s_pending_mask;
+  s_pending_mask = 0;
+  for (int i = 0; i < CONFIG_LED_LAYERS; i++) {
+    layer_t *l = &s_layers[i];
+    if (mask & (1u << i)) {
+      l->job = s_pending[i];
+      l->job.start_us = start_us;
+      l->dirty = l->job.effect != NULL;
+      l->held = false;
+      if (l->job.blank) {
+        blank_layer(i);
+      }
+    }
+    if (s_settings_changed) {
+      l->opacity = s_opacity[i];
+      l->mode = s_mode[i];
+    }
+  }
+  s_level = s_brightness;
+  if (mask || s_settings_changed) {
+    s_recompose = true;
+  }
+  s_settings_changed = false;
+  const render_job_t *base = &s_layers[LED_LAYER_BASE].job;
+  s_stats.split = base->effect && should_split(base->effect);
+  portEXIT_CRITICAL(&s_lock);
+
+  if ((mask & (1u << LED_LAYER_BASE)) && base->effect) {
+    start_transition(base);
+  }
+  if (s_cancel_transition) {
+    s_cancel_transition = false;
+    s_in_transition = false;
+  }
+}
+
+// Blend the outgoing frame over the freshly rendered one
+static void apply_transition(const render_job_t *job, int64_t elapsed_us) {
+  int64_t total_us = (int64_t)job->transition_ms * 1000;
+  if (elapsed_us >= total_us) {
+    s_in_transition = false;
+    return;
+  }
+
+  uint32_t progress = elapsed_us > 0
+                          ? (uint32_t)(elapsed_us * LED_TRANSITION_FULL /
+                                       total_us)
+                          : 0;
+  trace_span_t span = trace_begin("transition");
+#if CONFIG_LED_HIGH_DEPTH
+  led_transition_blend16(job->transition, s_from, s_frame16, s_num_leds,
+                         progress);
+#else
+  led_transition_blend(job->transition, s_from, s_frame, s_num_leds,
+                       progress);
+#endif
+  trace_end(&span);
+}
+
+// A layer has to be rendered again this frame
+static bool layer_needs_render(int i) {
+  const layer_t *l = &s_layers[i];
+  if (!l->job.effect) {
+    return false;
+  }
+  return l->dirty || (i == LED_LAYER_BASE && s_in_transition) ||
+         (!l->held && !l->job.effect->still);
+}
+
+// Anything to do at all; otherwise the task sleeps and the strip keeps
+// showing the last frame
+static bool needs_frame(void) {
+  if (s_recompose || s_frame_hook || ws2812_needs_refresh()) {
+    return true;
+  }
+  for (int i = 0; i < CONFIG_LED_LAYERS; i++) {
+    const layer_t *l = &s_layers[i];
+    // a still layer with a duration still has to be timed out
+    if (layer_needs_render(i) ||
+        (l->job.effect && l->job.duration_ms && !l->held)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Render the layers that changed, returns false if none did
+static bool render_layers(int64_t frame_us) {
+  bool changed = false;
+  for (int i = 0; i < CONFIG_LED_LAYERS; i++) {
+    layer_t *l = &s_layers[i];
+    if (!l->job.effect) {
+      continue;
+    }
+
+    int64_t elapsed_us = frame_us - l->job.start_us;
+    uint32_t t_ms = elapsed_us > 0 ? (uint32_t)(elapsed_us / 1000) : 0;
+    bool done = l->job.duration_ms && t_ms >= l->job.duration_ms;
+    if (done) {
+      t_ms = l->job.duration_ms;
+      if (i != LED_LAYER_BASE) {
+        // overlays disappear when their time is up
+        l->job.effect = NULL;
+        changed = true;
+        continue;
+      }
+    }
+
+    if (layer_needs_render(i)) {
+#if CONFIG_LED_HIGH_DEPTH
+      if (i == LED_LAYER_BASE) {
+        render_base16(&l->job, t_ms);
+      } else
+#endif
+        render_frame(&l->job, l->px, NULL, t_ms);
+      if (i == LED_LAYER_BASE && s_in_transition) {
+        apply_transition(&l->job, elapsed_us);
+      }
+      l->dirty = false;
+      changed = true;
+    }
+    if (done && !s_in_transition) {
+      l->held = true;
+    }
+  }
+  return changed;
+}
+
+// Composite the overlays over the base layer and apply the brightness. In
+// high depth NULL means the base layer alone, which stays in s_frame16;
+// overlays are 8-bit, so with any showing the frame is composited in 8 bits.
+static const rgb_t *compose(int *layers_out) {
+  bool copied = false;
+  int layers = 1;
+  for (int i = LED_LAYER_BASE + 1; i < CONFIG_LED_LAYERS; i++) {
+    const layer_t *l = &s_layers[i];
+    if (!l->job.effect || l->opacity == 0) {
+      continue;
+    }
+    if (!copied) {
+#if CONFIG_LED_HIGH_DEPTH
+      for (int k = 0; k < s_num_leds; k++) {
+        rgb16_t p = s_frame16[k];
+        s_out[k] = (rgb_t){p.r >> 8, p.g >> 8, p.b >> 8};
+      }
+#else
+      memcpy(s_out, s_frame, s_num_leds * sizeof(rgb_t));
+#endif
+      copied = true;
+    }
+    led_blend_layer(l->mode, s_out, l->px, s_num_leds, l->opacity);
+    layers++;
+  }
+  *layers_out = layers;
+#if CONFIG_LED_HIGH_DEPTH
+  return copied ? s_out : NULL;
+#else
+  if (s_level < 255) {
+    led_scale_frame(s_out, copied ? s_out : s_frame, s_num_leds, s_level);
+    return s_out;
+  }
+  return copied ? s_out : s_frame;
+#endif
+}
+
+// Hand the composited frame to the output. In high depth the brightness is
+// applied here while widening to 16 bits, so a dimmed frame keeps the
+// steps that scaling in 8 bits would round away.
+static void set_frame(const rgb_t *px) {
+#if CONFIG_LED_HIGH_DEPTH
+  if (!px) {
+    // 255 -> 1 << 16, so full brightness leaves the levels as they are
+    uint32_t m = ((uint32_t)s_level << 16) / 255;
+    for (int i = 0; i < s_num_leds; i++) {
+      rgb16_t p = s_frame16[i];
+      s_out16[i] = (rgb16_t){p.r * m >> 16, p.g * m >> 16, p.b * m >> 16};
+    }
+    ws2812_set_frame16(s_out16);
+    return;
+  }
+  static uint16_t level16[256];
+  static int level16_for = -1;
+  if (level16_for != s_level) {
+    for (int v = 0; v < 256; v++) {
+      level16[v] = v * 257 * s_level / 255;
+    }
+    level16_for = s_level;
+  }
+  for (int i = 0; i < s_num_leds; i++) {
+    s_out16[i] =
+        (rgb16_t){level16[px[i].r], level16[px[i].g], level16[px[i].b]};
+  }
+  ws2812_set_frame16(s_out16);
+#else
+  ws2812_set_frame(px);
+#endif
+}
+
+static void update_stats(int64_t now, uint32_t render_us, uint32_t show_us,
+                         int layers) {
+  s_window.frames++;
+  s_window.render_us += render_us;
+  s_window.show_us += show_us;
+  if (render_us > s_window.render_us_max) {
+    s_window.render_us_max = render_us;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  s_stats.layers = layers;
+  if (s_stats.frames++ == 0) {
+    s_stats.first_frame_us = now;
+  }
+  if (now - s_window.start_us >= 1000000) {
+    s_stats.fps = s_window.frames;
+    s_stats.render_us_avg = s_window.render_us / s_window.frames;
+    s_stats.render_us_max = s_window.render_us_max;
+    s_stats.show_us_avg = s_window.show_us / s_window.frames;
+    s_window = (render_window_t){.start_us = now};
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+static void render_task(void *arg) {
+  for (;;) {
+    // nothing from the last frame is read any more
+    s_gen++;
+    follow_clock();
+    take_pending();
+    s_active = needs_frame();
+    if (!s_active) {
+      // idle until a layer is played or changed
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      s_local_due_us = 0;
+      s_window = (render_window_t){.start_us = esp_timer_get_time()};
+      continue;
+    }
+
+    // time this frame is for, on the pipeline clock
+    int64_t frame_us =
+        s_clock ? wait_frame_slot() : led_clock_system.now_us();
+    int64_t t0 = esp_timer_get_time();
+
+    trace_span_t span = trace_begin("led_frame");
+    s_frame_us = frame_us;
+    led_render_frame_fn hook = s_frame_hook;
+    if (hook) {
+      hook(frame_us);
+    }
+    bool changed = render_layers(frame_us) || s_recompose;
+    s_recompose = false;
+    if (changed) {
+      int layers;
+      const rgb_t *out = compose(&layers);
+      int64_t t1 = esp_timer_get_time();
+      set_frame(out);
+      if (s_clock) {
+        // transmit exactly on the frame boundary (within the lead); a
+        // clock that jumped back meanwhile does not hold the frame up
+        int64_t wait_us = frame_us - s_clock->now_us();
+        if (wait_us > 0 && wait_us <= CONFIG_LED_FRAME_LEAD_US) {
+          s_clock->sleep_until_us(frame_us);
+        }
+      }
+      int64_t ts = esp_timer_get_time();
+      ws2812_show();
+      int64_t t2 = esp_timer_get_time();
+      update_stats(t2, t1 - t0, t2 - ts, layers);
+    } else if (ws2812_needs_refresh()) {
+      // same frame again while the limiter fades back up or dithering
+      // spreads a level over frames
+      ws2812_show();
+    }
+    trace_end(&span);
+
+    if (!s_clock) {
+      pace_local(frame_us);
+    }
+  }
+}
+
+esp_err_t led_render_start(void) {
+  led_layout_init(s_num_leds);
+
+  // frame buffers are static, sized by CONFIG_LED_STRIP_COUNT
+  for (int i = 0; i < CONFIG_LED_LAYERS; i++) {
+    s_layers[i].px = s_layer_px[i];
+    s_layers[i].opacity = s_opacity[i] = 255;
+    // black is see-through on overlays by default
+    s_layers[i].mode = s_mode[i] =
+        i == LED_LAYER_BASE ? LED_BLEND_NORMAL : LED_BLEND_MAX;
+  }
+
+#if CONFIG_LED_SPLIT_FRAME
+  s_worker_go = xSemaphoreCreateBinary();
+  s_worker_done = xSemaphoreCreateBinary();
+  if (s_worker_go && s_worker_done &&
+      xTaskCreatePinnedToCore(worker_task, "led_split", RENDER_STACK_SIZE,
+                              NULL, RENDER_PRIORITY, &s_worker,
+                              !CONFIG_LED_RENDER_CORE) != pdPASS) {
+    s_worker = NULL;
+  }
+  if (!s_worker) {
+    ESP_LOGW(TAG, "Split-frame helper not started, rendering on one core");
+  }
+#endif
+
+  if (xTaskCreatePinnedToCore(render_task, "led_render", RENDER_STACK_SIZE,
+                              NULL, RENDER_PRIORITY, &s_task,
+                              CONFIG_LED_RENDER_CORE) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start render task!");
+    return ESP_FAIL;
+  }
+  ESP_LOGI(TAG, "Render task on core %d, %d FPS, %d LEDs, %d layers",
+           CONFIG_LED_RENDER_CORE, CONFIG_LED_FRAME_RATE, s_num_leds,
+           CONFIG_LED_LAYERS);
+  return ESP_OK;
+}
+
+static void wake(void) {
+  if (s_task) {
+    xTaskNotifyGive(s_task);
+  }
+}
+
+static void post(int layer, const render_job_t *job) {
+  portENTER_CRITICAL(&s_lock);
+  s_pending[layer] = *job;
+  s_pending_mask |= 1u << layer;
+  portEXIT_CRITICAL(&s_lock);
+  wake();
+}
+
+// Tell the hook what the base layer plays now, outside the lock
+static void notify_change(void) {
+  led_render_change_fn hook = s_change_hook;
+  if (!hook) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  led_effect_id_t id = s_base_id;
+  led_effect_params_t params = s_base_params;
+  uint32_t duration_ms = s_base_duration_ms;
+  uint8_t brightness = s_brightness;
+  portEXIT_CRITICAL(&s_lock);
+  hook(id, &params, duration_ms, brightness);
+}
+
+static bool valid_layer(int layer) {
+  if (layer < 0 || layer >= CONFIG_LED_LAYERS) {
+    ESP_LOGE(TAG, "No layer %d", layer);
+    return false;
+  }
+  return true;
+}
+
+// New base-layer job, and the brightness unless level < 0, as one change:
+// picked up in the same frame and reported to the hook once
+static void play_base(const led_effect_t *fx, led_effect_id_t id,
+                      const led_effect_params_t *params,
+                      uint32_t duration_ms, int level) {
+  render_job_t job = {
+      .effect = fx, .params = *params, .duration_ms = duration_ms};
+  portENTER_CRITICAL(&s_lock);
+  job.transition = s_transition;
+  job.transition_ms = s_transition_ms;
+  s_base_id = id;
+  s_base_params = *params;
+  s_base_duration_ms = duration_ms;
+  if (level >= 0) {
+    s_brightness = level;
+    s_settings_changed = true;
+  }
+  s_pending[LED_LAYER_BASE] = job;
+  s_pending_mask |= 1u << LED_LAYER_BASE;
+  portEXIT_CRITICAL(&s_lock);
+  wake();
+  notify_change();
+}
+
+void led_render_layer_play(int layer, led_effect_id_t id,
+                           const led_effect_params_t *params,
+                           uint32_t duration_ms) {
+  const led_effect_t *fx = led_effect_get(id);
+  if (!fx) {
+    ESP_LOGE(TAG, "Unknown effect %d", id);
+    return;
+  }
+  if (!valid_layer(layer)) {
+    return;
+  }
+  if (layer == LED_LAYER_BASE) {
+    play_base(fx, id, params, duration_ms, -1);
+    return;
+  }
+  render_job_t job = {
+      .effect = fx, .params = *params, .duration_ms = duration_ms};
+  post(layer, &job);
+}
+
+void led_render_layer_clear(int layer) {
+  if (!valid_layer(layer)) {
+    return;
+  }
+  render_job_t job = {.blank = true};
+  post(layer, &job);
+}
+
+void led_render_layer_set(int layer, uint8_t opacity, led_blend_mode_t mode) {
+  if (!valid_layer(layer) || mode >= LED_BLEND_COUNT) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  s_opacity[layer] = opacity;
+  s_mode[layer] = mode;
+  s_settings_changed = true;
+  portEXIT_CRITICAL(&s_lock);
+  wake();
+}
+
+void led_render_layer_get(int layer, uint8_t *opacity,
+                          led_blend_mode_t *mode) {
+  if (!valid_layer(layer)) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  *opacity = s_opacity[layer];
+  *mode = s_mode[layer];
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void led_render_play(led_effect_id_t id, const led_effect_params_t *params,
+                     uint32_t duration_ms) {
+  led_render_layer_play(LED_LAYER_BASE, id, params, duration_ms);
+}
+
+void led_render_play_at(led_effect_id_t id, const led_effect_params_t *params,
+                        uint32_t duration_ms, uint8_t brightness) {
+  const led_effect_t *fx = led_effect_get(id);
+  if (!fx) {
+    ESP_LOGE(TAG, "Unknown effect %d", id);
+    return;
+  }
+  play_base(fx, id, params, duration_ms, brightness);
+}
+
+void led_render_stop(void) {
+  render_job_t job = {0};
+  post(LED_LAYER_BASE, &job);
+}
+
+void led_render_set_brightness(uint8_t level) {
+  portENTER_CRITICAL(&s_lock);
+  s_brightness = level;
+  s_settings_changed = true;
+  portEXIT_CRITICAL(&s_lock);
+  wake();
+  notify_change();
+}
+
+uint8_t led_render_get_brightness(void) {
+  portENTER_CRITICAL(&s_lock);
+  uint8_t level = s_brightness;
+  portEXIT_CRITICAL(&s_lock);
+  return level;
+}
+
+void led_render_set_change_hook(led_render_change_fn hook) {
+  s_change_hook = hook;
+}
+
+void led_render_set_transition(led_transition_type_t type,
+                               uint16_t duration_ms) {
+  portENTER_CRITICAL(&s_lock);
+  s_transition = type;
+  s_transition_ms = duration_ms;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void led_render_get_transition(led_transition_type_t *type,
+                               uint16_t *duration_ms) {
+  portENTER_CRITICAL(&s_lock);
+  *type = s_transition;
+  *duration_ms = s_transition_ms;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void led_render_cancel_transition(void) { s_cancel_transition = true; }
+
+void led_render_set_clock(const led_clock_t *clock,
+                          uint32_t start_quantum_ms) {
+  s_start_quantum_ms = start_quantum_ms;
+  s_next_clock = clock;
+  wake();
+}
+
+int64_t led_render_clock_shift(void) { return s_shift_us; }
+
+void led_render_set_frame_hook(led_render_frame_fn hook) {
+  s_frame_hook = hook;
+  wake();
+}
+
+void led_render_frame_set(int layer, led_effect_id_t id,
+                          const led_effect_params_t *params) {
+  const led_effect_t *fx = led_effect_get(id);
+  if (!fx || layer < 0 || layer >= CONFIG_LED_LAYERS) {
+    return;
+  }
+  layer_t *l = &s_layers[layer];
+  if (l->job.effect != fx) {
+    // new effect: its time starts with this frame, no transition
+    l->job = (render_job_t){
+        .effect = fx, .params = *params, .start_us = s_frame_us};
+  } else if (memcmp(&l->job.params, params, sizeof(*params)) == 0) {
+    return;
+  } else {
+    // same effect, new parameters: its time keeps running
+    l->job.params = *params;
+    l->job.duration_ms = 0;
+  }
+  l->dirty = true;
+  l->held = false;
+  s_recompose = true;
+}
+
+void led_render_frame_clear(int layer) {
+  if (layer < 0 || layer >= CONFIG_LED_LAYERS || !s_layers[layer].job.effect) {
+    return;
+  }
+  s_layers[layer].job = (render_job_t){0};
+  blank_layer(layer);
+  s_recompose = true;
+}
+
+uint32_t led_render_frame_gen(void) { return s_gen; }
+
+bool led_render_wait_frame(uint32_t gen, uint32_t timeout_ms) {
+  TickType_t start = xTaskGetTickCount();
+  while (s_task && s_gen == gen) {
+    if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms)) {
+      return false;
+    }
+    // an idle task passes the boundary when woken
+    wake();
+    vTaskDelay(1);
+  }
+  return true;
+}
+
+bool led_render_is_active(void) { return s_active || s_pending_mask; }
+
+void led_render_get_stats(led_render_stats_t *out) {
+  portENTER_CRITICAL(&s_lock);
+  *out = s_stats;
+  portEXIT_CRITICAL(&s_lock);
+}
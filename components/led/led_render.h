@@ -0,0 +1,124 @@
+#ifndef LED_RENDER_H
+#define LED_RENDER_H
+
+#include "esp_err.h"
+#include "led_clock.h"
+#include "led_effects.h"
+#include "led_transition.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  uint32_t frames;        // frames shown since start
+  uint32_t fps;           // frames shown during the last second
+  uint32_t render_us_avg; // effect render time, last second
+  uint32_t render_us_max;
+  uint32_t show_us_avg;   // ws2812_show() time, last second
+  bool split;             // current effect is rendered on both cores
+  int layers;             // layers composited into the last frame
+  int64_t first_frame_us; // esp_timer time of the first frame, 0 = none yet
+} led_render_stats_t;
+
+// Compositor layers. Layer 0 is the base that led_render_play() and the
+// effect starters draw to (with transitions); higher layers are composited
+// over it with their opacity and blend mode. The top layer is kept for
+// notifications such as led_flash().
+#define LED_LAYER_BASE 0
+#define LED_LAYER_NOTIFY (CONFIG_LED_LAYERS - 1)
+
+// Start the render task pinned to CONFIG_LED_RENDER_CORE (and the split-frame
+// helper on the other core). Call after ws2812_init(). All frame buffers are
+// static, nothing is allocated here or while rendering.
+esp_err_t led_render_start(void);
+
+// Play an effect on the base layer from the next frame on. duration_ms = 0
+// runs until replaced, otherwise the last frame is held when the time is up.
+void led_render_play(led_effect_id_t id, const led_effect_params_t *params,
+                     uint32_t duration_ms);
+
+// led_render_play() and led_render_set_brightness() as one change, e.g. a
+// scene: both apply in the same frame and the change hook sees them once
+void led_render_play_at(led_effect_id_t id, const led_effect_params_t *params,
+                        uint32_t duration_ms, uint8_t brightness);
+
+// Stop rendering and leave the strip as it is
+void led_render_stop(void);
+
+// Play an effect on a layer. Overlays (layer > 0) are removed when
+// duration_ms is up; the base layer holds its last frame. Clearing a
+// layer removes it from the composite; the base layer goes black, unlike
+// with led_render_stop().
+void led_render_layer_play(int layer, led_effect_id_t id,
+                           const led_effect_params_t *params,
+                           uint32_t duration_ms);
+void led_render_layer_clear(int layer);
+
+// Opacity 0-255 and blend mode of a layer. Overlays default to 255 and
+// max, so their black pixels let the layers below show through.
+void led_render_layer_set(int layer, uint8_t opacity, led_blend_mode_t mode);
+void led_render_layer_get(int layer, uint8_t *opacity,
+                          led_blend_mode_t *mode);
+
+// Master brightness 0-255, applied to the composited frame
+void led_render_set_brightness(uint8_t level);
+uint8_t led_render_get_brightness(void);
+
+// Called from the caller's task whenever the base layer gets a new effect
+// or the brightness changes, e.g. to persist the current scene
+typedef void (*led_render_change_fn)(led_effect_id_t id,
+                                     const led_effect_params_t *params,
+                                     uint32_t duration_ms,
+                                     uint8_t brightness);
+void led_render_set_change_hook(led_render_change_fn hook);
+
+// Transition used when the next effect is played (default ease over
+// CONFIG_LED_TRANSITION_MS). A new effect played mid-transition fades from
+// whatever is on the strip at that moment.
+void led_render_set_transition(led_transition_type_t type,
+                               uint16_t duration_ms);
+void led_render_get_transition(led_transition_type_t *type,
+                               uint16_t *duration_ms);
+
+// Jump straight to the incoming effect if a transition is running
+void led_render_cancel_transition(void);
+
+// Schedule frames on an external clock, e.g. the network clock: each frame
+// is shown on a frame-period boundary of that clock, rendering starts
+// CONFIG_LED_FRAME_LEAD_US before it, and new effects start on the next
+// start_quantum_ms boundary. When the clock jumps, running effects and
+// transitions are moved with it so they carry on where they were. Pass
+// NULL to go back to the free-running local clock.
+void led_render_set_clock(const led_clock_t *clock,
+                          uint32_t start_quantum_ms);
+
+// Sum of the clock jumps the render task has followed so far. A frame hook
+// that keeps a start time on the pipeline clock adds the change since it
+// took that time.
+int64_t led_render_clock_shift(void);
+
+// Called on the render task at the start of every frame, before the layers
+// render, with the frame time on the pipeline clock. The task keeps
+// running frames while a hook is set. Pass NULL to remove it.
+typedef void (*led_render_frame_fn)(int64_t frame_us);
+void led_render_set_frame_hook(led_render_frame_fn hook);
+
+// Only from the frame hook: show an effect on a layer from this frame on.
+// If the layer already plays that effect only the parameters change and
+// the effect time keeps running. No transition, no change hook.
+void led_render_frame_set(int layer, led_effect_id_t id,
+                          const led_effect_params_t *params);
+// Same as led_render_layer_clear() from the frame hook
+void led_render_frame_clear(int layer);
+
+// Count of frame boundaries the render task has passed. Whatever a frame
+// read is free again once this moved on from the value taken during it.
+uint32_t led_render_frame_gen(void);
+// Wait until the count is past gen, waking the task if it is idle; false
+// after timeout_ms. Not from the render task itself.
+bool led_render_wait_frame(uint32_t gen, uint32_t timeout_ms);
+
+bool led_render_is_active(void);
+void led_render_get_stats(led_render_stats_t *out);
+
+#endif
@@ -0,0 +1,586 @@
+#include "led_shader.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "led_layout.h"
+#include "led_math.h"
+#include "led_noise.h"
+#include "led_swap.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ONE 0x10000 // 1.0 in 16.16
+
+// Register layout
+#define REG_OUT 0    // r0..r2 = red, green, blue
+#define REG_STACK 3  // expression stack for the compiler, r3..r11
+#define REG_INPUT 12 // r12..r15 = index, x, y, time
+#define STACK_DEPTH (REG_INPUT - REG_STACK)
+
+static const char *TAG = "led_shader";
+
+typedef struct {
+  uint8_t op;
+  uint8_t dst;
+  uint8_t a;
+  uint8_t b;
+} insn_t;
+
+typedef struct {
+  int32_t k[LED_SHADER_MAX_CONSTS];
+  insn_t code[CONFIG_LED_SHADER_MAX_INSNS];
+  uint8_t n_k;
+  uint8_t n_code;
+} program_t;
+
+// Two programs: a loaded one is copied into the spare one, then swapped in
+static program_t s_progs[2];
+static led_swap_t s_swap = LED_SWAP_INIT(&s_progs[0], &s_progs[1]);
+// Uploads are parsed and checked here before they go into the spare
+// program. Only the loader holding the spare (led_swap_begin) uses it.
+static program_t s_scratch;
+
+static esp_err_t check_budget(const program_t *p) {
+  int32_t per_frame = p->n_code * ws2812_get_num_leds();
+  if (per_frame > CONFIG_LED_SHADER_BUDGET) {
+    ESP_LOGW(TAG, "%d instructions x %d LEDs is over the budget of %d",
+             p->n_code, ws2812_get_num_leds(), CONFIG_LED_SHADER_BUDGET);
+    return ESP_ERR_INVALID_SIZE;
+  }
+  return ESP_OK;
+}
+
+static program_t *begin_load(void) {
+  program_t *spare = led_swap_begin(&s_swap);
+  if (!spare) {
+    ESP_LOGW(TAG, "Previous program still in use");
+  }
+  return spare;
+}
+
+// Copy the checked program in s_scratch in place of the running one, or
+// drop the load on err
+static esp_err_t finish_load(program_t *spare, esp_err_t err) {
+  if (err != ESP_OK) {
+    led_swap_cancel(&s_swap);
+    return err;
+  }
+  memcpy(spare, &s_scratch, sizeof(s_scratch));
+  led_swap_publish(&s_swap, spare);
+  ESP_LOGI(TAG, "Shader: %d instructions, %d constants", spare->n_code,
+           spare->n_k);
+  return ESP_OK;
+}
+
+// --- VM ---
+
+static inline int32_t fx_sin(int32_t a) {
+  // one turn is ONE, led_sin8 takes 256 steps per turn
+  uint8_t theta = (uint32_t)a >> 8;
+  return ((int32_t)led_sin8(theta) - 128) * (ONE / 127);
+}
+
+static inline int32_t fx_tri(int32_t a) {
+  int32_t f = a & (ONE - 1);
+  return f < ONE / 2 ? 2 * f : 2 * (ONE - f);
+}
+
+static inline uint8_t to_channel(int32_t v) {
+  if (v <= 0) {
+    return 0;
+  }
+  return v >= ONE ? 255 : (uint8_t)((v * 255) >> 16);
+}
+
+// Run the program on r; registers only, nothing else is touched
+static void run(const program_t *p, int32_t *r) {
+  const insn_t *in = p->code;
+  const insn_t *end = in + p->n_code;
+  for (; in < end; in++) {
+    // verified on load, masked anyway so no program can leave r
+    int32_t a = r[in->a & (LED_SHADER_REGS - 1)];
+    int32_t b = r[in->b & (LED_SHADER_REGS - 1)];
+    int32_t v;
+    switch (in->op) {
+    case LED_SHADER_LDK:
+      v = p->k[in->a & (LED_SHADER_MAX_CONSTS - 1)];
+      break;
+    case LED_SHADER_MOV:
+      v = a;
+      break;
+    case LED_SHADER_ADD:
+      v = a + b;
+      break;
+    case LED_SHADER_SUB:
+      v = a - b;
+      break;
+    case LED_SHADER_MUL:
+      v = (int32_t)(((int64_t)a * b) >> 16);
+      break;
+    case LED_SHADER_DIV:
+      v = b ? (int32_t)(((int64_t)a << 16) / b) : 0;
+      break;
+    case LED_SHADER_NEG:
+      v = -a;
+      break;
+    case LED_SHADER_ABS:
+      v = a < 0 ? -a : a;
+      break;
+    case LED_SHADER_FRACT:
+      v = a & (ONE - 1);
+      break;
+    case LED_SHADER_MIN:
+      v = a < b ? a : b;
+      break;
+    case LED_SHADER_MAX:
+      v = a > b ? a : b;
+      break;
+    case LED_SHADER_STEP:
+      v = b < a ? 0 : ONE;
+      break;
+    case LED_SHADER_SIN:
+      v = fx_sin(a);
+      break;
+    case LED_SHADER_TRI:
+      v = fx_tri(a);
+      break;
+    case LED_SHADER_NOISE:
+      v = led_noise2(a, b) * (ONE / 128);
+      break;
+    default:
+      v = 0;
+      break;
+    }
+    r[in->dst & (LED_SHADER_REGS - 1)] = v;
+  }
+}
+
+// Every cell of the layout with an LED in this part of the frame
+static inline uint16_t to_channel16(int32_t v) {
+  if (v <= 0) {
+    return 0;
+  }
+  return v >= ONE ? 0xffff : (uint16_t)v;
+}
+
+// Run the program for every pixel in [start, end), into px or px16
+static void shade(uint32_t t_ms, int start, int end, rgb_t *px,
+                  rgb16_t *px16) {
+  const program_t *prog = led_swap_current(&s_swap);
+  if (!prog) {
+    for (int i = start; i < end; i++) {
+      if (px16) {
+        px16[i] = (rgb16_t){0, 0, 0};
+      } else {
+        px[i] = (rgb_t){0, 0, 0};
+      }
+    }
+    return;
+  }
+
+  const led_layout_t *l = led_layout_get();
+  int32_t r[LED_SHADER_REGS] = {0};
+  r[REG_INPUT + 3] = (int32_t)(((int64_t)t_ms << 16) / 1000);
+  for (int i = start; i < end; i++) {
+    int x, y;
+    if (!led_layout_pos(l, i, &x, &y)) {
+      continue;
+    }
+    r[REG_OUT] = r[REG_OUT + 1] = r[REG_OUT + 2] = 0;
+    r[REG_INPUT] = i << 16;
+    r[REG_INPUT + 1] = x << 16;
+    r[REG_INPUT + 2] = y << 16;
+    run(prog, r);
+    if (px16) {
+      px16[i] = (rgb16_t){to_channel16(r[REG_OUT]),
+                          to_channel16(r[REG_OUT + 1]),
+                          to_channel16(r[REG_OUT + 2])};
+    } else {
+      px[i] = (rgb_t){to_channel(r[REG_OUT]), to_channel(r[REG_OUT + 1]),
+                      to_channel(r[REG_OUT + 2])};
+    }
+  }
+}
+
+void led_shader_render(const led_effect_params_t *p, uint32_t t_ms,
+                       led_frame_t *f) {
+  shade(t_ms, f->start, f->end, f->px, NULL);
+}
+
+void led_shader_render16(const led_effect_params_t *p, uint32_t t_ms,
+                         led_frame16_t *f) {
+  shade(t_ms, f->start, f->end, NULL, f->px);
+}
+
+// --- bytecode ---
+
+static esp_err_t verify(const program_t *p) {
+  for (int i = 0; i < p->n_code; i++) {
+    const insn_t *in = &p->code[i];
+    bool ok = in->op < LED_SHADER_OP_COUNT && in->dst < LED_SHADER_REGS &&
+              in->b < LED_SHADER_REGS &&
+              (in->op == LED_SHADER_LDK ? in->a < p->n_k
+                                        : in->a < LED_SHADER_REGS);
+    if (!ok) {
+      ESP_LOGW(TAG, "Bad instruction %d", i);
+      return ESP_ERR_INVALID_ARG;
+    }
+  }
+  return check_budget(p);
+}
+
+esp_err_t led_shader_load_bytecode(const uint8_t *data, size_t len) {
+  if (len < 6 || memcmp(data, "LSV1", 4) != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  int n_k = data[4], n_code = data[5];
+  if (n_k > LED_SHADER_MAX_CONSTS || n_code > CONFIG_LED_SHADER_MAX_INSNS ||
+      len != 6 + n_k * 4 + n_code * sizeof(insn_t)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  program_t *spare = begin_load();
+  if (!spare) {
+    return ESP_ERR_TIMEOUT;
+  }
+  program_t *p = &s_scratch;
+  const uint8_t *d = data + 6;
+  for (int i = 0; i < n_k; i++, d += 4) {
+    p->k[i] = (int32_t)(d[0] | d[1] << 8 | d[2] << 16 | (uint32_t)d[3] << 24);
+  }
+  memcpy(p->code, d, n_code * sizeof(insn_t));
+  p->n_k = n_k;
+  p->n_code = n_code;
+
+  return finish_load(spare, verify(p));
+}
+
+// --- expression compiler ---
+
+typedef struct {
+  const char *s;
+  program_t *p;
+  int sp; // next free stack register
+  const char *err;
+} compiler_t;
+
+static void skip_space(compiler_t *c) {
+  while (isspace((unsigned char)*c->s)) {
+    c->s++;
+  }
+}
+
+static bool accept(compiler_t *c, char ch) {
+  skip_space(c);
+  if (*c->s == ch) {
+    c->s++;
+    return true;
+  }
+  return false;
+}
+
+static void emit(compiler_t *c, int op, int dst, int a, int b) {
+  if (c->err) {
+    return;
+  }
+  if (c->p->n_code >= CONFIG_LED_SHADER_MAX_INSNS) {
+    c->err = "program too long";
+    return;
+  }
+  c->p->code[c->p->n_code++] = (insn_t){op, dst, a, b};
+}
+
+// Register for a new value on the stack
+static int push(compiler_t *c) {
+  if (c->sp >= REG_STACK + STACK_DEPTH) {
+    c->err = "expression too deep";
+    return REG_STACK;
+  }
+  return c->sp++;
+}
+
+static int add_const(compiler_t *c, int32_t v) {
+  program_t *p = c->p;
+  for (int i = 0; i < p->n_k; i++) {
+    if (p->k[i] == v) {
+      return i;
+    }
+  }
+  if (p->n_k >= LED_SHADER_MAX_CONSTS) {
+    c->err = "too many constants";
+    return 0;
+  }
+  p->k[p->n_k] = v;
+  return p->n_k++;
+}
+
+// Decimal number to 16.16 without floats
+static int32_t parse_number(compiler_t *c) {
+  int32_t whole = 0;
+  while (isdigit((unsigned char)*c->s) && whole < 32768) {
+    whole = whole * 10 + (*c->s++ - '0');
+  }
+  int32_t frac = 0, scale = 1;
+  if (*c->s == '.') {
+    c->s++;
+    while (isdigit((unsigned char)*c->s)) {
+      if (scale < 100000) {
+        frac = frac * 10 + (*c->s - '0');
+        scale *= 10;
+      }
+      c->s++;
+    }
+  }
+  return (whole << 16) + (int32_t)(((int64_t)frac << 16) / scale);
+}
+
+static void expr(compiler_t *c);
+
+static const struct {
+  const char *name;
+  uint8_t op;
+  uint8_t args;
+} s_funcs[] = {
+    {"sin", LED_SHADER_SIN, 1},     {"tri", LED_SHADER_TRI, 1},
+    {"noise", LED_SHADER_NOISE, 2}, {"abs", LED_SHADER_ABS, 1},
+    {"fract", LED_SHADER_FRACT, 1}, {"min", LED_SHADER_MIN, 2},
+    {"max", LED_SHADER_MAX, 2},     {"step", LED_SHADER_STEP, 2},
+};
+
+static void primary(compiler_t *c) {
+  skip_space(c);
+  if (accept(c, '(')) {
+    expr(c);
+    if (!accept(c, ')')) {
+      c->err = "missing )";
+    }
+    return;
+  }
+  if (isdigit((unsigned char)*c->s) || *c->s == '.') {
+    int k = add_const(c, parse_number(c));
+    emit(c, LED_SHADER_LDK, push(c), k, 0);
+    return;
+  }
+
+  char name[8];
+  int len = 0;
+  while (isalpha((unsigned char)*c->s)) {
+    if (len < sizeof(name) - 1) {
+      name[len++] = *c->s;
+    }
+    c->s++;
+  }
+  name[len] = '\0';
+
+  static const char inputs[] = "ixyt";
+  const char *in = len == 1 ? strchr(inputs, name[0]) : NULL;
+  if (in) {
+    emit(c, LED_SHADER_MOV, push(c), REG_INPUT + (in - inputs), 0);
+    return;
+  }
+  for (int f = 0; f < sizeof(s_funcs) / sizeof(s_funcs[0]); f++) {
+    if (strcmp(name, s_funcs[f].name) != 0) {
+      continue;
+    }
+    if (!accept(c, '(')) {
+      c->err = "missing (";
+      return;
+    }
+    expr(c);
+    if (s_funcs[f].args == 2 && !accept(c, ',')) {
+      c->err = "missing argument";
+      return;
+    }
+    if (s_funcs[f].args == 2) {
+      expr(c);
+    }
+    if (!accept(c, ')')) {
+      c->err = "missing )";
+      return;
+    }
+    // arguments are on top of the stack, the result replaces the first
+    int a = c->sp - s_funcs[f].args;
+    emit(c, s_funcs[f].op, a, a, c->sp - 1);
+    c->sp = a + 1;
+    return;
+  }
+  c->err = "unknown name";
+}
+
+static void unary(compiler_t *c) {
+  if (accept(c, '-')) {
+    unary(c);
+    emit(c, LED_SHADER_NEG, c->sp - 1, c->sp - 1, 0);
+    return;
+  }
+  primary(c);
+}
+
+static void binary(compiler_t *c, int op) {
+  emit(c, op, c->sp - 2, c->sp - 2, c->sp - 1);
+  c->sp--;
+}
+
+static void term(compiler_t *c) {
+  unary(c);
+  while (!c->err) {
+    if (accept(c, '*')) {
+      unary(c);
+      binary(c, LED_SHADER_MUL);
+    } else if (accept(c, '/')) {
+      unary(c);
+      binary(c, LED_SHADER_DIV);
+    } else {
+      return;
+    }
+  }
+}
+
+static void expr(compiler_t *c) {
+  term(c);
+  while (!c->err) {
+    if (accept(c, '+')) {
+      term(c);
+      binary(c, LED_SHADER_ADD);
+    } else if (accept(c, '-')) {
+      term(c);
+      binary(c, LED_SHADER_SUB);
+    } else {
+      return;
+    }
+  }
+}
+
+static esp_err_t compile(const char *src, program_t *p, char *err,
+                         size_t err_len) {
+  compiler_t c = {.s = src, .p = p, .sp = REG_STACK};
+  p->n_k = 0;
+  p->n_code = 0;
+
+  static const char channels[] = "rgb";
+  while (!c.err) {
+    if (accept(&c, ';')) {
+      continue;
+    }
+    skip_space(&c);
+    if (*c.s == '\0') {
+      break;
+    }
+    const char *ch = strchr(channels, *c.s);
+    if (!ch || !*ch) {
+      c.err = "expected r, g or b";
+      break;
+    }
+    c.s++;
+    if (!accept(&c, '=')) {
+      c.err = "expected =";
+      break;
+    }
+    expr(&c);
+    emit(&c, LED_SHADER_MOV, REG_OUT + (ch - channels), REG_STACK, 0);
+    c.sp = REG_STACK;
+  }
+
+  if (c.err) {
+    if (err) {
+      snprintf(err, err_len, "%s at offset %d", c.err, (int)(c.s - src));
+    }
+    return ESP_ERR_INVALID_ARG;
+  }
+  return ESP_OK;
+}
+
+esp_err_t led_shader_load_expr(const char *src, char *err, size_t err_len) {
+  program_t *spare = begin_load();
+  if (!spare) {
+    if (err) {
+      snprintf(err, err_len, "previous program still in use");
+    }
+    return ESP_ERR_TIMEOUT;
+  }
+  program_t *p = &s_scratch;
+  esp_err_t ret = compile(src, p, err, err_len);
+  if (ret == ESP_OK) {
+    ret = check_budget(p);
+    if (ret != ESP_OK && err) {
+      snprintf(err, err_len, "over the budget of %d instructions per frame",
+               CONFIG_LED_SHADER_BUDGET);
+    }
+  }
+  return finish_load(spare, ret);
+}
+
+void led_shader_get_info(int *insns, int *consts) {
+  const program_t *p = led_swap_current(&s_swap);
+  *insns = p ? p->n_code : 0;
+  *consts = p ? p->n_k : 0;
+}
+
+// --- benchmark ---
+
+// Reference program and the same formula written in C
+#define BENCH_EXPR                                                             \
+  "r = sin(x * 0.0625 + t) * 0.5 + 0.5;"                                       \
+  "g = tri(y * 0.125 + t * 0.5);"                                              \
+  "b = noise(x * 0.25, y * 0.25 + t)"
+
+static rgb_t native_pixel(int32_t x, int32_t y, int32_t t) {
+  int32_t r = fx_sin((x >> 4) + t) / 2 + ONE / 2;
+  int32_t g = fx_tri((y >> 3) + t / 2);
+  int32_t b = led_noise2(x >> 2, (y >> 2) + t) * (ONE / 128);
+  return (rgb_t){to_channel(r), to_channel(g), to_channel(b)};
+}
+
+static uint32_t px_per_s(int px, int64_t us) {
+  return us > 0 ? (uint32_t)((int64_t)px * 1000000 / us) : 0;
+}
+
+esp_err_t led_shader_bench(int frames, led_shader_bench_t *out) {
+  static program_t prog;
+  if (frames <= 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  esp_err_t err = compile(BENCH_EXPR, &prog, NULL, 0);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  const led_layout_t *l = led_layout_get();
+  int px = frames * l->width * l->height;
+  volatile uint8_t sink = 0;
+
+  int64_t t0 = esp_timer_get_time();
+  int32_t r[LED_SHADER_REGS] = {0};
+  for (int n = 0; n < frames; n++) {
+    r[REG_INPUT + 3] = n * (ONE / 60);
+    for (int y = 0; y < l->height; y++) {
+      for (int x = 0; x < l->width; x++) {
+        r[REG_INPUT + 1] = x << 16;
+        r[REG_INPUT + 2] = y << 16;
+        run(&prog, r);
+        sink ^= to_channel(r[0]) ^ to_channel(r[1]) ^ to_channel(r[2]);
+      }
+    }
+  }
+  int64_t t1 = esp_timer_get_time();
+  for (int n = 0; n < frames; n++) {
+    int32_t t = n * (ONE / 60);
+    for (int y = 0; y < l->height; y++) {
+      for (int x = 0; x < l->width; x++) {
+        rgb_t c = native_pixel(x << 16, y << 16, t);
+        sink ^= c.r ^ c.g ^ c.b;
+      }
+    }
+  }
+  int64_t t2 = esp_timer_get_time();
+
+  *out = (led_shader_bench_t){.vm_px_per_s = px_per_s(px, t1 - t0),
+                              .native_px_per_s = px_per_s(px, t2 - t1),
+                              .insns = prog.n_code};
+  ESP_LOGI(TAG, "VM %lu px/s, native %lu px/s (%d instructions)",
+           (unsigned long)out->vm_px_per_s,
+           (unsigned long)out->native_px_per_s, out->insns);
+  return ESP_OK;
+}
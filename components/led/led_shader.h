@@ -0,0 +1,81 @@
+#ifndef LED_SHADER_H
+#define LED_SHADER_H
+
+#include "esp_err.h"
+#include "led_effects.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// User-defined effects without a reflash: a small register VM that runs
+// one straight-line program per pixel. Numbers are 16.16 fixed point.
+//
+// Registers r0..r15: r0, r1, r2 are the output red, green and blue (0..1,
+// clamped), r12..r15 hold the inputs index, x, y and time in seconds.
+// Angles are in turns, so sin(x) goes round once from 0 to 1.
+//
+// Programs are uploaded as bytecode or as an expression the device
+// compiles once, e.g.
+//
+//   r = sin(x * 0.05 + t) * 0.5 + 0.5; g = tri(t * 0.2); b = noise(x, y + t)
+//
+// Inputs i, x, y, t; functions sin, tri, noise(a, b), abs, fract,
+// min(a, b), max(a, b), step(edge, v); + - * / and parentheses. A missing
+// channel stays 0. There are no jumps, so a program costs the same for
+// every pixel, and it is refused if program length times LED count goes
+// over CONFIG_LED_SHADER_BUDGET instructions per frame.
+//
+// Bytecode: "LSV1", uint8 constant count, uint8 instruction count, the
+// constants as little-endian int32, then 4 bytes per instruction: opcode,
+// destination, a, b (see led_shader_op_t; for LDK, a is the constant).
+
+typedef enum {
+  LED_SHADER_LDK,   // dst = k[a]
+  LED_SHADER_MOV,   // dst = a
+  LED_SHADER_ADD,   // dst = a + b
+  LED_SHADER_SUB,   // dst = a - b
+  LED_SHADER_MUL,   // dst = a * b
+  LED_SHADER_DIV,   // dst = a / b, 0 when b is 0
+  LED_SHADER_NEG,   // dst = -a
+  LED_SHADER_ABS,   // dst = |a|
+  LED_SHADER_FRACT, // dst = a - floor(a)
+  LED_SHADER_MIN,   // dst = min(a, b)
+  LED_SHADER_MAX,   // dst = max(a, b)
+  LED_SHADER_STEP,  // dst = b < a ? 0 : 1
+  LED_SHADER_SIN,   // dst = sin(a turns), -1..1
+  LED_SHADER_TRI,   // dst = triangle 0..1..0 over one turn of a
+  LED_SHADER_NOISE, // dst = noise at (a, b), about -1..1
+  LED_SHADER_OP_COUNT,
+} led_shader_op_t;
+
+#define LED_SHADER_REGS 16
+#define LED_SHADER_MAX_CONSTS 32 // power of two, the VM masks with it
+
+// Compile an expression and make it the program the shader effect runs.
+// On a syntax error err gets a short message.
+esp_err_t led_shader_load_expr(const char *src, char *err, size_t err_len);
+
+// Check and load a compiled program. Both loaders give ESP_ERR_TIMEOUT if
+// the render task is not yet off the program before the running one.
+esp_err_t led_shader_load_bytecode(const uint8_t *data, size_t len);
+
+// Instructions and constants of the loaded program, 0 if none
+void led_shader_get_info(int *insns, int *consts);
+
+// Render functions of LED_EFFECT_SHADER, the 16-bit one keeps the full
+// resolution of the outputs
+void led_shader_render(const led_effect_params_t *p, uint32_t t_ms,
+                       led_frame_t *f);
+void led_shader_render16(const led_effect_params_t *p, uint32_t t_ms,
+                         led_frame16_t *f);
+
+typedef struct {
+  uint32_t vm_px_per_s;
+  uint32_t native_px_per_s;
+  int insns; // of the reference program
+} led_shader_bench_t;
+
+// Pixels per second of a reference program on the VM and of the same
+// formula in C, on the calling task's core
+esp_err_t led_shader_bench(int frames, led_shader_bench_t *out);
+
+#endif
@@ -0,0 +1,46 @@
+#include "led_swap.h"
+#include "freertos/FreeRTOS.h"
+#include "led_render.h"
+
+// a few frames even at the lowest frame rate
+#define SWAP_WAIT_MS 1500
+
+// Writers are rare, one lock for all of them
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void *led_swap_begin(led_swap_t *s) {
+  portENTER_CRITICAL(&s_lock);
+  if (s->building) {
+    portEXIT_CRITICAL(&s_lock);
+    return NULL;
+  }
+  void *spare = s->current == s->copies[0] ? s->copies[1] : s->copies[0];
+  bool in_use = spare == s->retired;
+  uint32_t gen = s->retired_gen;
+  s->building = true;
+  portEXIT_CRITICAL(&s_lock);
+
+  // the render task may still be in the frame that read it
+  if (in_use && !led_render_wait_frame(gen, SWAP_WAIT_MS)) {
+    led_swap_cancel(s);
+    return NULL;
+  }
+  return spare;
+}
+
+void led_swap_publish(led_swap_t *s, void *copy) {
+  portENTER_CRITICAL(&s_lock);
+  s->retired = s->current;
+  s->current = copy;
+  // taken after the swap: a frame that started before it may hold the
+  // old copy, one that starts after it sees the new one
+  s->retired_gen = led_render_frame_gen();
+  s->building = false;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void led_swap_cancel(led_swap_t *s) {
+  portENTER_CRITICAL(&s_lock);
+  s->building = false;
+  portEXIT_CRITICAL(&s_lock);
+}
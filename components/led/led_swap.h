@@ -0,0 +1,41 @@
+#ifndef LED_SWAP_H
+#define LED_SWAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Two copies of something the render task reads while it draws (layout
+// tables, timeline, shader program). A writer builds the next version in
+// the spare copy and publishes it. The copy it replaced only becomes the
+// spare again once the render task has finished every frame that could
+// still be reading it, so a second change right after the first waits for
+// the frame boundary instead of rewriting a table in use.
+//
+// Readers on the render task (and its split helper) fetch
+// led_swap_current() during a frame and do not keep the pointer past the
+// end of that frame. Writers run on any other task.
+typedef struct {
+  void *copies[2];
+  const void *volatile current; // NULL until the first publish
+  const void *retired;          // copy replaced by the last publish
+  uint32_t retired_gen;         // render frame generation at that moment
+  bool building;
+} led_swap_t;
+
+#define LED_SWAP_INIT(a, b) {.copies = {(a), (b)}}
+
+// Spare copy to build the next version in. NULL if another build is open
+// or the render task did not get off the old copy within a few frames.
+void *led_swap_begin(led_swap_t *s);
+
+// Make the copy from led_swap_begin() current from the next read on
+void led_swap_publish(led_swap_t *s, void *copy);
+
+// Drop an open build, the current copy stays
+void led_swap_cancel(led_swap_t *s);
+
+static inline const void *led_swap_current(const led_swap_t *s) {
+  return s->current;
+}
+
+#endif
@@ -0,0 +1,460 @@
+#include "led_timeline.h"
+#include "esp_log.h"
+#include "led_effects.h"
+#include "led_render.h"
+#include "led_swap.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_KEYS CONFIG_LED_TIMELINE_MAX_KEYS
+// the top layer stays free for notifications
+#define MAX_TRACKS LED_LAYER_NOTIFY
+#define WEIGHT_FULL 256
+
+static const char *TAG = "led_timeline";
+
+static const char *const s_ease_names[LED_EASE_COUNT] = {
+    [LED_EASE_STEP] = "step",
+    [LED_EASE_LINEAR] = "linear",
+    [LED_EASE_SMOOTH] = "smooth",
+};
+
+typedef struct {
+  uint32_t t_ms;
+  uint8_t track;
+  uint8_t effect;
+  uint8_t ease;
+  led_effect_params_t params;
+} keyframe_t;
+
+// From one keyframe towards the next one on the same track
+typedef struct {
+  uint32_t start_ms;
+  uint32_t end_ms;
+  uint32_t inv_len; // (256 << 16) / length, the weight without a divide
+  uint16_t from;
+  uint16_t to; // same as from for holds and cuts
+  uint8_t track;
+  uint8_t ease;
+} segment_t;
+
+typedef struct {
+  keyframe_t keys[MAX_KEYS];
+  segment_t segs[MAX_KEYS];
+  uint16_t n_keys;
+  uint16_t n_segs;
+  uint32_t length_ms;
+  uint32_t tracks; // bit per track in use
+} timeline_t;
+
+// Two timelines: a new one is built in the spare one, then swapped in
+static timeline_t s_timelines[2];
+static led_swap_t s_swap = LED_SWAP_INIT(&s_timelines[0], &s_timelines[1]);
+static timeline_t *s_build = NULL;
+static int s_line = 0;
+
+// Requests from other tasks
+static volatile bool s_playing = false;
+static volatile bool s_loop = false;
+static volatile bool s_restart = false;
+static volatile uint32_t s_position_ms = 0;
+
+// Owned by the render task; s_tl is only compared, the timeline is fetched
+// again every frame
+static const timeline_t *s_tl = NULL;
+static int64_t s_start_us = 0;
+static int64_t s_start_shift_us = 0; // led_render_clock_shift() at start
+static uint16_t s_cursor = 0;
+static int16_t s_active[MAX_TRACKS];
+static uint32_t s_last_ms = 0;
+static uint32_t s_shown = 0; // tracks with something on their layer
+
+static const timeline_t *current(void) { return led_swap_current(&s_swap); }
+
+esp_err_t led_timeline_begin(void) {
+  if (s_build) {
+    // an upload that never got committed
+    led_swap_cancel(&s_swap);
+  }
+  s_build = led_swap_begin(&s_swap);
+  if (!s_build) {
+    ESP_LOGW(TAG, "Previous timeline still in use");
+    return ESP_ERR_TIMEOUT;
+  }
+  s_build->n_keys = 0;
+  s_build->n_segs = 0;
+  s_build->length_ms = 0;
+  s_build->tracks = 0;
+  s_line = 0;
+  return ESP_OK;
+}
+
+// Next key=value pair of a line. text= takes the rest of the line.
+static bool next_pair(const char **line, char *key, size_t key_len,
+                      const char **val, size_t *val_len) {
+  const char *p = *line;
+  while (*p == ' ' || *p == '\t' || *p == '&') {
+    p++;
+  }
+  if (*p == '\0' || *p == '\r' || *p == '\n') {
+    return false;
+  }
+  size_t k = 0;
+  while (*p && *p != '=' && *p != ' ' && *p != '\t') {
+    if (k + 1 < key_len) {
+      key[k++] = *p;
+    }
+    p++;
+  }
+  key[k] = '\0';
+  if (*p == '=') {
+    p++;
+  }
+  *val = p;
+  bool rest = strcmp(key, "text") == 0;
+  while (*p && *p != '\r' && *p != '\n' &&
+         (rest || (*p != ' ' && *p != '\t' && *p != '&'))) {
+    p++;
+  }
+  *val_len = p - *val;
+  *line = p;
+  return true;
+}
+
+static bool parse_num(const char *val, size_t len, long max, long *out) {
+  char buf[12];
+  if (len == 0 || len >= sizeof(buf)) {
+    return false;
+  }
+  memcpy(buf, val, len);
+  buf[len] = '\0';
+  char *end;
+  long v = strtol(buf, &end, 10);
+  if (*end != '\0' || v < 0 || v > max) {
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+static int ease_from_name(const char *name) {
+  for (int i = 0; i < LED_EASE_COUNT; i++) {
+    if (strcmp(name, s_ease_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Copy a value into a NUL-terminated name, false if it does not fit
+static bool copy_name(char *name, size_t size, const char *val, size_t len) {
+  if (len >= size) {
+    return false;
+  }
+  memcpy(name, val, len);
+  name[len] = '\0';
+  return true;
+}
+
+// One key=value of a keyframe line, false if the key or value is bad
+static bool parse_pair(keyframe_t *k, const char *key, const char *val,
+                       size_t len, bool *has_t) {
+  long v = 0;
+  char name[24];
+  if (strcmp(key, "t") == 0) {
+    *has_t = parse_num(val, len, 0x7fffffff, &v);
+    k->t_ms = v;
+    return *has_t;
+  }
+  if (strcmp(key, "track") == 0) {
+    bool ok = parse_num(val, len, MAX_TRACKS - 1, &v);
+    k->track = v;
+    return ok;
+  }
+  if (strcmp(key, "fx") == 0) {
+    int id = copy_name(name, sizeof(name), val, len)
+                 ? led_effect_from_name(name)
+                 : -1;
+    k->effect = id;
+    return id >= 0;
+  }
+  if (strcmp(key, "ease") == 0) {
+    int ease =
+        copy_name(name, sizeof(name), val, len) ? ease_from_name(name) : -1;
+    k->ease = ease;
+    return ease >= 0;
+  }
+  if (strcmp(key, "text") == 0) {
+    if (len >= LED_TEXT_MAX) {
+      len = LED_TEXT_MAX - 1;
+    }
+    memcpy(k->params.text, val, len);
+    return true;
+  }
+  if (strcmp(key, "delay") == 0) {
+    bool ok = parse_num(val, len, 0xffff, &v);
+    k->params.delay_ms = v;
+    return ok;
+  }
+
+  uint8_t *u8 = strcmp(key, "r") == 0       ? &k->params.r
+                : strcmp(key, "g") == 0     ? &k->params.g
+                : strcmp(key, "b") == 0     ? &k->params.b
+                : strcmp(key, "speed") == 0 ? &k->params.speed
+                                            : NULL;
+  if (!u8 || !parse_num(val, len, 255, &v)) {
+    return false;
+  }
+  *u8 = v;
+  return true;
+}
+
+esp_err_t led_timeline_add_line(const char *line) {
+  if (!s_build) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  s_line++;
+  keyframe_t k = {.effect = LED_EFFECT_SOLID, .ease = LED_EASE_LINEAR};
+  bool has_t = false, is_key = false;
+
+  char key[16];
+  const char *val;
+  size_t len;
+  while (next_pair(&line, key, sizeof(key), &val, &len)) {
+    if (key[0] == '#') {
+      break;
+    }
+    bool ok;
+    if (strcmp(key, "length") == 0) {
+      long v = 0;
+      ok = parse_num(val, len, 0x7fffffff, &v);
+      s_build->length_ms = v;
+    } else {
+      is_key = true;
+      ok = parse_pair(&k, key, val, len, &has_t);
+    }
+    if (!ok) {
+      ESP_LOGW(TAG, "Line %d: bad %s", s_line, key);
+      return ESP_ERR_INVALID_ARG;
+    }
+  }
+
+  if (!is_key) {
+    return ESP_OK;
+  }
+  if (!has_t) {
+    ESP_LOGW(TAG, "Line %d: keyframe without t", s_line);
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (s_build->n_keys >= MAX_KEYS) {
+    ESP_LOGW(TAG, "Line %d: more than %d keyframes", s_line, MAX_KEYS);
+    return ESP_ERR_NO_MEM;
+  }
+  s_build->keys[s_build->n_keys++] = k;
+  return ESP_OK;
+}
+
+static int cmp_key(const void *a, const void *b) {
+  const keyframe_t *x = a, *y = b;
+  if (x->track != y->track) {
+    return x->track - y->track;
+  }
+  return x->t_ms < y->t_ms ? -1 : x->t_ms > y->t_ms;
+}
+
+static int cmp_segment(const void *a, const void *b) {
+  const segment_t *x = a, *y = b;
+  if (x->start_ms != y->start_ms) {
+    return x->start_ms < y->start_ms ? -1 : 1;
+  }
+  return x->track - y->track;
+}
+
+esp_err_t led_timeline_commit(void) {
+  timeline_t *tl = s_build;
+  if (!tl || tl->n_keys == 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // keyframes per track in time order
+  qsort(tl->keys, tl->n_keys, sizeof(keyframe_t), cmp_key);
+  for (int i = 0; i < tl->n_keys; i++) {
+    const keyframe_t *k = &tl->keys[i];
+    if (i > 0 && k->track == k[-1].track && k->t_ms == k[-1].t_ms) {
+      ESP_LOGW(TAG, "Two keyframes at %lu ms on track %d",
+               (unsigned long)k->t_ms, k->track);
+      return ESP_ERR_INVALID_ARG;
+    }
+    if (k->t_ms > tl->length_ms) {
+      tl->length_ms = k->t_ms;
+    }
+  }
+
+  // one segment per keyframe, up to the next one on its track or the end
+  for (int i = 0; i < tl->n_keys; i++) {
+    const keyframe_t *k = &tl->keys[i];
+    bool has_next = i + 1 < tl->n_keys && k[1].track == k->track;
+    segment_t *seg = &tl->segs[i];
+    *seg = (segment_t){.start_ms = k->t_ms,
+                       .end_ms = has_next ? k[1].t_ms : tl->length_ms,
+                       .from = i,
+                       .to = i,
+                       .track = k->track,
+                       .ease = k->ease};
+    if (has_next && k->ease != LED_EASE_STEP && k[1].effect == k->effect) {
+      seg->to = i + 1;
+    }
+    if (seg->end_ms > seg->start_ms) {
+      seg->inv_len = (WEIGHT_FULL << 16) / (seg->end_ms - seg->start_ms);
+    }
+    tl->tracks |= 1u << k->track;
+  }
+  tl->n_segs = tl->n_keys;
+  qsort(tl->segs, tl->n_segs, sizeof(segment_t), cmp_segment);
+
+  led_swap_publish(&s_swap, tl);
+  s_build = NULL;
+  s_restart = true;
+  ESP_LOGI(TAG, "Timeline: %d keyframes, %lu ms", tl->n_keys,
+           (unsigned long)tl->length_ms);
+  return ESP_OK;
+}
+
+static uint8_t lerp8(uint8_t a, uint8_t b, int32_t w) {
+  return a + (((int32_t)b - a) * w >> 8);
+}
+
+// Parameters of a segment's track at t_ms
+static void segment_params(const timeline_t *tl, const segment_t *seg,
+                           uint32_t t_ms, led_effect_params_t *out) {
+  const keyframe_t *from = &tl->keys[seg->from];
+  *out = from->params;
+  if (seg->to == seg->from) {
+    return;
+  }
+
+  uint32_t w = (t_ms - seg->start_ms) * seg->inv_len >> 16;
+  if (w > WEIGHT_FULL) {
+    w = WEIGHT_FULL;
+  }
+  if (seg->ease == LED_EASE_SMOOTH) {
+    // smoothstep, same curve as the ease transition
+    w = (w * w * (3 * WEIGHT_FULL - 2 * w)) >> 16;
+  }
+  const led_effect_params_t *to = &tl->keys[seg->to].params;
+  out->r = lerp8(out->r, to->r, w);
+  out->g = lerp8(out->g, to->g, w);
+  out->b = lerp8(out->b, to->b, w);
+  out->speed = lerp8(out->speed, to->speed, w);
+  out->delay_ms += ((int32_t)to->delay_ms - out->delay_ms) * (int32_t)w >> 8;
+}
+
+static void rewind(void) {
+  s_cursor = 0;
+  for (int i = 0; i < MAX_TRACKS; i++) {
+    s_active[i] = -1;
+  }
+}
+
+// Frame hook, runs on the render task
+static void timeline_frame(int64_t frame_us) {
+  const timeline_t *tl = current();
+  if (s_restart || tl != s_tl) {
+    s_restart = false;
+    s_tl = tl;
+    s_start_us = frame_us;
+    s_start_shift_us = led_render_clock_shift();
+    s_last_ms = 0;
+    // only the layers of this timeline are touched, the others keep
+    // whatever plays on them
+    s_shown = tl->tracks;
+    rewind();
+  }
+
+  // follow jumps of the pipeline clock like the layers do
+  int64_t shift = led_render_clock_shift();
+  s_start_us += shift - s_start_shift_us;
+  s_start_shift_us = shift;
+
+  int64_t elapsed_ms = (frame_us - s_start_us) / 1000;
+  uint32_t t = elapsed_ms > 0 ? (uint32_t)elapsed_ms : 0;
+  bool done = false;
+  if (t >= tl->length_ms) {
+    if (s_loop && tl->length_ms > 0) {
+      t %= tl->length_ms;
+    } else {
+      t = tl->length_ms;
+      done = true;
+    }
+  }
+  if (t < s_last_ms) {
+    // looped around
+    rewind();
+  }
+  s_last_ms = t;
+
+  // segments are sorted by start, so this only ever moves forward
+  while (s_cursor < tl->n_segs && tl->segs[s_cursor].start_ms <= t) {
+    s_active[tl->segs[s_cursor].track] = s_cursor;
+    s_cursor++;
+  }
+
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    if (s_active[track] < 0) {
+      // before the track's first keyframe, e.g. after looping around
+      if (s_shown & (1u << track)) {
+        led_render_frame_clear(track);
+        s_shown &= ~(1u << track);
+      }
+      continue;
+    }
+    const segment_t *seg = &tl->segs[s_active[track]];
+    led_effect_params_t params;
+    segment_params(tl, seg, t, &params);
+    led_render_frame_set(track, tl->keys[seg->from].effect, &params);
+    s_shown |= 1u << track;
+  }
+  s_position_ms = t;
+
+  if (done) {
+    // the last keyframes stay on the strip
+    s_playing = false;
+    s_tl = NULL;
+    led_render_set_frame_hook(NULL);
+  }
+}
+
+esp_err_t led_timeline_play(bool loop) {
+  if (!current()) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  s_loop = loop;
+  s_restart = true;
+  s_playing = true;
+  led_render_set_frame_hook(timeline_frame);
+  return ESP_OK;
+}
+
+void led_timeline_stop(void) {
+  led_render_set_frame_hook(NULL);
+  s_playing = false;
+  s_tl = NULL;
+  const timeline_t *tl = current();
+  for (int track = 0; tl && track < MAX_TRACKS; track++) {
+    if (tl->tracks & (1u << track)) {
+      led_render_layer_clear(track);
+    }
+  }
+}
+
+void led_timeline_get_status(led_timeline_status_t *out) {
+  const timeline_t *tl = current();
+  *out = (led_timeline_status_t){
+      .playing = s_playing,
+      .loop = s_loop,
+      .keys = tl ? tl->n_keys : 0,
+      .segments = tl ? tl->n_segs : 0,
+      .length_ms = tl ? tl->length_ms : 0,
+      .position_ms = s_playing ? s_position_ms : 0};
+}
@@ -0,0 +1,55 @@
+#ifndef LED_TIMELINE_H
+#define LED_TIMELINE_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Timed shows that run on the device. A timeline is uploaded as text, one
+// keyframe per line, and compiled once into a flat array of segments
+// sorted by start time; playback only moves a cursor and interpolates.
+//
+//   # comment
+//   length=20000
+//   t=0 track=0 fx=solid r=255 g=0 b=0 ease=smooth
+//   t=4000 track=0 fx=solid r=0 g=0 b=255
+//   t=0 track=1 fx=scroll_text r=255 g=255 b=255 speed=80 text=Hello all
+//
+// t is in ms from the start, track is the render layer (0 = base, up to
+// the one below the notification layer). Colors, speed and delay move from
+// one keyframe to the next of the same track with the first one's ease
+// (step, linear, smooth); when the effect changes it is a cut. text= takes
+// the rest of the line. length= sets the loop length, default the time of
+// the last keyframe.
+
+typedef enum {
+  LED_EASE_STEP,
+  LED_EASE_LINEAR,
+  LED_EASE_SMOOTH,
+  LED_EASE_COUNT,
+} led_ease_t;
+
+typedef struct {
+  bool playing;
+  bool loop;
+  uint16_t keys;
+  uint16_t segments;
+  uint32_t length_ms;
+  uint32_t position_ms;
+} led_timeline_status_t;
+
+// Upload: begin, one line at a time, commit. The new timeline is built
+// next to the one playing and swapped in on commit; if one was playing it
+// starts over with the new one. begin gives ESP_ERR_TIMEOUT if the render
+// task is not yet off the timeline before the current one.
+esp_err_t led_timeline_begin(void);
+esp_err_t led_timeline_add_line(const char *line);
+esp_err_t led_timeline_commit(void);
+
+// Start from the beginning, through a frame hook on the render task
+esp_err_t led_timeline_play(bool loop);
+// Stop and clear the layers the timeline used (the base layer goes dark)
+void led_timeline_stop(void);
+void led_timeline_get_status(led_timeline_status_t *out);
+
+#endif
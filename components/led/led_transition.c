@@ -0,0 +1,122 @@
+#include "led_transition.h"
+#include <string.h>
+
+// Width of the soft edge of the wipe, in pixels
+#define WIPE_EDGE 8
+
+static const char *const s_names[LED_TRANSITION_COUNT] = {
+    [LED_TRANSITION_NONE] = "none",
+    [LED_TRANSITION_LINEAR] = "linear",
+    [LED_TRANSITION_EASE] = "ease",
+    [LED_TRANSITION_WIPE] = "wipe",
+};
+
+// Same weight for the whole frame
+static void blend_uniform(const uint32_t *from, rgb_t *px, int n,
+                          uint32_t w) {
+  for (int i = 0; i < n; i++) {
+    led_store_rgb(&px[i], led_lerp_px(from[i], led_pack_rgb(px[i]), w));
+  }
+}
+
+// Incoming frame grows from index 0 behind an edge WIPE_EDGE pixels wide
+static void blend_wipe(const uint32_t *from, rgb_t *px, int n,
+                       uint32_t progress) {
+  // edge position in 1/256 pixels, runs from 0 to n + WIPE_EDGE
+  int32_t edge = (int32_t)progress * (n + WIPE_EDGE);
+  for (int i = 0; i < n; i++) {
+    int32_t w = (edge - i * LED_TRANSITION_FULL) / WIPE_EDGE;
+    if (w <= 0) {
+      // nothing further along has been reached either
+      for (; i < n; i++) {
+        led_store_rgb(&px[i], from[i]);
+      }
+      return;
+    }
+    if (w < LED_TRANSITION_FULL) {
+      led_store_rgb(&px[i], led_lerp_px(from[i], led_pack_rgb(px[i]), w));
+    }
+  }
+}
+
+// smoothstep p^2 * (3 - 2p) in 8.8
+static uint32_t ease(uint32_t p) {
+  return (p * p * (3 * LED_TRANSITION_FULL - 2 * p)) >> 16;
+}
+
+void led_transition_blend(led_transition_type_t type, const uint32_t *from,
+                          rgb_t *px, int n, uint32_t progress) {
+  if (progress >= LED_TRANSITION_FULL) {
+    return;
+  }
+
+  switch (type) {
+  case LED_TRANSITION_LINEAR:
+    blend_uniform(from, px, n, progress);
+    break;
+  case LED_TRANSITION_EASE:
+    blend_uniform(from, px, n, ease(progress));
+    break;
+  case LED_TRANSITION_WIPE:
+    blend_wipe(from, px, n, progress);
+    break;
+  default:
+    break;
+  }
+}
+
+static inline uint16_t lerp16(uint16_t a, uint16_t b, uint32_t w) {
+  return ((uint32_t)a * (LED_WEIGHT_FULL - w) + (uint32_t)b * w) >> 8;
+}
+
+static inline void blend16(const rgb16_t *from, rgb16_t *px, uint32_t w) {
+  px->r = lerp16(from->r, px->r, w);
+  px->g = lerp16(from->g, px->g, w);
+  px->b = lerp16(from->b, px->b, w);
+}
+
+void led_transition_blend16(led_transition_type_t type, const rgb16_t *from,
+                            rgb16_t *px, int n, uint32_t progress) {
+  if (progress >= LED_TRANSITION_FULL) {
+    return;
+  }
+
+  switch (type) {
+  case LED_TRANSITION_LINEAR:
+  case LED_TRANSITION_EASE: {
+    uint32_t w = type == LED_TRANSITION_EASE ? ease(progress) : progress;
+    for (int i = 0; i < n; i++) {
+      blend16(&from[i], &px[i], w);
+    }
+    break;
+  }
+  case LED_TRANSITION_WIPE: {
+    // as blend_wipe
+    int32_t edge = (int32_t)progress * (n + WIPE_EDGE);
+    for (int i = 0; i < n; i++) {
+      int32_t w = (edge - i * LED_TRANSITION_FULL) / WIPE_EDGE;
+      if (w <= 0) {
+        px[i] = from[i];
+      } else if (w < LED_TRANSITION_FULL) {
+        blend16(&from[i], &px[i], w);
+      }
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+const char *led_transition_name(led_transition_type_t type) {
+  return type < LED_TRANSITION_COUNT ? s_names[type] : "?";
+}
+
+int led_transition_from_name(const char *name) {
+  for (int i = 0; i < LED_TRANSITION_COUNT; i++) {
+    if (strcmp(name, s_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
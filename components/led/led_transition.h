@@ -0,0 +1,30 @@
+#ifndef LED_TRANSITION_H
+#define LED_TRANSITION_H
+
+#include "led_blend.h"
+#include <stdint.h>
+
+typedef enum {
+  LED_TRANSITION_NONE, // hard cut
+  LED_TRANSITION_LINEAR,
+  LED_TRANSITION_EASE, // smoothstep, slow start and end
+  LED_TRANSITION_WIPE, // soft edge running along the strip
+  LED_TRANSITION_COUNT,
+} led_transition_type_t;
+
+// Progress is 8.8 fixed point: 0 = all outgoing, 256 = all incoming
+#define LED_TRANSITION_FULL LED_WEIGHT_FULL
+
+// Blend the packed outgoing frame into px (the incoming frame) in place
+void led_transition_blend(led_transition_type_t type, const uint32_t *from,
+                          rgb_t *px, int n, uint32_t progress);
+
+// Same at 16 bits per channel, for the base layer with CONFIG_LED_HIGH_DEPTH
+void led_transition_blend16(led_transition_type_t type, const rgb16_t *from,
+                            rgb16_t *px, int n, uint32_t progress);
+
+// "linear", "ease", ... and back, -1 for unknown names
+const char *led_transition_name(led_transition_type_t type);
+int led_transition_from_name(const char *name);
+
+#endif
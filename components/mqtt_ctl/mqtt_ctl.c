@@ -0,0 +1,456 @@
+#include "mqtt_ctl.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "led_effects.h"
+#include "led_render.h"
+#include "mqtt_client.h"
+#include "scene.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CONFIG_MQTT_CTL_ENABLED
+
+#define MQTT_CTL_TASK_STACK 4096
+// below the render task, above idle work
+#define MQTT_CTL_TASK_PRIORITY 4
+#define MQTT_CTL_TOPIC_MAX 64
+// longest command we take, an effect with text
+#define MQTT_CTL_PAYLOAD_MAX 96
+
+static const char *TAG = "mqtt_ctl";
+
+typedef enum {
+  BASE_NONE,
+  BASE_PLAY, // color or effect
+  BASE_SCENE,
+} base_kind_t;
+
+// Newest command of each kind, written by the MQTT task and taken by ours.
+// seq keeps the order between the two when both are pending.
+typedef struct {
+  base_kind_t kind;
+  uint32_t seq;
+  led_effect_id_t effect;
+  led_effect_params_t params;
+  uint32_t duration_ms;
+  int scene;
+} base_cmd_t;
+
+typedef struct {
+  bool set;
+  uint32_t seq;
+  uint8_t level;
+} brightness_cmd_t;
+
+static esp_mqtt_client_handle_t s_client = NULL;
+static TaskHandle_t s_task = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static base_cmd_t s_base;
+static brightness_cmd_t s_brightness;
+static uint32_t s_seq = 0;
+static mqtt_ctl_stats_t s_stats;
+
+static char s_hub[32];
+static char s_set_prefix[MQTT_CTL_TOPIC_MAX]; // <prefix>/<hub>/set/
+
+// Owned by the apply task
+static scene_t s_last_state;
+static bool s_state_sent = false;
+static int64_t s_state_us = 0;
+static uint32_t s_seen_connects = 0;
+static mqtt_ctl_stats_t s_last_metrics;
+static uint32_t s_last_fps = 0;
+static int64_t s_metrics_us = 0;
+
+static void topic(char *buf, size_t len, const char *leaf) {
+  snprintf(buf, len, "%s/%s/%s", CONFIG_MQTT_CTL_TOPIC_PREFIX, s_hub, leaf);
+}
+
+// --- commands, on the MQTT task ---
+
+static bool parse_u8(const char *s, uint8_t *out) {
+  char *end;
+  long v = strtol(s, &end, 10);
+  if (end == s || v < 0 || v > 255) {
+    return false;
+  }
+  *out = v;
+  return true;
+}
+
+// "255,0,0" or "#ff0000"
+static bool parse_color(const char *s, led_effect_params_t *p) {
+  if (s[0] == '#') {
+    char *end;
+    unsigned long v = strtoul(s + 1, &end, 16);
+    if (end - s != 7) {
+      return false;
+    }
+    p->r = v >> 16;
+    p->g = v >> 8;
+    p->b = v;
+    return true;
+  }
+  return sscanf(s, "%hhu,%hhu,%hhu", &p->r, &p->g, &p->b) == 3;
+}
+
+// "name key=value ...", text= takes the rest
+static bool parse_effect(char *s, base_cmd_t *cmd) {
+  led_effect_params_t *p = &cmd->params;
+  // what the HTTP handlers use when a parameter is left out
+  p->speed = 3;
+  p->delay_ms = 50;
+
+  // the rest of the message, spaces included; cut off before tokenizing
+  char *text = strstr(s, " text=");
+  if (text) {
+    *text = '\0';
+    strncpy(p->text, text + 6, sizeof(p->text) - 1);
+  }
+
+  char *save = NULL;
+  char *name = strtok_r(s, " ", &save);
+  int id = name ? led_effect_from_name(name) : -1;
+  if (id < 0) {
+    return false;
+  }
+  cmd->effect = id;
+
+  char *tok;
+  while ((tok = strtok_r(NULL, " ", &save))) {
+    char *eq = strchr(tok, '=');
+    if (!eq) {
+      return false;
+    }
+    *eq = '\0';
+    const char *v = eq + 1;
+    bool ok = true;
+    if (strcmp(tok, "r") == 0) {
+      ok = parse_u8(v, &p->r);
+    } else if (strcmp(tok, "g") == 0) {
+      ok = parse_u8(v, &p->g);
+    } else if (strcmp(tok, "b") == 0) {
+      ok = parse_u8(v, &p->b);
+    } else if (strcmp(tok, "speed") == 0) {
+      ok = parse_u8(v, &p->speed);
+    } else if (strcmp(tok, "delay") == 0) {
+      p->delay_ms = atoi(v);
+    } else if (strcmp(tok, "duration") == 0) {
+      cmd->duration_ms = strtoul(v, NULL, 10);
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool handle_command(const char *what, char *payload) {
+  if (strcmp(what, "brightness") == 0) {
+    uint8_t level;
+    if (!parse_u8(payload, &level)) {
+      return false;
+    }
+    portENTER_CRITICAL(&s_lock);
+    if (s_brightness.set) {
+      s_stats.coalesced++;
+    }
+    s_brightness = (brightness_cmd_t){true, ++s_seq, level};
+    portEXIT_CRITICAL(&s_lock);
+    return true;
+  }
+
+  base_cmd_t cmd = {.kind = BASE_PLAY, .effect = LED_EFFECT_SOLID};
+  if (strcmp(what, "color") == 0) {
+    if (!parse_color(payload, &cmd.params)) {
+      return false;
+    }
+  } else if (strcmp(what, "effect") == 0) {
+    if (!parse_effect(payload, &cmd)) {
+      return false;
+    }
+  } else if (strcmp(what, "scene") == 0) {
+    char *end;
+    cmd.kind = BASE_SCENE;
+    cmd.scene = strtol(payload, &end, 10);
+    if (end == payload) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  if (s_base.kind != BASE_NONE) {
+    s_stats.coalesced++;
+  }
+  cmd.seq = ++s_seq;
+  s_base = cmd;
+  portEXIT_CRITICAL(&s_lock);
+  return true;
+}
+
+static void on_data(esp_mqtt_event_handle_t ev) {
+  size_t prefix_len = strlen(s_set_prefix);
+  char what[16];
+  char payload[MQTT_CTL_PAYLOAD_MAX + 1];
+
+  // fragments only come for messages far over the limit
+  bool ok = ev->data_len == ev->total_data_len &&
+            ev->data_len <= MQTT_CTL_PAYLOAD_MAX &&
+            ev->topic_len > prefix_len &&
+            ev->topic_len - prefix_len < sizeof(what) &&
+            memcmp(ev->topic, s_set_prefix, prefix_len) == 0;
+  if (ok) {
+    memcpy(what, ev->topic + prefix_len, ev->topic_len - prefix_len);
+    what[ev->topic_len - prefix_len] = '\0';
+    memcpy(payload, ev->data, ev->data_len);
+    payload[ev->data_len] = '\0';
+    ok = handle_command(what, payload);
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  s_stats.received++;
+  if (!ok) {
+    s_stats.rejected++;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (ok) {
+    xTaskNotifyGive(s_task);
+  } else {
+    ESP_LOGW(TAG, "Rejected %.*s", ev->topic_len, ev->topic);
+  }
+}
+
+static void publish(const char *leaf, const char *msg, bool retain) {
+  char t[MQTT_CTL_TOPIC_MAX];
+  topic(t, sizeof(t), leaf);
+  // queued for the MQTT task, never waits for the network
+  if (esp_mqtt_client_enqueue(s_client, t, msg, 0, 0, retain, true) >= 0) {
+    portENTER_CRITICAL(&s_lock);
+    s_stats.published++;
+    portEXIT_CRITICAL(&s_lock);
+  }
+}
+
+static void mqtt_event(void *arg, esp_event_base_t base, int32_t id,
+                       void *data) {
+  esp_mqtt_event_handle_t ev = data;
+  switch ((esp_mqtt_event_id_t)id) {
+  case MQTT_EVENT_CONNECTED: {
+    char t[MQTT_CTL_TOPIC_MAX + 1];
+    snprintf(t, sizeof(t), "%s+", s_set_prefix);
+    esp_mqtt_client_subscribe(s_client, t, 0);
+    portENTER_CRITICAL(&s_lock);
+    s_stats.connected = true;
+    s_stats.connects++;
+    portEXIT_CRITICAL(&s_lock);
+    publish("status", "online", true);
+    ESP_LOGI(TAG, "Connected, commands on %s", t);
+    xTaskNotifyGive(s_task);
+    break;
+  }
+  case MQTT_EVENT_DISCONNECTED:
+    portENTER_CRITICAL(&s_lock);
+    s_stats.connected = false;
+    portEXIT_CRITICAL(&s_lock);
+    break;
+  case MQTT_EVENT_DATA:
+    on_data(ev);
+    break;
+  default:
+    break;
+  }
+}
+
+// --- apply and publish, on our task ---
+
+static void apply_base(const base_cmd_t *cmd) {
+  if (cmd->kind == BASE_SCENE) {
+    if (scene_apply(cmd->scene) != ESP_OK) {
+      ESP_LOGW(TAG, "No scene %d", cmd->scene);
+    }
+  } else {
+    led_render_play(cmd->effect, &cmd->params, cmd->duration_ms);
+  }
+}
+
+static void apply_pending(void) {
+  portENTER_CRITICAL(&s_lock);
+  base_cmd_t base = s_base;
+  brightness_cmd_t bri = s_brightness;
+  s_base.kind = BASE_NONE;
+  s_brightness.set = false;
+  s_stats.applied += (base.kind != BASE_NONE) + bri.set;
+  portEXIT_CRITICAL(&s_lock);
+
+  // in the order they came, a scene carries its own brightness
+  if (bri.set && (base.kind == BASE_NONE || bri.seq < base.seq)) {
+    led_render_set_brightness(bri.level);
+    bri.set = false;
+  }
+  if (base.kind != BASE_NONE) {
+    apply_base(&base);
+  }
+  if (bri.set) {
+    led_render_set_brightness(bri.level);
+  }
+}
+
+static void publish_state(int64_t now) {
+  scene_t st;
+  scene_get_current(&st);
+  if (s_state_sent && memcmp(&st, &s_last_state, sizeof(st)) == 0) {
+    return;
+  }
+  if (now - s_state_us < (int64_t)CONFIG_MQTT_CTL_STATE_MIN_MS * 1000) {
+    return; // picked up on a later round
+  }
+
+  const led_effect_t *fx = led_effect_get(st.effect);
+  char msg[160];
+  snprintf(msg, sizeof(msg),
+           "{\"effect\":\"%s\",\"r\":%u,\"g\":%u,\"b\":%u,\"speed\":%u,"
+           "\"brightness\":%u}",
+           fx ? fx->name : "", st.params.r, st.params.g, st.params.b,
+           st.params.speed, st.brightness);
+  publish("state", msg, true);
+  s_last_state = st;
+  s_state_sent = true;
+  s_state_us = now;
+}
+
+static void publish_metrics(int64_t now) {
+  if (now - s_metrics_us < (int64_t)CONFIG_MQTT_CTL_METRICS_MS * 1000) {
+    return;
+  }
+  led_render_stats_t rs;
+  led_render_get_stats(&rs);
+  mqtt_ctl_stats_t ms;
+  mqtt_ctl_get_stats(&ms);
+  // published is left out, it would count this message itself
+  ms.published = s_last_metrics.published;
+  if (rs.fps == s_last_fps && memcmp(&ms, &s_last_metrics, sizeof(ms)) == 0) {
+    return;
+  }
+
+  char msg[192];
+  snprintf(msg, sizeof(msg),
+           "{\"fps\":%lu,\"render_us_avg\":%lu,\"render_us_max\":%lu,"
+           "\"received\":%lu,\"applied\":%lu,\"coalesced\":%lu,"
+           "\"rejected\":%lu,\"connects\":%lu}",
+           (unsigned long)rs.fps, (unsigned long)rs.render_us_avg,
+           (unsigned long)rs.render_us_max, (unsigned long)ms.received,
+           (unsigned long)ms.applied, (unsigned long)ms.coalesced,
+           (unsigned long)ms.rejected, (unsigned long)ms.connects);
+  publish("metrics", msg, false);
+  s_last_metrics = ms;
+  s_last_fps = rs.fps;
+  s_metrics_us = now;
+}
+
+static void mqtt_ctl_task(void *arg) {
+  // at most one update per frame, whatever came in meanwhile waits
+  TickType_t frame = pdMS_TO_TICKS(1000 / CONFIG_LED_FRAME_RATE);
+  TickType_t idle = pdMS_TO_TICKS(CONFIG_MQTT_CTL_STATE_MIN_MS);
+  if (frame < 1) {
+    frame = 1;
+  }
+  if (idle < frame) {
+    idle = frame;
+  }
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, idle);
+    apply_pending();
+
+    mqtt_ctl_stats_t st;
+    mqtt_ctl_get_stats(&st);
+    if (st.connects != s_seen_connects) {
+      s_seen_connects = st.connects;
+      s_state_sent = false; // state again for whoever missed it
+    }
+    // nothing is queued while the client is reconnecting
+    if (st.connected) {
+      int64_t now = esp_timer_get_time();
+      publish_state(now);
+      publish_metrics(now);
+    }
+    vTaskDelay(frame);
+  }
+}
+
+esp_err_t mqtt_ctl_start(void) {
+  if (s_client) {
+    return ESP_OK;
+  }
+  if (!CONFIG_MQTT_CTL_BROKER_URI[0]) {
+    ESP_LOGW(TAG, "No broker configured, MQTT control off");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (CONFIG_MQTT_CTL_HUB_ID[0]) {
+    strncpy(s_hub, CONFIG_MQTT_CTL_HUB_ID, sizeof(s_hub) - 1);
+  } else {
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(s_hub, sizeof(s_hub), "hub-%02x%02x%02x", mac[3], mac[4],
+             mac[5]);
+  }
+  topic(s_set_prefix, sizeof(s_set_prefix), "set/");
+
+  static char will_topic[MQTT_CTL_TOPIC_MAX];
+  topic(will_topic, sizeof(will_topic), "status");
+  const esp_mqtt_client_config_t cfg = {
+      .broker.address.uri = CONFIG_MQTT_CTL_BROKER_URI,
+      .credentials.client_id = s_hub,
+      .session.last_will = {.topic = will_topic,
+                            .msg = "offline",
+                            .qos = 1,
+                            .retain = 1},
+      .network.reconnect_timeout_ms = CONFIG_MQTT_CTL_RECONNECT_MS,
+  };
+
+  if (xTaskCreatePinnedToCore(mqtt_ctl_task, "mqtt_ctl", MQTT_CTL_TASK_STACK,
+                              NULL, MQTT_CTL_TASK_PRIORITY, &s_task,
+                              0) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start MQTT control task!");
+    return ESP_ERR_NO_MEM;
+  }
+
+  s_client = esp_mqtt_client_init(&cfg);
+  if (!s_client) {
+    return ESP_FAIL;
+  }
+  esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event,
+                                 NULL);
+  // connects on its own task, retrying every CONFIG_MQTT_CTL_RECONNECT_MS
+  esp_err_t err = esp_mqtt_client_start(s_client);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Client start failed: %s", esp_err_to_name(err));
+  }
+  return err;
+}
+
+void mqtt_ctl_get_stats(mqtt_ctl_stats_t *out) {
+  portENTER_CRITICAL(&s_lock);
+  *out = s_stats;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+#else
+
+esp_err_t mqtt_ctl_start(void) { return ESP_ERR_NOT_SUPPORTED; }
+
+void mqtt_ctl_get_stats(mqtt_ctl_stats_t *out) {
+  *out = (mqtt_ctl_stats_t){0};
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MQTT_CTL_H
+#define MQTT_CTL_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Commands over MQTT, one message per topic (Kconfig "MQTT control" for
+// prefix and hub id):
+//
+//   <prefix>/<hub>/set/color       255,0,0 or #ff0000
+//   <prefix>/<hub>/set/effect      plasma speed=3 duration=0
+//   <prefix>/<hub>/set/scene       2
+//   <prefix>/<hub>/set/brightness  0-255
+//
+// effect takes the effect name and optionally r, g, b, speed (default 3),
+// delay (default 50 ms) and duration; text= takes the rest of the message,
+// so it goes last. Messages are not applied one by one: the newest
+// color/effect/scene and the newest brightness are kept and picked up at
+// most once per frame, so a burst costs one update.
+//
+// Published: <prefix>/<hub>/state (retained JSON, when it changes),
+// <prefix>/<hub>/metrics (JSON) and <prefix>/<hub>/status (online/offline).
+//
+// host_test/test_mqtt_ctl checks the coalescing without a broker,
+// tools/mqtt_burst.py runs a burst through a real one.
+
+typedef struct {
+  bool connected;
+  uint32_t connects;
+  uint32_t received;  // command messages
+  uint32_t applied;   // updates handed to the render task
+  uint32_t coalesced; // replaced by a newer one before being applied
+  uint32_t rejected;  // unknown topic or bad payload
+  uint32_t published;
+} mqtt_ctl_stats_t;
+
+// Start the client and the task that applies commands. Call after
+// wifi_connect(); the client connects and reconnects in the background
+// and nothing here waits for the broker. ESP_ERR_INVALID_STATE when no
+// broker URI is configured.
+esp_err_t mqtt_ctl_start(void);
+
+void mqtt_ctl_get_stats(mqtt_ctl_stats_t *out);
+
+#endif
@@ -0,0 +1,258 @@
+#include "scene.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "led_render.h"
+#include "nvs_flash.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NVS_NAMESPACE "scenes"
+#define LAST_KEY "last"
+// bump when scene_t changes, blobs of other versions are ignored
+#define SCENE_VERSION 1
+
+static const char *TAG = "scene";
+
+typedef struct {
+  uint8_t version;
+  scene_t scene;
+} scene_blob_t;
+
+// Decoded scenes, loaded from NVS once at boot. Guarded by s_lock.
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static scene_t s_scenes[CONFIG_SCENE_MAX];
+static bool s_valid[CONFIG_SCENE_MAX];
+
+// Active scene, updated by the render change hook from any task
+static scene_t s_current;
+static bool s_current_valid = false;
+static int64_t s_dirty_since_us = 0; // 0 = nothing waiting to be saved
+
+// What the "last" key holds, owned by the save timer after boot
+static scene_t s_saved;
+static bool s_saved_valid = false;
+static esp_timer_handle_t s_save_timer = NULL;
+
+static void scene_key(int id, char *key, size_t size) {
+  snprintf(key, size, "s%d", id);
+}
+
+static bool load_blob(nvs_handle_t nvs_handle, const char *key,
+                      scene_t *out) {
+  scene_blob_t blob;
+  size_t len = sizeof(blob);
+  if (nvs_get_blob(nvs_handle, key, &blob, &len) != ESP_OK ||
+      len != sizeof(blob) || blob.version != SCENE_VERSION ||
+      blob.scene.effect >= LED_EFFECT_COUNT) {
+    return false;
+  }
+  blob.scene.params.text[LED_TEXT_MAX - 1] = '\0';
+  *out = blob.scene;
+  return true;
+}
+
+static esp_err_t store_blob(const char *key, const scene_t *scene) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  scene_blob_t blob = {.version = SCENE_VERSION, .scene = *scene};
+  err = nvs_set_blob(nvs_handle, key, &blob, sizeof(blob));
+  if (err == ESP_OK) {
+    err = nvs_commit(nvs_handle);
+  }
+  nvs_close(nvs_handle);
+  return err;
+}
+
+// Save timer: write the active scene once the changes have settled, and
+// only if it differs from what is already in flash
+static void save_last(void *arg) {
+  portENTER_CRITICAL(&s_lock);
+  scene_t cur = s_current;
+  s_dirty_since_us = 0;
+  portEXIT_CRITICAL(&s_lock);
+
+  if (s_saved_valid && memcmp(&cur, &s_saved, sizeof(cur)) == 0) {
+    return;
+  }
+  esp_err_t err = store_blob(LAST_KEY, &cur);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to save active scene: %s", esp_err_to_name(err));
+    return;
+  }
+  s_saved = cur;
+  s_saved_valid = true;
+  ESP_LOGI(TAG, "Saved active scene (%s)", led_effect_get(cur.effect)->name);
+}
+
+// led_render change hook. Every change pushes the write back by
+// CONFIG_SCENE_SAVE_DELAY_MS, but never past CONFIG_SCENE_SAVE_MAX_DELAY_MS
+// from the first unsaved change.
+static void on_change(led_effect_id_t id, const led_effect_params_t *params,
+                      uint32_t duration_ms, uint8_t brightness) {
+  if (duration_ms) {
+    return; // timed effects (self-test etc.) are not scenes
+  }
+
+  scene_t scene;
+  memset(&scene, 0, sizeof(scene));
+  scene.effect = id;
+  scene.brightness = brightness;
+  scene.params = *params;
+
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&s_lock);
+  s_current = scene;
+  s_current_valid = true;
+  if (s_dirty_since_us == 0) {
+    s_dirty_since_us = now;
+  }
+  bool overdue = now - s_dirty_since_us >=
+                 (int64_t)CONFIG_SCENE_SAVE_MAX_DELAY_MS * 1000;
+  portEXIT_CRITICAL(&s_lock);
+
+  if (!overdue || !esp_timer_is_active(s_save_timer)) {
+    esp_timer_stop(s_save_timer);
+    esp_timer_start_once(s_save_timer,
+                         (uint64_t)CONFIG_SCENE_SAVE_DELAY_MS * 1000);
+  }
+}
+
+static void play(const scene_t *scene) {
+  led_render_play_at((led_effect_id_t)scene->effect, &scene->params, 0,
+                     scene->brightness);
+}
+
+esp_err_t scene_init(void) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+  if (err == ESP_OK) {
+    int count = 0;
+    for (int i = 0; i < CONFIG_SCENE_MAX; i++) {
+      char key[8];
+      scene_key(i, key, sizeof(key));
+      s_valid[i] = load_blob(nvs_handle, key, &s_scenes[i]);
+      count += s_valid[i];
+    }
+    s_saved_valid = load_blob(nvs_handle, LAST_KEY, &s_saved);
+    nvs_close(nvs_handle);
+    ESP_LOGI(TAG, "Loaded %d scenes%s", count,
+             s_saved_valid ? " and the last active one" : "");
+  } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+    ESP_LOGW(TAG, "Failed to open scene store: %s", esp_err_to_name(err));
+  }
+
+  const esp_timer_create_args_t timer_args = {
+      .callback = save_last,
+      .name = "scene_save",
+  };
+  err = esp_timer_create(&timer_args, &s_save_timer);
+  if (err != ESP_OK) {
+    return err;
+  }
+  led_render_set_change_hook(on_change);
+  return ESP_OK;
+}
+
+esp_err_t scene_restore_last(void) {
+  if (!s_saved_valid) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  ESP_LOGI(TAG, "Restoring last scene (%s)",
+           led_effect_get(s_saved.effect)->name);
+  play(&s_saved);
+  return ESP_OK;
+}
+
+bool scene_get(int id, scene_t *out) {
+  if (id < 0 || id >= CONFIG_SCENE_MAX) {
+    return false;
+  }
+  portENTER_CRITICAL(&s_lock);
+  bool valid = s_valid[id];
+  if (valid) {
+    *out = s_scenes[id];
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return valid;
+}
+
+void scene_get_current(scene_t *out) {
+  portENTER_CRITICAL(&s_lock);
+  *out = s_current;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t scene_apply(int id) {
+  if (id < 0 || id >= CONFIG_SCENE_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  scene_t scene;
+  if (!scene_get(id, &scene)) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  play(&scene);
+  return ESP_OK;
+}
+
+esp_err_t scene_save(int id, const scene_t *scene) {
+  if (id < 0 || id >= CONFIG_SCENE_MAX ||
+      scene->effect >= LED_EFFECT_COUNT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  char key[8];
+  scene_key(id, key, sizeof(key));
+  esp_err_t err = store_blob(key, scene);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to save scene %d: %s", id, esp_err_to_name(err));
+    return err;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  s_scenes[id] = *scene;
+  s_valid[id] = true;
+  portEXIT_CRITICAL(&s_lock);
+  ESP_LOGI(TAG, "Saved scene %d", id);
+  return ESP_OK;
+}
+
+esp_err_t scene_save_current(int id) {
+  portENTER_CRITICAL(&s_lock);
+  bool valid = s_current_valid;
+  scene_t cur = s_current;
+  portEXIT_CRITICAL(&s_lock);
+
+  if (!valid) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return scene_save(id, &cur);
+}
+
+esp_err_t scene_delete(int id) {
+  if (id < 0 || id >= CONFIG_SCENE_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+  if (err != ESP_OK) {
+    return err;
+  }
+  char key[8];
+  scene_key(id, key, sizeof(key));
+  err = nvs_erase_key(nvs_handle, key);
+  if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+    err = nvs_commit(nvs_handle);
+  }
+  nvs_close(nvs_handle);
+
+  portENTER_CRITICAL(&s_lock);
+  s_valid[id] = false;
+  portEXIT_CRITICAL(&s_lock);
+  return err;
+}
@@ -0,0 +1,39 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "esp_err.h"
+#include "led_effects.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// What the base layer plays plus the master brightness
+typedef struct {
+  uint8_t effect; // led_effect_id_t
+  uint8_t brightness;
+  led_effect_params_t params;
+} scene_t;
+
+// Load all scenes and the last active one from NVS into RAM and start
+// tracking changes. Needs nvs_flash_init() and led_render_start().
+esp_err_t scene_init(void);
+
+// Play the last active scene from before the reboot.
+// ESP_ERR_NOT_FOUND if there is none.
+esp_err_t scene_restore_last(void);
+
+// Recall a stored scene, straight from the RAM cache
+esp_err_t scene_apply(int id);
+
+// Store the scene that is playing now in slot id
+esp_err_t scene_save_current(int id);
+
+esp_err_t scene_save(int id, const scene_t *scene);
+esp_err_t scene_delete(int id);
+
+// false if the slot is empty
+bool scene_get(int id, scene_t *out);
+
+// Scene that is playing now (what would be restored after a reboot)
+void scene_get_current(scene_t *out);
+
+#endif
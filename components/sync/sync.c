@@ -0,0 +1,437 @@
+#include "sync.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if CONFIG_SYNC_ENABLED
+
+#define SYNC_TASK_STACK 4096
+// above httpd so beacons are timestamped promptly
+#define SYNC_TASK_PRIORITY 8
+#define SYNC_MAGIC_BEACON 0x4e59534cu // "LSYN"
+#define SYNC_MAGIC_REPLY 0x5259534cu  // "LSYR"
+// follower clock model
+#define SYNC_SAMPLES 16
+#define SYNC_LOCK_SAMPLES 4
+#define SYNC_MAX_DRIFT 500e-6
+// an error this large means the master restarted, start over
+#define SYNC_STEP_US 50000
+#define SYNC_LOST_MS 3000
+// master keeps send times of the last beacons to match replies
+#define SYNC_TX_HISTORY 8
+#define SYNC_NODE_TIMEOUT_MS 5000
+
+static const char *TAG = "sync";
+
+// On the wire, little-endian on both ESP32 and x86 hosts
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t node_id; // sender
+  int64_t time_us;  // beacon: master time at send, reply: follower's estimate
+} sync_packet_t;
+
+static uint32_t s_node_id = 0;
+static TaskHandle_t s_task = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static sync_stats_t s_stats;
+static int64_t s_last_beacon_us = 0;
+
+// Follower clock model: network = local + ref_offset + drift * (local - ref),
+// drift in parts per billion so reading the clock needs no float
+static int64_t s_ref_local_us = 0;
+static int64_t s_ref_offset_us = 0;
+static int64_t s_drift_ppb = 0;
+// Jumps of the network clock (follower locking on or resyncing)
+static uint32_t s_steps = 0;
+static int64_t s_steps_total_us = 0;
+
+// Network minus local time at local, with s_lock held
+static int64_t offset_at(int64_t local_us) {
+  return s_ref_offset_us +
+         s_drift_ppb * (local_us - s_ref_local_us) / 1000000000;
+}
+
+int64_t sync_now_us(void) {
+  int64_t local = esp_timer_get_time();
+  portENTER_CRITICAL(&s_lock);
+  int64_t offset = offset_at(local);
+  portEXIT_CRITICAL(&s_lock);
+  return local + offset;
+}
+
+uint32_t sync_steps(int64_t *total_us) {
+  portENTER_CRITICAL(&s_lock);
+  uint32_t steps = s_steps;
+  *total_us = s_steps_total_us;
+  portEXIT_CRITICAL(&s_lock);
+  return steps;
+}
+
+void sync_get_stats(sync_stats_t *out) {
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&s_lock);
+  *out = s_stats;
+  out->offset_us = offset_at(now);
+  portEXIT_CRITICAL(&s_lock);
+
+  out->beacon_age_ms =
+      s_last_beacon_us ? (uint32_t)((now - s_last_beacon_us) / 1000) : 0;
+  for (int i = 0; i < out->node_count; i++) {
+    out->nodes[i].age_ms = (uint32_t)(now / 1000) - out->nodes[i].age_ms;
+  }
+}
+
+#if !CONFIG_SYNC_ROLE_MASTER
+
+static int64_t s_sample_local[SYNC_SAMPLES];
+static int64_t s_sample_offset[SYNC_SAMPLES];
+static int s_sample_count = 0;
+static int s_sample_next = 0;
+
+// Fit offset against local time over the sample window. One-way network
+// delay only ever makes a sample look early, so the fitted line is moved up
+// to the least delayed sample.
+static void follower_refit(void) {
+  int n = s_sample_count;
+  int64_t ref = s_sample_local[(s_sample_next + SYNC_SAMPLES - 1) %
+                               SYNC_SAMPLES];
+  int64_t base = s_sample_offset[(s_sample_next + SYNC_SAMPLES - 1) %
+                                 SYNC_SAMPLES];
+
+  double mx = 0, my = 0;
+  for (int i = 0; i < n; i++) {
+    mx += (double)(s_sample_local[i] - ref);
+    my += (double)(s_sample_offset[i] - base);
+  }
+  mx /= n;
+  my /= n;
+
+  double sxx = 0, sxy = 0;
+  for (int i = 0; i < n; i++) {
+    double dx = (double)(s_sample_local[i] - ref) - mx;
+    double dy = (double)(s_sample_offset[i] - base) - my;
+    sxx += dx * dx;
+    sxy += dx * dy;
+  }
+  double drift = sxx > 0 ? sxy / sxx : 0;
+  if (drift > SYNC_MAX_DRIFT) {
+    drift = SYNC_MAX_DRIFT;
+  } else if (drift < -SYNC_MAX_DRIFT) {
+    drift = -SYNC_MAX_DRIFT;
+  }
+
+  // intercept at ref, then lift to the upper envelope
+  double b = my - drift * mx;
+  double lift = -1e18;
+  for (int i = 0; i < n; i++) {
+    double x = (double)(s_sample_local[i] - ref);
+    double r = (double)(s_sample_offset[i] - base) - (b + drift * x);
+    if (r > lift) {
+      lift = r;
+    }
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  s_ref_local_us = ref;
+  s_ref_offset_us = base + (int64_t)(b + lift);
+  s_drift_ppb = (int64_t)(drift * 1e9);
+  s_stats.drift_ppb = (int32_t)s_drift_ppb;
+  s_stats.locked = n >= SYNC_LOCK_SAMPLES;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+static void follower_add_sample(int64_t local_us, int64_t master_us) {
+  int64_t offset = master_us - local_us;
+  portENTER_CRITICAL(&s_lock);
+  int64_t predicted = offset_at(local_us);
+  portEXIT_CRITICAL(&s_lock);
+
+  if (s_sample_count > 0) {
+    int64_t err = offset - predicted;
+    if (err > SYNC_STEP_US || err < -SYNC_STEP_US) {
+      ESP_LOGW(TAG, "Clock step of %lld us, resyncing", (long long)err);
+      s_sample_count = 0;
+      s_sample_next = 0;
+    } else {
+      int32_t abs_err = (int32_t)(err < 0 ? -err : err);
+      s_stats.residual_us += (abs_err - s_stats.residual_us) / 8;
+    }
+  }
+
+  s_sample_local[s_sample_next] = local_us;
+  s_sample_offset[s_sample_next] = offset;
+  s_sample_next = (s_sample_next + 1) % SYNC_SAMPLES;
+  if (s_sample_count < SYNC_SAMPLES) {
+    s_sample_count++;
+  }
+  follower_refit();
+
+  if (s_sample_count == 1) {
+    // first sample or a resync: the clock jumps, tell whoever holds times
+    // on it how far
+    portENTER_CRITICAL(&s_lock);
+    s_steps++;
+    s_steps_total_us += offset_at(local_us) - predicted;
+    portEXIT_CRITICAL(&s_lock);
+  }
+}
+
+static int open_socket(void) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    return -1;
+  }
+
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(CONFIG_SYNC_PORT),
+      .sin_addr.s_addr = htonl(INADDR_ANY),
+  };
+  struct ip_mreq mreq = {
+      .imr_multiaddr.s_addr = inet_addr(CONFIG_SYNC_GROUP_ADDR),
+      .imr_interface.s_addr = htonl(INADDR_ANY),
+  };
+  // joining fails until an interface is up, the task retries
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) <
+          0) {
+    close(sock);
+    return -1;
+  }
+
+  struct timeval tv = {.tv_sec = 1};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ESP_LOGI(TAG, "Following clock on %s:%d", CONFIG_SYNC_GROUP_ADDR,
+           CONFIG_SYNC_PORT);
+  return sock;
+}
+
+static void sync_step(int sock) {
+  sync_packet_t pkt;
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  int len = recvfrom(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&from,
+                     &from_len);
+  int64_t rx_us = esp_timer_get_time();
+
+  if (s_last_beacon_us && rx_us - s_last_beacon_us > SYNC_LOST_MS * 1000) {
+    portENTER_CRITICAL(&s_lock);
+    s_stats.locked = false;
+    portEXIT_CRITICAL(&s_lock);
+  }
+  if (len != sizeof(pkt) || pkt.magic != SYNC_MAGIC_BEACON) {
+    return;
+  }
+
+  follower_add_sample(rx_us, pkt.time_us);
+  s_last_beacon_us = rx_us;
+  s_stats.beacons++;
+
+  // answer with our estimate so the master can measure the real skew
+  sync_packet_t reply = {
+      .magic = SYNC_MAGIC_REPLY,
+      .seq = pkt.seq,
+      .node_id = s_node_id,
+      .time_us = sync_now_us(),
+  };
+  sendto(sock, &reply, sizeof(reply), 0, (struct sockaddr *)&from, from_len);
+}
+
+#else // CONFIG_SYNC_ROLE_MASTER
+
+static int64_t s_tx_time[SYNC_TX_HISTORY];
+static uint32_t s_seq = 0;
+static int64_t s_next_beacon_us = 0;
+
+static int open_socket(void) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    return -1;
+  }
+  uint8_t ttl = 1;
+  uint8_t loop = 1;
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  ESP_LOGI(TAG, "Time master, beacons to %s:%d every %d ms",
+           CONFIG_SYNC_GROUP_ADDR, CONFIG_SYNC_PORT,
+           CONFIG_SYNC_BEACON_INTERVAL_MS);
+  return sock;
+}
+
+// Reply to beacon `seq`: the follower's clock is compared with the midpoint
+// of the round trip
+static void master_handle_reply(const sync_packet_t *pkt, int64_t rx_us) {
+  if (s_seq - pkt->seq >= SYNC_TX_HISTORY) {
+    return;
+  }
+  int64_t tx_us = s_tx_time[pkt->seq % SYNC_TX_HISTORY];
+  int32_t skew = (int32_t)(pkt->time_us - (tx_us + rx_us) / 2);
+  uint32_t rtt = (uint32_t)(rx_us - tx_us);
+  uint32_t now_ms = (uint32_t)(rx_us / 1000);
+
+  portENTER_CRITICAL(&s_lock);
+  // find the node, or take a free or timed-out slot
+  int slot = -1;
+  for (int i = 0; i < s_stats.node_count; i++) {
+    if (s_stats.nodes[i].id == pkt->node_id) {
+      slot = i;
+      break;
+    }
+    if (now_ms - s_stats.nodes[i].age_ms > SYNC_NODE_TIMEOUT_MS) {
+      slot = i;
+    }
+  }
+  if (slot < 0 && s_stats.node_count < SYNC_MAX_NODES) {
+    slot = s_stats.node_count++;
+  }
+  if (slot >= 0) {
+    sync_node_t *node = &s_stats.nodes[slot];
+    if (node->id != pkt->node_id) {
+      *node = (sync_node_t){.id = pkt->node_id, .skew_us = skew};
+    }
+    node->skew_us += (skew - node->skew_us) / 4;
+    node->rtt_us = rtt;
+    // stored as a timestamp, sync_get_stats turns it into an age
+    node->age_ms = now_ms;
+
+    // spread over the master (0) and all live followers
+    int32_t lo = 0, hi = 0;
+    for (int i = 0; i < s_stats.node_count; i++) {
+      if (now_ms - s_stats.nodes[i].age_ms > SYNC_NODE_TIMEOUT_MS) {
+        continue;
+      }
+      if (s_stats.nodes[i].skew_us < lo) {
+        lo = s_stats.nodes[i].skew_us;
+      }
+      if (s_stats.nodes[i].skew_us > hi) {
+        hi = s_stats.nodes[i].skew_us;
+      }
+    }
+    s_stats.max_skew_us = hi - lo;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+static void sync_step(int sock) {
+  int64_t now = esp_timer_get_time();
+
+  if (now >= s_next_beacon_us) {
+    struct sockaddr_in group = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_SYNC_PORT),
+        .sin_addr.s_addr = inet_addr(CONFIG_SYNC_GROUP_ADDR),
+    };
+    sync_packet_t pkt = {
+        .magic = SYNC_MAGIC_BEACON,
+        .seq = ++s_seq,
+        .node_id = s_node_id,
+    };
+    pkt.time_us = esp_timer_get_time();
+    s_tx_time[pkt.seq % SYNC_TX_HISTORY] = pkt.time_us;
+    if (sendto(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&group,
+               sizeof(group)) == sizeof(pkt)) {
+      s_stats.beacons++;
+      s_last_beacon_us = pkt.time_us;
+    }
+    s_next_beacon_us = now + CONFIG_SYNC_BEACON_INTERVAL_MS * 1000;
+  }
+
+  // collect replies until the next beacon is due
+  int64_t wait_us = s_next_beacon_us - esp_timer_get_time();
+  if (wait_us < 0) {
+    wait_us = 0;
+  }
+  struct timeval tv = {.tv_sec = wait_us / 1000000,
+                       .tv_usec = wait_us % 1000000};
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(sock, &fds);
+  if (select(sock + 1, &fds, NULL, NULL, &tv) <= 0) {
+    return;
+  }
+
+  sync_packet_t pkt;
+  int len = recv(sock, &pkt, sizeof(pkt), 0);
+  int64_t rx_us = esp_timer_get_time();
+  if (len == sizeof(pkt) && pkt.magic == SYNC_MAGIC_REPLY) {
+    master_handle_reply(&pkt, rx_us);
+  }
+}
+
+#endif
+
+static void sync_task(void *arg) {
+  int sock = -1;
+  for (;;) {
+    if (sock < 0) {
+      sock = open_socket();
+      if (sock < 0) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        continue;
+      }
+    }
+    sync_step(sock);
+  }
+}
+
+esp_err_t sync_start(void) {
+  if (s_task) {
+    return ESP_OK;
+  }
+
+  s_node_id = esp_random();
+#if CONFIG_SYNC_ROLE_MASTER
+  // the master's clock is the network clock
+  s_stats.master = true;
+  s_stats.locked = true;
+#endif
+
+  // networking core
+  if (xTaskCreatePinnedToCore(sync_task, "sync", SYNC_TASK_STACK, NULL,
+                              SYNC_TASK_PRIORITY, &s_task, 0) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start sync task!");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+#else
+
+esp_err_t sync_start(void) { return ESP_ERR_NOT_SUPPORTED; }
+
+int64_t sync_now_us(void) { return esp_timer_get_time(); }
+
+uint32_t sync_steps(int64_t *total_us) {
+  *total_us = 0;
+  return 0;
+}
+
+void sync_get_stats(sync_stats_t *out) { *out = (sync_stats_t){0}; }
+
+#endif
+
+void sync_sleep_until_us(int64_t t_us) {
+  // converted to local time once, so a jump of the network clock while
+  // asleep cannot stretch the sleep
+  int64_t now = esp_timer_get_time();
+  int64_t local = now + (t_us - sync_now_us());
+  int64_t left = local - now;
+  // tick sleeps can overshoot by up to a tick, keep the rest for spinning
+  if (left > 2000) {
+    vTaskDelay(pdMS_TO_TICKS((left - 1000) / 1000));
+  }
+  while (esp_timer_get_time() < local) {
+  }
+}
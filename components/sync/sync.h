@@ -0,0 +1,48 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SYNC_MAX_NODES 8
+
+// Follower as seen by the master, from its replies to beacons
+typedef struct {
+  uint32_t id;
+  int32_t skew_us; // follower's network time minus master time
+  uint32_t rtt_us;
+  uint32_t age_ms; // since the last reply
+} sync_node_t;
+
+typedef struct {
+  bool master;
+  bool locked;          // follower has a usable clock estimate
+  int64_t offset_us;    // network time minus local time, now
+  int32_t drift_ppb;    // follower clock rate error vs master
+  int32_t residual_us;  // mean |error| of the model on new beacons
+  uint32_t beacons;     // sent (master) or received (follower)
+  uint32_t beacon_age_ms;
+  int node_count;       // master only
+  sync_node_t nodes[SYNC_MAX_NODES];
+  int32_t max_skew_us;  // master only: spread of skew over all nodes
+} sync_stats_t;
+
+// Start the sync task for the role chosen in Kconfig. Call once the TCP/IP
+// stack is initialized; it waits for the network by itself.
+esp_err_t sync_start(void);
+
+// Shared network time in microseconds. The master's esp_timer is the
+// reference; followers add their estimated offset and drift.
+int64_t sync_now_us(void);
+
+// Sleep until network time t_us
+void sync_sleep_until_us(int64_t t_us);
+
+// How often the network clock has jumped (a follower locking on, or
+// resyncing after the master restarted) and the sum of the jumps in us
+uint32_t sync_steps(int64_t *total_us);
+
+void sync_get_stats(sync_stats_t *out);
+
+#endif
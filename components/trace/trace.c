@@ -0,0 +1,156 @@
+#include "trace.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// JSON is built in pieces of this size before being handed to the sink
+#define TRACE_CHUNK_SIZE 512
+
+#if CONFIG_TRACE_ENABLED
+
+// One finished span ("X" complete event in Chrome Trace terms)
+typedef struct {
+  const char *name;
+  int64_t start_us;
+  uint32_t dur_us;
+  uint8_t cpu;
+} trace_event_t;
+
+static trace_event_t s_events[CONFIG_TRACE_BUFFER_EVENTS];
+// total number of events ever written, s_events is a ring over it
+static uint32_t s_written = 0;
+// set by a dump, spans ending meanwhile are dropped
+static bool s_paused = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+IRAM_ATTR trace_span_t trace_begin(const char *name) {
+  return (trace_span_t){.name = name, .start_us = esp_timer_get_time()};
+}
+
+IRAM_ATTR void trace_end(const trace_span_t *span) {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL_SAFE(&s_lock);
+  if (s_paused) {
+    portEXIT_CRITICAL_SAFE(&s_lock);
+    return;
+  }
+  trace_event_t *ev = &s_events[s_written % CONFIG_TRACE_BUFFER_EVENTS];
+  ev->name = span->name;
+  ev->start_us = span->start_us;
+  ev->dur_us = (uint32_t)(now - span->start_us);
+  ev->cpu = (uint8_t)xPortGetCoreID();
+  s_written++;
+  portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+void trace_clear(void) {
+  portENTER_CRITICAL(&s_lock);
+  s_written = 0;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+#else
+
+void trace_clear(void) {}
+
+#endif
+
+// Small buffered writer on top of the sink
+typedef struct {
+  trace_write_fn write;
+  void *ctx;
+  char buf[TRACE_CHUNK_SIZE];
+  size_t len;
+  esp_err_t err;
+} trace_out_t;
+
+static void out_flush(trace_out_t *out) {
+  if (out->len > 0 && out->err == ESP_OK) {
+    out->err = out->write(out->ctx, out->buf, out->len);
+  }
+  out->len = 0;
+}
+
+static void out_printf(trace_out_t *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void out_printf(trace_out_t *out, const char *fmt, ...) {
+  // longest record is well below 128 bytes
+  if (sizeof(out->buf) - out->len < 128) {
+    out_flush(out);
+  }
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len, fmt,
+                    args);
+  va_end(args);
+  if (n > 0) {
+    out->len += n;
+  }
+}
+
+// One dump at a time, it owns the static writer below
+static portMUX_TYPE s_dump_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_dumping = false;
+
+esp_err_t trace_dump_json(trace_write_fn write, void *ctx) {
+  portENTER_CRITICAL(&s_dump_lock);
+  bool busy = s_dumping;
+  s_dumping = true;
+  portEXIT_CRITICAL(&s_dump_lock);
+  if (busy) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // static to keep the chunk buffer off the caller's (httpd) stack
+  static trace_out_t out;
+  out = (trace_out_t){.write = write, .ctx = ctx, .err = ESP_OK};
+
+  out_printf(&out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  // one timeline row per core
+  for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+    out_printf(&out,
+               "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"tid\":%d,\"args\":{\"name\":\"CPU %d\"}}",
+               cpu == 0 ? "" : ",", cpu, cpu);
+  }
+
+#if CONFIG_TRACE_ENABLED
+  // from here on no span touches the ring until the dump is done
+  portENTER_CRITICAL(&s_lock);
+  s_paused = true;
+  uint32_t count = s_written;
+  portEXIT_CRITICAL(&s_lock);
+  uint32_t first = 0;
+  if (count > CONFIG_TRACE_BUFFER_EVENTS) {
+    first = count - CONFIG_TRACE_BUFFER_EVENTS;
+  }
+
+  for (uint32_t i = first; i < count && out.err == ESP_OK; i++) {
+    const trace_event_t *ev = &s_events[i % CONFIG_TRACE_BUFFER_EVENTS];
+    out_printf(&out,
+               ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+               "\"ts\":%lld,\"dur\":%lu}",
+               ev->name, ev->cpu, (long long)ev->start_us,
+               (unsigned long)ev->dur_us);
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  s_paused = false;
+  portEXIT_CRITICAL(&s_lock);
+#endif
+
+  out_printf(&out, "]}");
+  out_flush(&out);
+  esp_err_t err = out.err;
+
+  portENTER_CRITICAL(&s_dump_lock);
+  s_dumping = false;
+  portEXIT_CRITICAL(&s_dump_lock);
+  return err;
+}
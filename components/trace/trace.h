@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// An open span. Lives on the caller's stack between trace_begin() and
+// trace_end(); `name` must be a string literal (only the pointer is stored).
+typedef struct {
+  const char *name;
+  int64_t start_us;
+} trace_span_t;
+
+#if CONFIG_TRACE_ENABLED
+// Safe to call from tasks and ISRs on either core
+trace_span_t trace_begin(const char *name);
+void trace_end(const trace_span_t *span);
+#else
+static inline trace_span_t trace_begin(const char *name) {
+  return (trace_span_t){0};
+}
+static inline void trace_end(const trace_span_t *span) {}
+#endif
+
+// Sink for trace_dump_json(), called with consecutive pieces of the document
+typedef esp_err_t (*trace_write_fn)(void *ctx, const char *data, size_t len);
+
+// Write the buffer as Chrome Trace Event JSON (open in Perfetto or
+// chrome://tracing). Recording is paused while dumping, spans that end
+// meanwhile are dropped. ESP_ERR_INVALID_STATE if a dump is already
+// running.
+esp_err_t trace_dump_json(trace_write_fn write, void *ctx);
+
+// Drop all recorded events
+void trace_clear(void);
+
+#endif
@@ -2,14 +2,20 @@
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "trace.h"
+#include "wifi_scan.h"
 #include <string.h>
 
+// failed attempts before the setup AP is started next to STA
 #define MAX_RETRY 5
+// reconnect backoff: 1 s, 2 s, 4 s ... up to CONFIG_WIFI_RETRY_BACKOFF_MAX_MS
+#define RETRY_BACKOFF_BASE_MS 1000
 #define NVS_NAMESPACE "wifi_config"
 #define AP_SSID "ESP32-Setup"
 #define AP_PASSWORD "12345678" // 8 chars
@@ -23,6 +29,29 @@ static int s_retry_num = 0;
 static esp_netif_t *s_sta_netif = NULL;
 static esp_netif_t *s_ap_netif = NULL;
 
+// Last good connection, saved in NVS next to the credentials so the next
+// connect can go straight to the right BSSID/channel (and skip DHCP)
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t channel;
+  esp_netif_ip_info_t ip_info;
+  uint32_t dns;
+} wifi_cache_t;
+
+static wifi_config_t s_sta_config;
+static wifi_cache_t s_cache;
+static bool s_cache_valid = false;
+// BSSID/channel of the current association, saved once we have an IP
+static wifi_cache_t s_link;
+// current attempt uses the cache, fall back to a full scan if it fails
+static bool s_fast_attempt = false;
+static bool s_was_connected = false;
+// no credentials, STA only runs for the setup page's network scans
+static bool s_setup_mode = false;
+static esp_timer_handle_t s_retry_timer = NULL;
+
+static void wifi_start_setup_ap(void);
+
 // Spara WiFi credentials
 esp_err_t wifi_save_credentials(const char *ssid, const char *password) {
   nvs_handle_t nvs_handle;
@@ -32,6 +61,8 @@ esp_err_t wifi_save_credentials(const char *ssid, const char *password) {
 
   nvs_set_str(nvs_handle, "ssid", ssid);
   nvs_set_str(nvs_handle, "password", password);
+  // cache belongs to the old network
+  nvs_erase_key(nvs_handle, "bssid");
   nvs_commit(nvs_handle);
   nvs_close(nvs_handle);
 
@@ -69,6 +100,7 @@ esp_err_t wifi_clear_credentials(void) {
 
   nvs_erase_key(nvs_handle, "ssid");
   nvs_erase_key(nvs_handle, "password");
+  nvs_erase_key(nvs_handle, "bssid");
   nvs_commit(nvs_handle);
   nvs_close(nvs_handle);
 
@@ -76,28 +108,171 @@ esp_err_t wifi_clear_credentials(void) {
   return ESP_OK;
 }
 
+// Läs cachad BSSID/kanal/IP, "bssid" saknas = ingen cache
+static bool wifi_load_cache(wifi_cache_t *cache) {
+  nvs_handle_t nvs_handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK)
+    return false;
+
+  *cache = (wifi_cache_t){0};
+  size_t len = sizeof(cache->bssid);
+  esp_err_t err = nvs_get_blob(nvs_handle, "bssid", cache->bssid, &len);
+  if (err == ESP_OK)
+    err = nvs_get_u8(nvs_handle, "channel", &cache->channel);
+  if (err == ESP_OK) {
+    // IP-delen är frivillig
+    nvs_get_u32(nvs_handle, "ip", &cache->ip_info.ip.addr);
+    nvs_get_u32(nvs_handle, "netmask", &cache->ip_info.netmask.addr);
+    nvs_get_u32(nvs_handle, "gw", &cache->ip_info.gw.addr);
+    nvs_get_u32(nvs_handle, "dns", &cache->dns);
+  }
+  nvs_close(nvs_handle);
+  return err == ESP_OK && cache->channel != 0;
+}
+
+// Spara cachen, bara om något ändrats (sparar flash)
+static void wifi_save_cache(const wifi_cache_t *cache) {
+  if (s_cache_valid && memcmp(cache, &s_cache, sizeof(*cache)) == 0)
+    return;
+
+  nvs_handle_t nvs_handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    return;
+
+  nvs_set_blob(nvs_handle, "bssid", cache->bssid, sizeof(cache->bssid));
+  nvs_set_u8(nvs_handle, "channel", cache->channel);
+  nvs_set_u32(nvs_handle, "ip", cache->ip_info.ip.addr);
+  nvs_set_u32(nvs_handle, "netmask", cache->ip_info.netmask.addr);
+  nvs_set_u32(nvs_handle, "gw", cache->ip_info.gw.addr);
+  nvs_set_u32(nvs_handle, "dns", cache->dns);
+  nvs_commit(nvs_handle);
+  nvs_close(nvs_handle);
+
+  s_cache = *cache;
+  s_cache_valid = true;
+  ESP_LOGI(TAG, "Saved connection cache: channel %d, BSSID " MACSTR,
+           cache->channel, MAC2STR(cache->bssid));
+}
+
+// Sätt STA-config, fast = direkt mot cachad BSSID/kanal (+ statisk IP)
+static void wifi_apply_sta_config(bool fast) {
+  wifi_config_t cfg = s_sta_config;
+  s_fast_attempt = fast && s_cache_valid;
+
+  if (s_fast_attempt) {
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, s_cache.bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = s_cache.channel;
+  }
+  esp_wifi_set_config(WIFI_IF_STA, &cfg);
+
+#if CONFIG_WIFI_FAST_STATIC_IP
+  if (s_fast_attempt && s_cache.ip_info.ip.addr != 0) {
+    esp_netif_dhcpc_stop(s_sta_netif);
+    esp_netif_set_ip_info(s_sta_netif, &s_cache.ip_info);
+    esp_netif_dns_info_t dns = {0};
+    dns.ip.u_addr.ip4.addr = s_cache.dns;
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+  } else {
+    esp_netif_dhcpc_start(s_sta_netif);
+  }
+#endif
+}
+
+// Next step of the backoff. Also taken when esp_wifi_connect() itself
+// fails, since then no disconnect event comes to move the chain on.
+static void wifi_schedule_retry(void) {
+  int shift = s_retry_num < 16 ? s_retry_num : 16;
+  uint32_t delay_ms = RETRY_BACKOFF_BASE_MS << shift;
+  if (delay_ms > CONFIG_WIFI_RETRY_BACKOFF_MAX_MS)
+    delay_ms = CONFIG_WIFI_RETRY_BACKOFF_MAX_MS;
+  s_retry_num++;
+  ESP_LOGW(TAG, "Retry %d in %lu ms", s_retry_num, (unsigned long)delay_ms);
+
+  if (s_retry_num == MAX_RETRY) {
+    // keep the credentials and keep trying, but make setup reachable
+    ESP_LOGE(TAG, "Failed to connect %d times, starting setup AP",
+             MAX_RETRY);
+    wifi_start_setup_ap();
+  }
+  esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+// false (and the backoff moved on) if the attempt could not be started,
+// e.g. while a scan is running
+static bool wifi_try_connect(void) {
+  esp_err_t err = esp_wifi_connect();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Connect not started: %s", esp_err_to_name(err));
+    wifi_schedule_retry();
+    return false;
+  }
+  return true;
+}
+
+static void wifi_retry_timer_cb(void *arg) {
+  ESP_LOGI(TAG, "Retrying WiFi connection...");
+  wifi_try_connect();
+}
+
+static void wifi_handle_disconnect(void) {
+  xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+
+  if (s_was_connected) {
+    // AP blip: go straight back to the AP we had
+    s_was_connected = false;
+    ESP_LOGW(TAG, "Disconnected, fast reconnect");
+    wifi_apply_sta_config(true);
+    wifi_try_connect();
+    return;
+  }
+
+  if (s_fast_attempt) {
+    ESP_LOGW(TAG, "Fast connect failed, falling back to full scan");
+    wifi_apply_sta_config(false);
+    wifi_try_connect();
+    return;
+  }
+
+  wifi_schedule_retry();
+}
+
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data) {
+  trace_span_t span = trace_begin("wifi_event_handler");
   if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-    esp_wifi_connect();
-    ESP_LOGI(TAG, "Connecting to WiFi...");
+    if (!s_setup_mode) {
+      ESP_LOGI(TAG, "Connecting to WiFi...");
+      wifi_try_connect();
+    }
+  } else if (event_base == WIFI_EVENT &&
+             event_id == WIFI_EVENT_STA_CONNECTED) {
+    wifi_event_sta_connected_t *event =
+        (wifi_event_sta_connected_t *)event_data;
+    memcpy(s_link.bssid, event->bssid, sizeof(s_link.bssid));
+    s_link.channel = event->channel;
   } else if (event_base == WIFI_EVENT &&
              event_id == WIFI_EVENT_STA_DISCONNECTED) {
-    if (s_retry_num < MAX_RETRY) {
-      esp_wifi_connect();
-      s_retry_num++;
-      ESP_LOGW(TAG, "Retry %d/%d", s_retry_num, MAX_RETRY);
-    } else {
-      ESP_LOGE(TAG, "Failed to connect, clearing credentials and restarting");
-      wifi_clear_credentials();
-      vTaskDelay(pdMS_TO_TICKS(2000));
-      esp_restart();
-    }
-    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    wifi_handle_disconnect();
   } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-    ESP_LOGI(TAG, "Connected! IP: " IPSTR, IP2STR(&event->ip_info.ip));
+    ESP_LOGI(TAG, "Connected! IP: " IPSTR "%s", IP2STR(&event->ip_info.ip),
+             s_fast_attempt ? " (fast path)" : "");
     s_retry_num = 0;
+    s_was_connected = true;
+
+    s_link.ip_info = event->ip_info;
+    esp_netif_dns_info_t dns = {0};
+    esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    s_link.dns = dns.ip.u_addr.ip4.addr;
+    wifi_save_cache(&s_link);
+
+    // setup AP was only a fallback
+    wifi_mode_t mode;
+    if (esp_wifi_get_mode(&mode) == ESP_OK && mode == WIFI_MODE_APSTA) {
+      esp_wifi_set_mode(WIFI_MODE_STA);
+    }
     xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
   } else if (event_base == WIFI_EVENT &&
              event_id == WIFI_EVENT_AP_STACONNECTED) {
@@ -105,13 +280,14 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
         (wifi_event_ap_staconnected_t *)event_data;
     ESP_LOGI(TAG, "Station connected to AP, MAC: " MACSTR, MAC2STR(event->mac));
   }
+  trace_end(&span);
 }
 
-// Starta i AP-läge (Setup-mode)
-static void wifi_start_ap_mode(void) {
-  ESP_LOGI(TAG, "Starting AP mode: %s", AP_SSID);
-
-  s_ap_netif = esp_netif_create_default_wifi_ap();
+// Konfigurera setup-AP:n (mode sätts av anroparen)
+static void wifi_configure_ap(void) {
+  if (!s_ap_netif) {
+    s_ap_netif = esp_netif_create_default_wifi_ap();
+  }
 
   wifi_config_t ap_config = {
       .ap =
@@ -129,14 +305,31 @@ static void wifi_start_ap_mode(void) {
     ap_config.ap.authmode = WIFI_AUTH_OPEN;
   }
 
-  esp_wifi_set_mode(WIFI_MODE_AP);
   esp_wifi_set_config(WIFI_IF_AP, &ap_config);
+}
+
+// Starta i AP-läge (Setup-mode), STA är på för nätverksskanningen
+static void wifi_start_ap_mode(void) {
+  ESP_LOGI(TAG, "Starting AP mode: %s", AP_SSID);
+
+  s_setup_mode = true;
+  esp_wifi_set_mode(WIFI_MODE_APSTA);
+  wifi_configure_ap();
   esp_wifi_start();
+  wifi_scan_start();
 
   ESP_LOGI(TAG, "AP started. Connect to '%s' and go to http://192.168.4.1",
            AP_SSID);
 }
 
+// Setup-AP bredvid STA när anslutningen inte lyckas, STA fortsätter försöka
+static void wifi_start_setup_ap(void) {
+  esp_wifi_set_mode(WIFI_MODE_APSTA);
+  wifi_configure_ap();
+  wifi_scan_start();
+  ESP_LOGI(TAG, "Setup AP '%s' up at http://192.168.4.1", AP_SSID);
+}
+
 // Starta i Station-läge (Normal drift)
 static void wifi_start_sta_mode(const char *ssid, const char *password) {
   ESP_LOGI(TAG, "Starting STA mode, connecting to: %s with password %s", ssid,
@@ -144,13 +337,20 @@ static void wifi_start_sta_mode(const char *ssid, const char *password) {
 
   s_sta_netif = esp_netif_create_default_wifi_sta();
 
-  wifi_config_t sta_config = {0};
-  strncpy((char *)sta_config.sta.ssid, ssid, sizeof(sta_config.sta.ssid) - 1);
-  strncpy((char *)sta_config.sta.password, password,
-          sizeof(sta_config.sta.password) - 1);
+  wifi_config_t *sta_config = &s_sta_config;
+  strncpy((char *)sta_config->sta.ssid, ssid,
+          sizeof(sta_config->sta.ssid) - 1);
+  strncpy((char *)sta_config->sta.password, password,
+          sizeof(sta_config->sta.password) - 1);
+
+  s_cache_valid = wifi_load_cache(&s_cache);
+  if (s_cache_valid) {
+    ESP_LOGI(TAG, "Cached AP " MACSTR " on channel %d, trying it first",
+             MAC2STR(s_cache.bssid), s_cache.channel);
+  }
 
   esp_wifi_set_mode(WIFI_MODE_STA);
-  esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+  wifi_apply_sta_config(true);
   esp_wifi_start();
 }
 
@@ -171,6 +371,12 @@ void wifi_connect(void) {
   esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
                                       &wifi_event_handler, NULL, NULL);
 
+  const esp_timer_create_args_t retry_args = {
+      .callback = wifi_retry_timer_cb,
+      .name = "wifi_retry",
+  };
+  esp_timer_create(&retry_args, &s_retry_timer);
+
   // Försök läsa sparade credentials
   char saved_ssid[32] = {0};
   char saved_pass[64] = {0};
@@ -225,8 +431,9 @@ void wifi_print_status(void) {
   wifi_mode_t mode;
   esp_wifi_get_mode(&mode);
 
-  if (mode == WIFI_MODE_AP) {
-    ESP_LOGI(TAG, "Mode: Access Point (Setup)");
+  if (mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA) {
+    ESP_LOGI(TAG, "Mode: Access Point (Setup)%s",
+             s_setup_mode ? "" : ", still trying saved WiFi");
     ESP_LOGI(TAG, "SSID: %s", AP_SSID);
     ESP_LOGI(TAG, "IP: 192.168.4.1");
   } else if (mode == WIFI_MODE_STA) {
@@ -236,3 +443,8 @@ void wifi_print_status(void) {
     ESP_LOGI(TAG, "IP: " IPSTR, IP2STR(&ip_info.ip));
   }
 }
+
+bool wifi_is_connected(void) {
+  return s_wifi_event_group &&
+         (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT);
+}
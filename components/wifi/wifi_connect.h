@@ -6,6 +6,7 @@
 
 void wifi_connect(void);
 bool wifi_wait_until_connected(uint32_t timeout_ms);
+bool wifi_is_connected(void);
 esp_err_t wifi_save_credentials(const char *ssid, const char *password);
 esp_err_t wifi_clear_credentials(void);
 esp_err_t wifi_reconfigure(const char *ssid, const char *password);
@@ -0,0 +1,177 @@
+#include "wifi_scan.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+
+#define SCAN_TASK_STACK 3072
+#define SCAN_TASK_PRIORITY 3
+// raw records fetched per scan, before de-duplication
+#define SCAN_MAX_RECORDS 32
+#define SCAN_DONE_TIMEOUT_MS 10000
+// retry sooner until the first scan has succeeded
+#define SCAN_RETRY_MS 1000
+
+static const char *TAG = "wifi_scan";
+
+static TaskHandle_t s_task = NULL;
+static SemaphoreHandle_t s_scan_done = NULL;
+
+static wifi_ap_record_t s_records[SCAN_MAX_RECORDS];
+
+// Cache served to HTTP, guarded by s_lock
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_scan_entry_t s_cache[WIFI_SCAN_MAX_NETWORKS];
+static int s_cache_count = 0;
+static int64_t s_cache_time_us = -1;
+
+static void scan_done_handler(void *arg, esp_event_base_t event_base,
+                              int32_t event_id, void *event_data) {
+  xSemaphoreGive(s_scan_done);
+}
+
+// Merge raw records into a list with one entry per SSID (strongest AP wins),
+// sorted by RSSI
+static int build_entries(const wifi_ap_record_t *rec, int n,
+                         wifi_scan_entry_t *out) {
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    const char *ssid = (const char *)rec[i].ssid;
+    if (ssid[0] == '\0') {
+      continue; // hidden network
+    }
+
+    int j = 0;
+    while (j < count && strcmp(out[j].ssid, ssid) != 0) {
+      j++;
+    }
+    if (j == count) {
+      if (count == WIFI_SCAN_MAX_NETWORKS) {
+        continue;
+      }
+      count++;
+    } else if (out[j].rssi >= rec[i].rssi) {
+      continue;
+    }
+
+    strncpy(out[j].ssid, ssid, sizeof(out[j].ssid) - 1);
+    out[j].ssid[sizeof(out[j].ssid) - 1] = '\0';
+    out[j].rssi = rec[i].rssi;
+    out[j].channel = rec[i].primary;
+    out[j].secure = rec[i].authmode != WIFI_AUTH_OPEN;
+  }
+
+  // insertion sort, strongest first (count is small)
+  for (int i = 1; i < count; i++) {
+    wifi_scan_entry_t e = out[i];
+    int j = i - 1;
+    while (j >= 0 && out[j].rssi < e.rssi) {
+      out[j + 1] = out[j];
+      j--;
+    }
+    out[j + 1] = e;
+  }
+  return count;
+}
+
+static bool ap_active(void) {
+  wifi_mode_t mode;
+  return esp_wifi_get_mode(&mode) == ESP_OK &&
+         (mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA);
+}
+
+static void scan_once(void) {
+  // short dwell per channel, the AP is off-channel while we scan
+  wifi_scan_config_t cfg = {
+      .show_hidden = false,
+      .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+      .scan_time.active = {.min = 50, .max = 120},
+  };
+
+  xSemaphoreTake(s_scan_done, 0);
+  esp_err_t err = esp_wifi_scan_start(&cfg, false);
+  if (err != ESP_OK) {
+    // e.g. STA is busy connecting, try again next round
+    ESP_LOGD(TAG, "Scan not started: %s", esp_err_to_name(err));
+    return;
+  }
+  if (xSemaphoreTake(s_scan_done, pdMS_TO_TICKS(SCAN_DONE_TIMEOUT_MS)) !=
+      pdTRUE) {
+    ESP_LOGW(TAG, "Scan timed out");
+    return;
+  }
+
+  uint16_t n = SCAN_MAX_RECORDS;
+  if (esp_wifi_scan_get_ap_records(&n, s_records) != ESP_OK) {
+    return;
+  }
+
+  static wifi_scan_entry_t entries[WIFI_SCAN_MAX_NETWORKS];
+  int count = build_entries(s_records, n, entries);
+
+  portENTER_CRITICAL(&s_lock);
+  memcpy(s_cache, entries, count * sizeof(entries[0]));
+  s_cache_count = count;
+  s_cache_time_us = esp_timer_get_time();
+  portEXIT_CRITICAL(&s_lock);
+
+  ESP_LOGI(TAG, "Scan done, %d networks", count);
+}
+
+static void scan_task(void *arg) {
+  while (ap_active()) {
+    scan_once();
+    uint32_t delay_ms = s_cache_time_us < 0 ? SCAN_RETRY_MS
+                                            : CONFIG_WIFI_SCAN_INTERVAL_MS;
+    vTaskDelay(pdMS_TO_TICKS(delay_ms));
+  }
+
+  ESP_LOGI(TAG, "Setup AP off, scan task stopped");
+  s_task = NULL;
+  vTaskDelete(NULL);
+}
+
+esp_err_t wifi_scan_start(void) {
+  if (s_task) {
+    return ESP_OK;
+  }
+
+  if (!s_scan_done) {
+    s_scan_done = xSemaphoreCreateBinary();
+    if (!s_scan_done) {
+      return ESP_ERR_NO_MEM;
+    }
+    esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE,
+                                        &scan_done_handler, NULL, NULL);
+  }
+
+  // networking core, next to the WiFi task
+  if (xTaskCreatePinnedToCore(scan_task, "wifi_scan", SCAN_TASK_STACK, NULL,
+                              SCAN_TASK_PRIORITY, &s_task, 0) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start scan task!");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+int wifi_scan_get_results(wifi_scan_entry_t *out, int max) {
+  portENTER_CRITICAL(&s_lock);
+  int n = s_cache_count < max ? s_cache_count : max;
+  memcpy(out, s_cache, n * sizeof(out[0]));
+  portEXIT_CRITICAL(&s_lock);
+  return n;
+}
+
+int32_t wifi_scan_age_ms(void) {
+  portENTER_CRITICAL(&s_lock);
+  int64_t t = s_cache_time_us;
+  portEXIT_CRITICAL(&s_lock);
+  if (t < 0) {
+    return -1;
+  }
+  return (int32_t)((esp_timer_get_time() - t) / 1000);
+}
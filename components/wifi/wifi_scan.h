@@ -0,0 +1,28 @@
+#ifndef WIFI_SCAN_H
+#define WIFI_SCAN_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WIFI_SCAN_MAX_NETWORKS 20
+
+typedef struct {
+  char ssid[33];
+  int8_t rssi;
+  uint8_t channel;
+  bool secure;
+} wifi_scan_entry_t;
+
+// Start the background scan task (needs WiFi started in AP+STA mode). It
+// stops by itself once the AP is turned off.
+esp_err_t wifi_scan_start(void);
+
+// Copy the cached networks, strongest first, one entry per SSID. Never
+// blocks on a scan. Returns the number of entries written.
+int wifi_scan_get_results(wifi_scan_entry_t *out, int max);
+
+// Milliseconds since the cache was last refreshed, -1 if never
+int32_t wifi_scan_age_ms(void);
+
+#endif
@@ -0,0 +1,38 @@
+#include "led_bench.h"
+#include "led_layout.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// What the effects reach of the render task and the strip
+void led_render_play(led_effect_id_t id, const led_effect_params_t *params,
+                     uint32_t duration_ms) {}
+void led_render_layer_play(int layer, led_effect_id_t id,
+                           const led_effect_params_t *params,
+                           uint32_t duration_ms) {}
+uint32_t led_render_frame_gen(void) { return 0; }
+bool led_render_wait_frame(uint32_t gen, uint32_t timeout_ms) { return true; }
+int ws2812_get_num_leds(void) { return CONFIG_LED_STRIP_COUNT; }
+
+// led_bench_effects() on the host: render cost of one full frame per
+// effect, over a CONFIG_LED_STRIP_COUNT LED strip, next to the frame
+// period. Same numbers as the "effects" part of GET /bench.
+//
+//   bench_effects [frames]
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 100;
+  led_layout_init(CONFIG_LED_STRIP_COUNT);
+
+  led_bench_result_t res[LED_EFFECT_COUNT];
+  if (led_bench_effects(frames, res) != ESP_OK) {
+    printf("FAIL led_bench_effects\n");
+    return 1;
+  }
+  printf("%d LEDs x %d frames, budget %d us per frame\n",
+         CONFIG_LED_STRIP_COUNT, frames, 1000000 / CONFIG_LED_FRAME_RATE);
+  for (int i = 0; i < LED_EFFECT_COUNT; i++) {
+    printf("%-14s %7lu us avg %7lu us max\n", res[i].name,
+           (unsigned long)res[i].us_avg, (unsigned long)res[i].us_max);
+  }
+  return 0;
+}
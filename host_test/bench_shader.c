@@ -0,0 +1,35 @@
+#include "led_layout.h"
+#include "led_shader.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// What the shader sources reach of the render task and the strip
+uint32_t led_render_frame_gen(void) { return 0; }
+bool led_render_wait_frame(uint32_t gen, uint32_t timeout_ms) { return true; }
+int ws2812_get_num_leds(void) { return CONFIG_LED_STRIP_COUNT; }
+
+// led_shader_bench() on the host: the reference program on the VM against
+// the same formula in C, over a CONFIG_LED_STRIP_COUNT LED strip.
+//
+//   bench_shader [frames]
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 100;
+  led_layout_init(CONFIG_LED_STRIP_COUNT);
+
+  led_shader_bench_t res;
+  esp_err_t err = led_shader_bench(frames, &res);
+  if (err != ESP_OK) {
+    printf("FAIL led_shader_bench: %d\n", err);
+    return 1;
+  }
+  printf("%d LEDs x %d frames, %d instructions\n", CONFIG_LED_STRIP_COUNT,
+         frames, res.insns);
+  printf("VM      %10lu px/s\n", (unsigned long)res.vm_px_per_s);
+  printf("native  %10lu px/s\n", (unsigned long)res.native_px_per_s);
+  if (res.vm_px_per_s) {
+    printf("native is %.1fx the VM\n",
+           (double)res.native_px_per_s / res.vm_px_per_s);
+  }
+  return res.vm_px_per_s && res.native_px_per_s ? 0 : 1;
+}
@@ -0,0 +1,17 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+
+// Monotonic host time in microseconds
+int64_t esp_timer_get_time(void);
+
+// Host only: from now on esp_timer_get_time() runs offset_us ahead of the
+// monotonic clock and drift_ppm fast, so processes on one host can play
+// hubs with different crystals (host_test/sync_node.c)
+void host_clock_skew(int64_t offset_us, int32_t drift_ppm);
+
+// The monotonic clock itself, the same in every process
+int64_t host_clock_real_us(void);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef FREERTOS_TASK_H
+#define FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+
+// No tasks on the host: creating one fails, notifications go nowhere
+typedef void (*TaskFunction_t)(void *arg);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *task,
+                                   BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task) { return pdPASS; }
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Kconfig defaults for the host tests. A test overrides a value with a
+// compile definition in CMakeLists.txt.
+
+// Builds the linux-target paths (no GPIO driver)
+#define CONFIG_IDF_TARGET_LINUX 1
+
+#ifndef CONFIG_LED_STRIP_COUNT
+#define CONFIG_LED_STRIP_COUNT 12
+#endif
+#define CONFIG_LED_STRIP_GPIO 27
+#define CONFIG_LED_CHIP_WS2812B 1
+#define CONFIG_LED_COLOR_ORDER_GRB 1
+#define CONFIG_LED_OUTPUT_FILE 1
+#define CONFIG_LED_OUTPUT_FILE_PATH "/tmp/led_frames.bin"
+
+#ifndef CONFIG_LED_POWER_LIMIT
+#define CONFIG_LED_POWER_LIMIT 0
+#endif
+#define CONFIG_LED_POWER_BUDGET_MA 2000
+#define CONFIG_LED_POWER_MA_RED 16
+#define CONFIG_LED_POWER_MA_GREEN 16
+#define CONFIG_LED_POWER_MA_BLUE 16
+#define CONFIG_LED_POWER_MA_IDLE 1000
+
+#define CONFIG_LED_FRAME_RATE 60
+#define CONFIG_LED_RENDER_CORE 1
+#define CONFIG_LED_FRAME_LEAD_US 4000
+#define CONFIG_LED_LAYERS 3
+#define CONFIG_LED_TRANSITION_MS 400
+#ifndef CONFIG_LED_HIGH_DEPTH
+#define CONFIG_LED_HIGH_DEPTH 0
+#endif
+#define CONFIG_LED_GAMMA_X10 22
+#define CONFIG_LED_TIMELINE_MAX_KEYS 64
+#define CONFIG_LED_SHADER_MAX_INSNS 64
+#define CONFIG_LED_SHADER_BUDGET 100000
+#ifndef CONFIG_LED_REGRESS_FRAME_US
+#define CONFIG_LED_REGRESS_FRAME_US 4000
+#endif
+#ifndef CONFIG_LED_REGRESS_JITTER_US
+#define CONFIG_LED_REGRESS_JITTER_US 1500
+#endif
+
+#define CONFIG_LED_MATRIX_WIDTH 0
+#define CONFIG_LED_LAYOUT_MAX_CELLS 1024
+
+#ifndef CONFIG_MQTT_CTL_ENABLED
+#define CONFIG_MQTT_CTL_ENABLED 0
+#endif
+#define CONFIG_MQTT_CTL_BROKER_URI ""
+#define CONFIG_MQTT_CTL_TOPIC_PREFIX "tissla"
+#define CONFIG_MQTT_CTL_HUB_ID ""
+#define CONFIG_MQTT_CTL_RECONNECT_MS 5000
+#define CONFIG_MQTT_CTL_STATE_MIN_MS 250
+#define CONFIG_MQTT_CTL_METRICS_MS 10000
+
+#ifndef CONFIG_SYNC_ENABLED
+#define CONFIG_SYNC_ENABLED 0
+#endif
+#ifndef CONFIG_SYNC_ROLE_MASTER
+#define CONFIG_SYNC_ROLE_FOLLOWER 1
+#endif
+#define CONFIG_SYNC_GROUP_ADDR "239.255.76.83"
+#define CONFIG_SYNC_PORT 5990
+#define CONFIG_SYNC_BEACON_INTERVAL_MS 250
+#define CONFIG_SYNC_START_QUANTUM_MS 500
+
+#define CONFIG_TRACE_ENABLED 0
+#define CONFIG_FREERTOS_UNICORE 1
+
+#endif
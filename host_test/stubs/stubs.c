@@ -0,0 +1,69 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+const char *esp_err_to_name(esp_err_t err) {
+  return err == ESP_OK ? "ESP_OK" : "ESP_ERR";
+}
+
+void host_log(char level, const char *tag, const char *fmt, ...) {
+  if (level != 'E' && level != 'W') {
+    return;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "%c (%s) ", level, tag);
+  vfprintf(stderr, fmt, ap);
+  fputc('\n', stderr);
+  va_end(ap);
+}
+
+static int64_t s_skew_offset_us = 0;
+static int32_t s_skew_drift_ppm = 0;
+static int64_t s_skew_from_us = 0;
+
+int64_t host_clock_real_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void host_clock_skew(int64_t offset_us, int32_t drift_ppm) {
+  s_skew_from_us = host_clock_real_us();
+  s_skew_offset_us = offset_us;
+  s_skew_drift_ppm = drift_ppm;
+}
+
+int64_t esp_timer_get_time(void) {
+  int64_t real = host_clock_real_us();
+  return real + s_skew_offset_us +
+         (real - s_skew_from_us) * s_skew_drift_ppm / 1000000;
+}
+
+// distinct per process, which is what the sync node ids need
+uint32_t esp_random(void) { return (uint32_t)getpid() * 2654435761u; }
+
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  struct timespec ts = {.tv_sec = ticks / 1000,
+                        .tv_nsec = (long)(ticks % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *task,
+                                   BaseType_t core) {
+  return pdFALSE;
+}
+
+void vTaskDelete(TaskHandle_t task) {}
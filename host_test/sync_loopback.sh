@@ -0,0 +1,38 @@
+#!/bin/sh
+# Multi-hub sync over multicast on this host: one master and three
+# followers with clocks seconds apart and tens of ppm off, each its own
+# process running sync.c. Prints every follower's skew against the master
+# and the spread between the followers; fails if one never locks or goes
+# over the budget.
+#
+#   sync_loopback.sh path/to/sync_master path/to/sync_follower [budget_us]
+set -u
+master=$1
+follower=$2
+budget=${3:-2000}
+seconds=8
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+"$master" $((seconds + 1)) >"$out/master" &
+pids=$!
+i=0
+for clock in "3000000 40" "-1500000 -60" "250000 15"; do
+  set -- $clock
+  "$follower" $seconds "$1" "$2" "$budget" >"$out/follower$i" &
+  pids="$pids $!"
+  i=$((i + 1))
+done
+
+fail=0
+for pid in $pids; do
+  wait "$pid" || fail=1
+done
+cat "$out"/follower* "$out/master"
+
+# inter-node skew: spread of the followers' mean skew, the master at 0
+awk '/skew avg/ { for (k = 1; k < NF; k++) if ($k == "avg") v = $(k + 1) + 0
+                  if (v < lo) lo = v
+                  if (v > hi) hi = v }
+     END { printf "inter-node skew: %d us\n", hi - lo }' "$out"/follower*
+exit $fail
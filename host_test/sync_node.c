@@ -0,0 +1,110 @@
+// One hub of the sync protocol as a host process: sync.c with its own
+// sockets, over multicast on this host, and a local clock that is off by
+// an offset and a drift. Built once as master and once as follower;
+// sync_loopback.sh runs one master and several followers against each
+// other.
+//
+//   sync_master seconds
+//   sync_follower seconds offset_us drift_ppm budget_us
+//
+// The master's clock is the monotonic host clock, so a follower knows the
+// true network time and prints how far its own estimate is off (the skew)
+// once locked. It fails if it never locks or the skew goes over budget_us
+// in the second half of the run, when the drift fit has settled. The
+// master prints the skew it measured itself from the replies.
+#include "sync.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if !CONFIG_SYNC_ROLE_MASTER
+
+static int64_t s_locked_us = 0;
+static int32_t s_skew_max = 0;
+static int64_t s_skew_sum = 0;
+static int s_skew_n = 0;
+
+// After each beacon: our network time against the master's, which is the
+// monotonic clock itself
+static void measure(int64_t settled) {
+  sync_stats_t st;
+  sync_get_stats(&st);
+  if (!st.locked) {
+    return;
+  }
+  int64_t real = host_clock_real_us();
+  int32_t skew = (int32_t)(sync_now_us() - real);
+  if (!s_locked_us) {
+    s_locked_us = real;
+  }
+  if (real >= settled) {
+    int32_t abs_skew = skew < 0 ? -skew : skew;
+    if (abs_skew > s_skew_max) {
+      s_skew_max = abs_skew;
+    }
+    s_skew_sum += skew;
+    s_skew_n++;
+  }
+}
+
+#endif
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 8;
+  int64_t offset_us = argc > 2 ? atoll(argv[2]) : 0;
+  int32_t drift_ppm = argc > 3 ? atoi(argv[3]) : 0;
+  int32_t budget_us = argc > 4 ? atoi(argv[4]) : 1000;
+
+  host_clock_skew(offset_us, drift_ppm);
+  s_node_id = esp_random();
+#if CONFIG_SYNC_ROLE_MASTER
+  s_stats.master = true;
+  s_stats.locked = true;
+#endif
+
+  int sock;
+  while ((sock = open_socket()) < 0) {
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+
+  int64_t start = host_clock_real_us();
+  int64_t end = start + seconds * 1000000LL;
+  while (host_clock_real_us() < end) {
+    sync_step(sock);
+#if !CONFIG_SYNC_ROLE_MASTER
+    measure(start + seconds * 500000LL);
+#endif
+  }
+  close(sock);
+
+  sync_stats_t st;
+  sync_get_stats(&st);
+#if CONFIG_SYNC_ROLE_MASTER
+  printf("master: %lu beacons, %d followers, skew spread %ld us\n",
+         (unsigned long)st.beacons, st.node_count, (long)st.max_skew_us);
+  for (int i = 0; i < st.node_count; i++) {
+    printf("master: node %08lx skew %+ld us, rtt %lu us\n",
+           (unsigned long)st.nodes[i].id, (long)st.nodes[i].skew_us,
+           (unsigned long)st.nodes[i].rtt_us);
+  }
+  (void)budget_us;
+  return st.node_count ? 0 : 1;
+#else
+  printf("follower %08lx: clock %+lld us %+ld ppm, drift fit %+ld ppb, "
+         "locked after %lld ms, skew avg %+ld us max %ld us (budget %ld)\n",
+         (unsigned long)s_node_id, (long long)offset_us, (long)drift_ppm,
+         (long)st.drift_ppb,
+         s_locked_us ? (long long)(s_locked_us - start) / 1000 : -1LL,
+         s_skew_n ? (long)(s_skew_sum / s_skew_n) : 0L, (long)s_skew_max,
+         (long)budget_us);
+  if (!s_skew_n) {
+    printf("FAIL follower never locked\n");
+    return 1;
+  }
+  if (s_skew_max > budget_us) {
+    printf("FAIL skew over budget\n");
+    return 1;
+  }
+  return 0;
+#endif
+}
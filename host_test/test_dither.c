@@ -0,0 +1,123 @@
+#include "led_api.h"
+#include "led_output.h"
+#include "sdkconfig.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define N CONFIG_LED_STRIP_COUNT
+
+static int s_failed = 0;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      s_failed++;                                                              \
+    }                                                                          \
+  } while (0)
+
+// Output backend that keeps the last frame, gray pixels only so the byte
+// order does not matter
+static uint8_t s_sent[N * 3];
+
+static esp_err_t host_init(void) { return ESP_OK; }
+
+static esp_err_t host_submit(const uint8_t *wire, size_t len) {
+  memcpy(s_sent, wire, len < sizeof(s_sent) ? len : sizeof(s_sent));
+  return ESP_OK;
+}
+
+static esp_err_t host_wait(void) { return ESP_OK; }
+
+const led_output_t led_output_file = {
+    .name = "host",
+    .init = host_init,
+    .submit = host_submit,
+    .wait = host_wait,
+};
+
+static void set_gray(const uint16_t *levels) {
+  rgb16_t px[N];
+  for (int i = 0; i < N; i++) {
+    px[i] = (rgb16_t){levels[i], levels[i], levels[i]};
+  }
+  ws2812_set_frame16(px);
+}
+
+// Levels exactly on a step go out unchanged and need no more frames
+static void test_exact_levels_settle(void) {
+  uint16_t levels[N];
+  for (int i = 0; i < N; i++) {
+    levels[i] = i % 2 ? 0xffff : 0;
+  }
+  set_gray(levels);
+  for (int f = 0; f < 3; f++) {
+    ws2812_show();
+    CHECK(!ws2812_needs_refresh(), "refresh wanted on exact levels");
+    for (int i = 0; i < N * 3; i++) {
+      CHECK(s_sent[i] == (i / 3 % 2 ? 255 : 0), "byte %d is %d", i,
+            s_sent[i]);
+    }
+  }
+}
+
+// A level between two steps averages to it over 256 frames, and LEDs on
+// the same level do not all step up in the same frame
+static void test_fraction_averages(void) {
+  const uint16_t level = 0x3000;
+  // top byte of the 16-bit level after gamma
+  double want =
+      pow(level / 65535.0, CONFIG_LED_GAMMA_X10 / 10.0) * 65535.0 / 256.0;
+  uint16_t levels[N];
+  for (int i = 0; i < N; i++) {
+    levels[i] = level;
+  }
+  set_gray(levels);
+
+  uint32_t sum[N * 3] = {0};
+  bool spread = false;
+  for (int f = 0; f < 256; f++) {
+    ws2812_show();
+    CHECK(ws2812_needs_refresh(), "no refresh wanted while dithering");
+    for (int i = 0; i < N * 3; i++) {
+      sum[i] += s_sent[i];
+      spread |= s_sent[i] != s_sent[0];
+    }
+  }
+  for (int i = 0; i < N * 3; i++) {
+    double avg = sum[i] / 256.0;
+    CHECK(fabs(avg - want) < 0.02, "byte %d averages %.3f, want %.3f", i,
+          avg, want);
+  }
+  CHECK(spread, "all bytes stepped together");
+}
+
+// Back on exact levels the carried remainders do not leak out
+static void test_settles_after_fraction(void) {
+  uint16_t levels[N] = {0};
+  set_gray(levels);
+  ws2812_show();
+  CHECK(!ws2812_needs_refresh(), "refresh wanted after going dark");
+  for (int i = 0; i < N * 3; i++) {
+    CHECK(s_sent[i] == 0, "byte %d is %d on black", i, s_sent[i]);
+  }
+}
+
+int main(void) {
+  if (ws2812_init() != ESP_OK) {
+    printf("FAIL init\n");
+    return 1;
+  }
+  test_exact_levels_settle();
+  test_fraction_averages();
+  test_settles_after_fraction();
+  if (s_failed) {
+    printf("%d checks failed\n", s_failed);
+    return 1;
+  }
+  printf("dither: ok\n");
+  return 0;
+}
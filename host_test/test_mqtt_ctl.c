@@ -0,0 +1,229 @@
+// The command path of mqtt_ctl.c without a broker: messages go in through
+// on_data() as the MQTT task would deliver them, and apply_pending() hands
+// them to the stubbed render task below, which records what it was told.
+#include "mqtt_ctl.c"
+
+static int s_failed = 0;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      s_failed++;                                                              \
+    }                                                                          \
+  } while (0)
+
+typedef enum { CALL_PLAY, CALL_SCENE, CALL_BRIGHTNESS } call_kind_t;
+
+typedef struct {
+  call_kind_t kind;
+  led_effect_id_t effect;
+  led_effect_params_t params;
+  uint32_t duration_ms;
+  int arg; // scene id or brightness
+} call_t;
+
+static call_t s_calls[16];
+static int s_n_calls;
+
+static void record(call_t c) {
+  if (s_n_calls < 16) {
+    s_calls[s_n_calls++] = c;
+  }
+}
+
+void led_render_play(led_effect_id_t id, const led_effect_params_t *params,
+                     uint32_t duration_ms) {
+  record((call_t){CALL_PLAY, id, *params, duration_ms});
+}
+void led_render_layer_play(int layer, led_effect_id_t id,
+                           const led_effect_params_t *params,
+                           uint32_t duration_ms) {}
+void led_render_set_brightness(uint8_t level) {
+  record((call_t){CALL_BRIGHTNESS, .arg = level});
+}
+void led_render_get_stats(led_render_stats_t *out) {
+  *out = (led_render_stats_t){0};
+}
+uint32_t led_render_frame_gen(void) { return 0; }
+bool led_render_wait_frame(uint32_t gen, uint32_t timeout_ms) { return true; }
+int ws2812_get_num_leds(void) { return CONFIG_LED_STRIP_COUNT; }
+
+esp_err_t scene_apply(int id) {
+  record((call_t){CALL_SCENE, .arg = id});
+  return ESP_OK;
+}
+void scene_get_current(scene_t *out) { *out = (scene_t){0}; }
+
+// Client calls of mqtt_ctl_start() and publish(), never made here
+esp_mqtt_client_handle_t
+esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+  return NULL;
+}
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler,
+                                         void *arg) {
+  return ESP_OK;
+}
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+  return ESP_OK;
+}
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client,
+                              const char *topic, int qos) {
+  return 0;
+}
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client,
+                            const char *topic, const char *data, int len,
+                            int qos, int retain, bool store) {
+  return 0;
+}
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) { return ESP_OK; }
+
+// One message on <prefix>/hub1/set/<what>
+static void send(const char *what, const char *payload) {
+  char t[MQTT_CTL_TOPIC_MAX];
+  snprintf(t, sizeof(t), "%s%s", s_set_prefix, what);
+  char data[128];
+  strncpy(data, payload, sizeof(data) - 1);
+  esp_mqtt_event_t ev = {.event_id = MQTT_EVENT_DATA,
+                         .data = data,
+                         .data_len = strlen(data),
+                         .total_data_len = strlen(data),
+                         .topic = t,
+                         .topic_len = strlen(t)};
+  on_data(&ev);
+}
+
+static void reset(void) {
+  s_base.kind = BASE_NONE;
+  s_brightness.set = false;
+  s_stats = (mqtt_ctl_stats_t){0};
+  s_n_calls = 0;
+}
+
+static void test_color_burst(void) {
+  reset();
+  char c[16];
+  for (int i = 1; i <= 10; i++) {
+    snprintf(c, sizeof(c), "%d,0,0", i * 10);
+    send("color", c);
+  }
+  apply_pending();
+  CHECK(s_n_calls == 1, "burst: %d calls, want 1", s_n_calls);
+  CHECK(s_calls[0].kind == CALL_PLAY && s_calls[0].effect == LED_EFFECT_SOLID,
+        "burst: not a solid color");
+  CHECK(s_calls[0].params.r == 100, "burst: r %d, want the last (100)",
+        s_calls[0].params.r);
+  CHECK(s_stats.received == 10 && s_stats.coalesced == 9 &&
+            s_stats.applied == 1,
+        "burst: received %lu coalesced %lu applied %lu",
+        (unsigned long)s_stats.received, (unsigned long)s_stats.coalesced,
+        (unsigned long)s_stats.applied);
+
+  // nothing new, nothing applied
+  apply_pending();
+  CHECK(s_n_calls == 1, "idle round applied %d calls", s_n_calls - 1);
+}
+
+static void test_mixed_burst(void) {
+  reset();
+  send("effect", "plasma speed=7");
+  send("color", "#00ff00");
+  send("brightness", "10");
+  send("brightness", "20");
+  send("effect", "scroll_text r=1 duration=500 text=hello world");
+  apply_pending();
+  CHECK(s_n_calls == 2, "mixed: %d calls, want 2", s_n_calls);
+  // brightness came before the last effect, so it goes first
+  CHECK(s_calls[0].kind == CALL_BRIGHTNESS && s_calls[0].arg == 20,
+        "mixed: first call is not brightness 20");
+  const call_t *p = &s_calls[1];
+  CHECK(p->kind == CALL_PLAY && p->effect == LED_EFFECT_SCROLL_TEXT,
+        "mixed: last effect not played");
+  CHECK(p->params.r == 1 && p->params.speed == 3 && p->params.delay_ms == 50,
+        "mixed: r %d speed %d delay %d", p->params.r, p->params.speed,
+        (int)p->params.delay_ms);
+  CHECK(p->duration_ms == 500, "mixed: duration %lu",
+        (unsigned long)p->duration_ms);
+  CHECK(strcmp(p->params.text, "hello world") == 0, "mixed: text '%s'",
+        p->params.text);
+  CHECK(s_stats.coalesced == 3 && s_stats.applied == 2,
+        "mixed: coalesced %lu applied %lu", (unsigned long)s_stats.coalesced,
+        (unsigned long)s_stats.applied);
+}
+
+// A scene carries its own brightness: a brightness command that came
+// before it must not override it, one that came after must
+static void test_scene_order(void) {
+  reset();
+  send("brightness", "50");
+  send("scene", "2");
+  apply_pending();
+  CHECK(s_n_calls == 2 && s_calls[0].kind == CALL_BRIGHTNESS &&
+            s_calls[1].kind == CALL_SCENE && s_calls[1].arg == 2,
+        "brightness, scene: applied in the wrong order");
+
+  reset();
+  send("scene", "3");
+  send("brightness", "80");
+  apply_pending();
+  CHECK(s_n_calls == 2 && s_calls[0].kind == CALL_SCENE &&
+            s_calls[1].kind == CALL_BRIGHTNESS && s_calls[1].arg == 80,
+        "scene, brightness: applied in the wrong order");
+
+  // a newer scene replaces the older one but keeps its place after the
+  // brightness that came between them
+  reset();
+  send("scene", "1");
+  send("brightness", "40");
+  send("scene", "4");
+  apply_pending();
+  CHECK(s_n_calls == 2 && s_calls[0].kind == CALL_BRIGHTNESS &&
+            s_calls[1].kind == CALL_SCENE && s_calls[1].arg == 4,
+        "scene, brightness, scene: applied in the wrong order");
+}
+
+static void test_rejects(void) {
+  reset();
+  send("effect", "nosuch");
+  send("effect", "plasma speed=300");
+  send("effect", "plasma bogus");
+  send("color", "1,2");
+  send("color", "#12345");
+  send("brightness", "256");
+  send("scene", "x");
+  send("volume", "3");
+  apply_pending();
+  CHECK(s_n_calls == 0, "rejects: %d calls", s_n_calls);
+  CHECK(s_stats.received == 8 && s_stats.rejected == 8,
+        "rejects: received %lu rejected %lu", (unsigned long)s_stats.received,
+        (unsigned long)s_stats.rejected);
+
+  // a bad message does not drop the good one before it
+  reset();
+  send("color", "0,0,9");
+  send("color", "oops");
+  apply_pending();
+  CHECK(s_n_calls == 1 && s_calls[0].params.b == 9,
+        "rejects: good command before a bad one lost");
+}
+
+int main(void) {
+  strcpy(s_hub, "hub1");
+  topic(s_set_prefix, sizeof(s_set_prefix), "set/");
+
+  test_color_burst();
+  test_mixed_burst();
+  test_scene_order();
+  test_rejects();
+
+  if (s_failed) {
+    printf("%d checks failed\n", s_failed);
+    return 1;
+  }
+  printf("mqtt_ctl: ok\n");
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include "led_bench.h"
+#include "led_layout.h"
+#include "led_render.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+// The effects are built without the render task; what they reach of it
+// is stubbed here
+void led_render_play(led_effect_id_t id, const led_effect_params_t *params,
+                     uint32_t duration_ms) {}
+void led_render_layer_play(int layer, led_effect_id_t id,
+                           const led_effect_params_t *params,
+                           uint32_t duration_ms) {}
+uint32_t led_render_frame_gen(void) { return 0; }
+bool led_render_wait_frame(uint32_t gen, uint32_t timeout_ms) { return true; }
+int ws2812_get_num_leds(void) { return CONFIG_LED_STRIP_COUNT; }
+
+static bool check(const led_regress_result_t *r) {
+  if (!r->hash_ok) {
+    printf("FAIL %s: hash %08lx, golden %08lx\n", r->name,
+           (unsigned long)r->hash, (unsigned long)r->golden);
+  }
+  if (r->us_max > CONFIG_LED_REGRESS_FRAME_US) {
+    printf("FAIL %s: frame cost %lu us, budget %d us\n", r->name,
+           (unsigned long)r->us_max, CONFIG_LED_REGRESS_FRAME_US);
+  }
+  if (r->jitter_us_max > CONFIG_LED_REGRESS_JITTER_US) {
+    printf("FAIL %s: frame %lu us late, budget %d us\n", r->name,
+           (unsigned long)r->jitter_us_max, CONFIG_LED_REGRESS_JITTER_US);
+  }
+  return r->pass;
+}
+
+// Run every effect on the virtual clock and compare its frame hashes with
+// the table in led_bench.c, and fail any effect over the frame cost
+// budget. --system paces a short run on the system clock instead, to
+// check the jitter budget as well (no hashes, the table is for 10 s).
+// --print lists the hashes to update the table with.
+int main(int argc, char **argv) {
+  bool print = argc > 1 && strcmp(argv[1], "--print") == 0;
+  bool system = argc > 1 && strcmp(argv[1], "--system") == 0;
+  const led_clock_t *clock = system ? &led_clock_system : &led_clock_virtual;
+  int seconds = system ? 1 : 10;
+
+  int n_golden = 0;
+  const uint32_t *golden = NULL;
+  if (!system) {
+    golden = led_bench_golden(seconds, &n_golden);
+    if (!golden) {
+      printf("FAIL no golden table for this configuration\n");
+      return 1;
+    }
+  }
+  if (print) {
+    n_golden = 0;
+  }
+
+  led_layout_init(CONFIG_LED_STRIP_COUNT);
+  led_regress_result_t res[LED_EFFECT_COUNT];
+  if (led_bench_regress(clock, seconds, golden, n_golden, res) != ESP_OK) {
+    printf("FAIL led_bench_regress\n");
+    return 1;
+  }
+
+  int failed = 0;
+  for (int i = 0; i < LED_EFFECT_COUNT; i++) {
+    if (print) {
+      char id[32];
+      for (int k = 0; k < sizeof(id); k++) {
+        id[k] = toupper((unsigned char)res[i].name[k]);
+        if (!id[k]) {
+          break;
+        }
+      }
+      if (i != LED_EFFECT_SHADER) {
+        printf("    [LED_EFFECT_%s] = 0x%08lx,\n", id,
+               (unsigned long)res[i].hash);
+      }
+      continue;
+    }
+    printf("%-14s %5lu us max (budget %d), %5lu us late (budget %d)\n",
+           res[i].name, (unsigned long)res[i].us_max,
+           CONFIG_LED_REGRESS_FRAME_US, (unsigned long)res[i].jitter_us_max,
+           CONFIG_LED_REGRESS_JITTER_US);
+    if (!check(&res[i])) {
+      failed++;
+    }
+  }
+  if (failed) {
+    printf("%d effects failed\n", failed);
+    return 1;
+  }
+  if (!print) {
+    printf("regress (%s clock): ok\n", clock->name);
+  }
+  return 0;
+}
@@ -1,11 +1,43 @@
-#include "driver/gpio.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "http_web.h"
 #include "led_api.h"
+#include "led_effects.h"
+#include "led_render.h"
+#include "mqtt_ctl.h"
 #include "nvs_flash.h"
+#include "scene.h"
+#include "sync.h"
 #include "wifi_connect.h"
 
+static const char *TAG = "main";
+
+#if CONFIG_SYNC_ENABLED
+// Network time of all hubs, as a pipeline clock
+static const led_clock_t s_sync_clock = {
+    .name = "sync",
+    .now_us = sync_now_us,
+    .sleep_until_us = sync_sleep_until_us,
+    .steps = sync_steps,
+};
+#endif
+
+// log how long the boot took until LEDs and HTTP were usable
+static void boot_report(int64_t http_ready_us) {
+  led_render_stats_t st;
+  led_render_get_stats(&st);
+
+  if (st.first_frame_us) {
+    ESP_LOGI(TAG, "Boot: first pixel after %lld ms",
+             (long long)(st.first_frame_us / 1000));
+  } else {
+    ESP_LOGW(TAG, "Boot: no frame shown yet");
+  }
+  ESP_LOGI(TAG, "Boot: HTTP ready after %lld ms",
+           (long long)(http_ready_us / 1000));
+}
+
 // main loop
 void app_main(void) {
   esp_err_t ret = nvs_flash_init();
@@ -14,41 +46,51 @@ void app_main(void) {
     ESP_ERROR_CHECK(nvs_flash_erase());
     ESP_ERROR_CHECK(nvs_flash_init());
   }
-  ESP_LOGI("main", "=== LED TEST START ===");
-  ws2812_init(27, 12);
-
-  gpio_set_drive_capability(GPIO_NUM_27, GPIO_DRIVE_CAP_3);
-
-  for (int i = 0; i < 5; i++) {
-    ESP_LOGI("main", "Test %d: RED", i);
-    ws2812_set_all(200, 0, 0);
-    ws2812_show();
-    vTaskDelay(pdMS_TO_TICKS(1000));
-
-    ESP_LOGI("main", "Test %d: GREEN", i);
-    ws2812_set_all(0, 200, 0);
-    ws2812_show();
-    vTaskDelay(pdMS_TO_TICKS(1000));
-
-    ESP_LOGI("main", "Test %d: BLUE", i);
-    ws2812_set_all(0, 0, 200);
-    ws2812_show();
-    vTaskDelay(pdMS_TO_TICKS(1000));
-
-    ESP_LOGI("main", "Test %d: OFF", i);
-    ws2812_clear();
-    vTaskDelay(pdMS_TO_TICKS(1000));
+
+  // LEDs first, the render task draws while the rest comes up. Pin, count
+  // and chip come from menuconfig (LED strip).
+  ret = ws2812_init();
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "LED strip init failed: %s", esp_err_to_name(ret));
+  }
+  if (led_render_start() != ESP_OK) {
+    ESP_LOGE(TAG, "LED render task not started");
   }
 
-  ESP_LOGI("main", "=== LED TEST DONE ===");
+  // last scene from before the reboot, before anything network related
+  scene_init();
+  if (scene_restore_last() != ESP_OK) {
+#if CONFIG_BOOT_SELF_TEST
+    led_self_test(CONFIG_BOOT_SELF_TEST_STEP_MS);
+#else
+    led_solid(0, 0, 0);
+#endif
+  }
 
-  // try to connect or start AP mode
+  // try to connect or start AP mode, returns without waiting for an IP
   wifi_connect();
-  // wait for connect (returns false if AP-mode)
-  wifi_wait_until_connected(10000);
 
-  // start API
+#if CONFIG_SYNC_ENABLED
+  // render against the shared network clock of all hubs
+  if (sync_start() == ESP_OK) {
+    led_render_set_clock(&s_sync_clock, CONFIG_SYNC_START_QUANTUM_MS);
+  }
+#endif
+
+#if CONFIG_MQTT_CTL_ENABLED
+  // connects in the background, commands are applied once per frame
+  mqtt_ctl_start();
+#endif
+
+  // start API right away, it answers as soon as the network is up
   http_api_start();
+  boot_report(esp_timer_get_time());
+
+  // wait for connect (returns false if AP-mode)
+  if (wifi_wait_until_connected(10000)) {
+    ESP_LOGI(TAG, "Boot: WiFi connected after %lld ms",
+             (long long)(esp_timer_get_time() / 1000));
+  }
   // log
   wifi_print_status();
 }
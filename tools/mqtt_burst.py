@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Send a command burst to a hub over MQTT and check where it settled.
+
+    mosquitto -p 1883 &                # broker on loopback
+    tools/mqtt_burst.py hub-a1b2c3
+    tools/mqtt_burst.py hub1 --broker 192.168.1.10 --count 200
+
+The hub needs CONFIG_MQTT_CTL_ENABLED and its broker URI pointed at the
+same broker, e.g. mqtt://127.0.0.1:1883 for a build running on this
+machine. Publishes --count colors, a brightness and an effect as fast as
+the broker takes them, then reads the retained state: the hub must end up
+on the last effect with the last brightness, whatever it skipped on the
+way. Needs mosquitto_pub and mosquitto_sub. The coalescing and ordering
+rules themselves are covered without a broker by host_test/test_mqtt_ctl.
+"""
+
+import argparse
+import json
+import subprocess
+import sys
+import time
+
+
+def sub_one(args, leaf, wait_s=5):
+    """First (retained) message on <prefix>/<hub>/<leaf>, None on timeout"""
+    cmd = ["mosquitto_sub", "-h", args.broker, "-p", str(args.port),
+           "-t", "%s/%s/%s" % (args.prefix, args.hub, leaf),
+           "-C", "1", "-W", str(wait_s)]
+    r = subprocess.run(cmd, capture_output=True, text=True)
+    return r.stdout.strip() if r.returncode == 0 else None
+
+
+def pub(args, what, lines):
+    cmd = ["mosquitto_pub", "-h", args.broker, "-p", str(args.port),
+           "-t", "%s/%s/set/%s" % (args.prefix, args.hub, what), "-l"]
+    subprocess.run(cmd, input="\n".join(lines) + "\n", text=True, check=True)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("hub", help="hub id in the topics, e.g. hub-a1b2c3")
+    ap.add_argument("--broker", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--prefix", default="tissla")
+    ap.add_argument("--count", type=int, default=50,
+                    help="color commands before the final ones")
+    args = ap.parse_args()
+
+    try:
+        status = sub_one(args, "status")
+        if status != "online":
+            print("mqtt_burst: hub %s not online (status %r)" % (
+                args.hub, status), file=sys.stderr)
+            return 2
+
+        pub(args, "color", ["%d,0,0" % (i % 256) for i in range(args.count)])
+        pub(args, "brightness", ["200", "77"])
+        pub(args, "effect", ["plasma speed=7"])
+    except (OSError, subprocess.CalledProcessError) as e:
+        print("mqtt_burst: %s" % e, file=sys.stderr)
+        return 2
+
+    # one frame to apply, then the state message is rate limited
+    time.sleep(1.0)
+    body = sub_one(args, "state")
+    try:
+        st = json.loads(body or "")
+    except ValueError:
+        print("mqtt_burst: no state: %r" % body, file=sys.stderr)
+        return 2
+
+    ok = (st.get("effect") == "plasma" and st.get("speed") == 7 and
+          st.get("brightness") == 77)
+    print("%s: state %s" % ("PASS" if ok else "FAIL", json.dumps(st)))
+    metrics = sub_one(args, "metrics", wait_s=1)
+    if metrics:
+        print("metrics %s" % metrics)
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
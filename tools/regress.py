@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Run the on-device regression check and fail the shell on a regression.
+
+    tools/regress.py 192.168.4.1
+    tools/regress.py hub.local --clock system --seconds 2
+
+Calls GET /regress and exits 0 only if every effect passed. Without
+--golden the device checks against the table built into its firmware
+(led_bench_golden), which exists for the default configuration only;
+"golden": "none" in the reply means the hashes were not checked.
+"""
+
+import argparse
+import json
+import sys
+import urllib.parse
+import urllib.request
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("host", help="device address, e.g. 192.168.4.1")
+    ap.add_argument("--clock", choices=("virtual", "system"),
+                    default="virtual")
+    ap.add_argument("--seconds", type=int, default=10)
+    ap.add_argument("--golden", help="comma-separated hashes in effect order")
+    ap.add_argument("--require-golden", action="store_true",
+                    help="fail if the hashes were not checked")
+    args = ap.parse_args()
+
+    query = {"clock": args.clock, "seconds": args.seconds}
+    if args.golden:
+        query["golden"] = args.golden
+    url = "http://%s/regress?%s" % (args.host, urllib.parse.urlencode(query))
+    try:
+        # a real-time run takes seconds per effect
+        with urllib.request.urlopen(url, timeout=120) as resp:
+            body = resp.read().decode()
+    except Exception as e:
+        print("regress: %s: %s" % (url, e), file=sys.stderr)
+        return 2
+    try:
+        res = json.loads(body)
+    except ValueError:
+        print("regress: not JSON: %s" % body.strip(), file=sys.stderr)
+        return 2
+
+    for fx in res["effects"]:
+        print("%-5s %-14s %s%s %6d us %6d us late" % (
+            "ok" if fx["pass"] else "FAIL", fx["name"], fx["hash"],
+            "" if fx["hash_ok"] else " (changed)", fx["us_max"],
+            fx["jitter_us_max"]))
+    print("%s: %d LEDs, %s clock, golden %s" % (
+        "PASS" if res["pass"] else "FAIL", res["leds"], res["clock"],
+        res["golden"]))
+
+    if not res["pass"]:
+        return 1
+    if args.require_golden and res["golden"] == "none":
+        print("regress: no golden hashes for this configuration",
+              file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())